@@ -8,8 +8,6 @@
 **  This program is under the terms of the BSD License.
 */
 
-#include <thread>
-
 //IDA
 #include <idp.hpp>
 #include <dbg.hpp>
@@ -29,6 +27,13 @@
 #include "context.hpp"
 #include "solver.hpp"
 #include "triton_logic.hpp"
+#include "shadow_state.hpp"
+#include "annotation_queue.hpp"
+#include "hybrid_execution.hpp"
+#include "progress_panel.hpp"
+#include "snapshot_chooser.hpp"
+#include "solver_results.hpp"
+#include "session.hpp"
 
 //Triton
 #include <triton/context.hpp>
@@ -51,6 +56,7 @@ int taint_symbolize_register(const qstring& selected, action_activation_ctx_t* a
 
         // Before symbolizing register we should set his concrete value
         needConcreteRegisterValue_cb(tritonCtx, register_to_symbolize);
+        snapshot_manager.recordEngineRegister(register_to_symbolize);
 
         if (cmdOptions.use_tainting_engine) {
             tritonCtx.taintRegister(register_to_symbolize);
@@ -58,8 +64,10 @@ int taint_symbolize_register(const qstring& selected, action_activation_ctx_t* a
         else{ // Symbolize register            
             tritonCtx.symbolizeRegister(register_to_symbolize, std::string(comment));
         }
+        shadow_state.invalidate();
 
         tritonize(pc);
+        annotation_queue.flush();
         return 0;
     }
     return 0;
@@ -207,6 +215,7 @@ struct ah_taint_symbolize_memory_t : public action_handler_t
         for (unsigned int i = 0; i < selection_length; i++) {
             needConcreteMemoryValue_cb(tritonCtx, triton::arch::MemoryAccess(selection_starts + i, 1));
         }
+        snapshot_manager.recordEngineMemory(selection_starts, selection_length);
 
         if (cmdOptions.use_tainting_engine) {
             for (unsigned int i = 0; i < selection_length; i++) {
@@ -224,7 +233,9 @@ struct ah_taint_symbolize_memory_t : public action_handler_t
             }
         }
 
+        shadow_state.invalidate();
         tritonize(current_instruction());
+        annotation_queue.flush();
 
         // Reset tracer timing counter since user was using IDA and not just tracing
         ponce_runtime_status.tracing_start_time = GetTimeMs64();
@@ -318,8 +329,7 @@ struct ah_negate_and_inject_t : public action_handler_t
             if (cmdOptions.showDebugInfo)
                 msg("[+] Negating condition at " MEM_FORMAT "\n", action_activation_ctx->cur_ea);
 
-            std::thread t(negate_inject_maybe_restore_solver, action_activation_ctx->cur_ea, symbolic_condition_index, false);
-            t.detach();            
+            negate_inject_maybe_restore_solver(action_activation_ctx->cur_ea, symbolic_condition_index, false);
         }
 
         // Reset tracer timing counter since user was using IDA and not just tracing
@@ -332,10 +342,11 @@ struct ah_negate_and_inject_t : public action_handler_t
         //Only if process is being debugged
         if (is_debugger_on()) {
             //If we are in runtime and it is the last instruction we test if it is symbolize
-            if (ponce_runtime_status.last_triton_instruction != NULL &&
-                ponce_runtime_status.last_triton_instruction->getAddress() == ctx->cur_ea &&
-                ponce_runtime_status.last_triton_instruction->isBranch() &&
-                ponce_runtime_status.last_triton_instruction->isSymbolized()) {
+            const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+            if (last_instruction != nullptr &&
+                last_instruction->getAddress() == ctx->cur_ea &&
+                last_instruction->isBranch() &&
+                last_instruction->isSymbolized()) {
 
                 unsigned int path_constraint_index = 0;
                 for (const auto& pc : tritonCtx.getPathConstraints()) {
@@ -388,8 +399,7 @@ struct ah_negate_inject_and_restore_t : public action_handler_t
             if (cmdOptions.showDebugInfo)
                 msg("[+] Negating condition at " MEM_FORMAT "\n", action_activation_ctx->cur_ea);
 
-            std::thread t(negate_inject_maybe_restore_solver, action_activation_ctx->cur_ea, symbolic_condition_index, true);
-            t.detach();
+            negate_inject_maybe_restore_solver(action_activation_ctx->cur_ea, symbolic_condition_index, true);
         }
         // Reset tracer timing counter since user was using IDA and not just tracing
         ponce_runtime_status.tracing_start_time = GetTimeMs64();
@@ -399,12 +409,13 @@ struct ah_negate_inject_and_restore_t : public action_handler_t
     virtual action_state_t idaapi update(action_update_ctx_t* ctx)
     {
         //Only if process is being debugged
-        if (is_debugger_on() && snapshot.exists()) {
+        if (is_debugger_on() && snapshot_manager.exists()) {
             //If we are in runtime and it is the last instruction we test if it is symbolize
-            if (ponce_runtime_status.last_triton_instruction != NULL &&
-                ponce_runtime_status.last_triton_instruction->getAddress() == ctx->cur_ea &&
-                ponce_runtime_status.last_triton_instruction->isBranch() &&
-                ponce_runtime_status.last_triton_instruction->isSymbolized()) {
+            const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+            if (last_instruction != nullptr &&
+                last_instruction->getAddress() == ctx->cur_ea &&
+                last_instruction->isBranch() &&
+                last_instruction->isSymbolized()) {
 
 
                 for (const auto& pc : tritonCtx.getPathConstraints()) {
@@ -438,18 +449,8 @@ struct ah_create_snapshot_t : public action_handler_t
 {
     virtual int idaapi activate(action_activation_ctx_t* ctx)
     {
-        ea_t xip;
-        if (!get_ip_val(&xip)) {
-            msg("Could not get the XIP value. This should never happen\n");
-            return 0;
-        }
-
-        ponce_set_cmt(xip, "Snapshot taken here", false, true, false);
-        ponce_set_item_color(xip, 0x00FFFF);
-
-        snapshot.takeSnapshot();
-        snapshot.setAddress(xip); // We will use this address later to delete the comment
-        msg("Snapshot Taken\n");
+        take_snapshot_here("");
+        refresh_snapshot_chooser();
 
         // Reset tracer timing counter since user was using IDA and not just tracing
         ponce_runtime_status.tracing_start_time = GetTimeMs64();
@@ -458,8 +459,8 @@ struct ah_create_snapshot_t : public action_handler_t
 
     virtual action_state_t idaapi update(action_update_ctx_t* ctx)
     {
-        //Only if process is being debugged and there is not previous snaphot
-        if (is_debugger_on() && !snapshot.exists())
+        //Only if process is being debugged, the new snapshot is a child of the current one
+        if (is_debugger_on())
             return AST_ENABLE;
         else
             return AST_DISABLE;
@@ -479,8 +480,10 @@ struct ah_restore_snapshot_t : public action_handler_t
 {
     virtual int idaapi activate(action_activation_ctx_t* ctx)
     {
-        snapshot.restoreSnapshot();
-        msg("Snapshot restored\n");
+        //The closest snapshot taken by hand, the checkpoints are restored from the snapshots window
+        if (snapshot_manager.restoreSnapshot())
+            msg("Snapshot restored\n");
+        refresh_snapshot_chooser();
 
         // Reset tracer timing counter since user was using IDA and not just tracing
         ponce_runtime_status.tracing_start_time = GetTimeMs64();
@@ -490,7 +493,7 @@ struct ah_restore_snapshot_t : public action_handler_t
     virtual action_state_t idaapi update(action_update_ctx_t* ctx)
     {
         //Only if process is being debugged and there is an existent shapshot
-        if (is_debugger_on() && snapshot.exists())
+        if (is_debugger_on() && snapshot_manager.exists())
             return AST_ENABLE;
         else
             return AST_DISABLE;
@@ -510,8 +513,10 @@ struct ah_delete_snapshot_t : public action_handler_t
 {
     virtual int idaapi activate(action_activation_ctx_t* ctx)
     {
-        snapshot.resetEngine();
-        msg("[+] Snapshot removed\n");
+        //The last snapshot taken or restored, the rest are deleted from the snapshots window
+        if (snapshot_manager.deleteSnapshot(snapshot_manager.getCurrent()))
+            msg("[+] Snapshot removed\n");
+        refresh_snapshot_chooser();
 
         // Reset tracer timing counter since user was using IDA and not just tracing
         ponce_runtime_status.tracing_start_time = GetTimeMs64();
@@ -521,7 +526,7 @@ struct ah_delete_snapshot_t : public action_handler_t
     virtual action_state_t idaapi update(action_update_ctx_t* ctx)
     {
         //Only if there is an existent shapshot
-        if (snapshot.exists())
+        if (snapshot_manager.exists())
             return AST_ENABLE;
         else
             return AST_DISABLE;
@@ -537,6 +542,72 @@ static const action_desc_t action_IDA_deleteSnapshot = ACTION_DESC_LITERAL(
     NULL,
     130);
 
+struct ah_save_session_t : public action_handler_t
+{
+    virtual int idaapi activate(action_activation_ctx_t* ctx)
+    {
+        qstring default_path = default_session_path();
+        const char* path = ask_file(true, default_path.c_str(), "FILTER Ponce sessions|*.ponce\nSave the Ponce session");
+        if (path != NULL)
+            save_session(path);
+
+        // Reset tracer timing counter since user was using IDA and not just tracing
+        ponce_runtime_status.tracing_start_time = GetTimeMs64();
+        return 0;
+    }
+
+    virtual action_state_t idaapi update(action_update_ctx_t* ctx)
+    {
+        //Only if the process is suspended
+        if (is_debugger_on() && get_process_state() == DSTATE_SUSP)
+            return AST_ENABLE;
+        else
+            return AST_DISABLE;
+    }
+};
+static ah_save_session_t ah_save_session;
+
+static const action_desc_t action_IDA_saveSession = ACTION_DESC_LITERAL(
+    "Ponce:save_session",
+    "Save Session",
+    &ah_save_session,
+    NULL,
+    "Save the symbolic state, the memory written and the snapshots next to the IDB",
+    27);
+
+struct ah_load_session_t : public action_handler_t
+{
+    virtual int idaapi activate(action_activation_ctx_t* ctx)
+    {
+        qstring default_path = default_session_path();
+        const char* path = ask_file(false, default_path.c_str(), "FILTER Ponce sessions|*.ponce\nLoad a Ponce session");
+        if (path != NULL && load_session(path))
+            annotation_queue.flush();
+
+        // Reset tracer timing counter since user was using IDA and not just tracing
+        ponce_runtime_status.tracing_start_time = GetTimeMs64();
+        return 0;
+    }
+
+    virtual action_state_t idaapi update(action_update_ctx_t* ctx)
+    {
+        //Only if the process is suspended
+        if (is_debugger_on() && get_process_state() == DSTATE_SUSP)
+            return AST_ENABLE;
+        else
+            return AST_DISABLE;
+    }
+};
+static ah_load_session_t ah_load_session;
+
+static const action_desc_t action_IDA_loadSession = ACTION_DESC_LITERAL(
+    "Ponce:load_session",
+    "Load Session",
+    &ah_load_session,
+    NULL,
+    "Load a saved session and go on from where it was saved",
+    25);
+
 struct ah_show_config_t : public action_handler_t
 {
     virtual int idaapi activate(action_activation_ctx_t* ctx)
@@ -607,6 +678,162 @@ action_desc_t action_IDA_show_expressionsWindow = ACTION_DESC_LITERAL(
     157); //Optional: the action icon (shows when in menus/toolbars)
 
 
+struct ah_show_progress_panel_t : public action_handler_t
+{
+    virtual int idaapi activate(action_activation_ctx_t* ctx)
+    {
+        //So we don't reopen twice the same window
+        if (ponce_progress_chooser != nullptr) {
+            auto form = find_widget(PROGRESS_PANEL_TITLE);
+            if (!form) {
+                msg("[!!] Could not find %s widget\n", PROGRESS_PANEL_TITLE);
+                return 0;
+            }
+            refresh_progress_panel(true);
+            activate_widget(form, true);
+        }
+        else {
+            ponce_progress_chooser = new ponce_progress_chooser_t();
+            ponce_progress_chooser->choose();
+        }
+        return 0;
+    }
+
+    virtual action_state_t idaapi update(action_update_ctx_t* ctx)
+    {
+        return AST_ENABLE;
+    }
+};
+static ah_show_progress_panel_t ah_show_progress_panel;
+
+action_desc_t action_IDA_show_progress_panel = ACTION_DESC_LITERAL(
+    "Ponce:show_progress_panel", // The action name. This acts like an ID and must be unique
+    "Show tracing progress", //The action text.
+    &ah_show_progress_panel, //The action handler.
+    NULL, //Optional: the action shortcut
+    "Show the live statistics of the tracing", //Optional: the action tooltip (available in menus/toolbar)
+    156); //Optional: the action icon (shows when in menus/toolbars)
+
+
+struct ah_show_snapshots_t : public action_handler_t
+{
+    virtual int idaapi activate(action_activation_ctx_t* ctx)
+    {
+        //So we don't reopen twice the same window
+        if (ponce_snapshot_chooser != nullptr) {
+            auto form = find_widget(SNAPSHOT_CHOOSER_TITLE);
+            if (!form) {
+                msg("[!!] Could not find %s widget\n", SNAPSHOT_CHOOSER_TITLE);
+                return 0;
+            }
+            refresh_snapshot_chooser();
+            activate_widget(form, true);
+        }
+        else {
+            ponce_snapshot_chooser = new ponce_snapshot_chooser_t();
+            ponce_snapshot_chooser->choose();
+        }
+        return 0;
+    }
+
+    virtual action_state_t idaapi update(action_update_ctx_t* ctx)
+    {
+        return AST_ENABLE;
+    }
+};
+static ah_show_snapshots_t ah_show_snapshots;
+
+action_desc_t action_IDA_show_snapshots = ACTION_DESC_LITERAL(
+    "Ponce:show_snapshots", // The action name. This acts like an ID and must be unique
+    "Show snapshots", //The action text.
+    &ah_show_snapshots, //The action handler.
+    NULL, //Optional: the action shortcut
+    "Show the snapshot tree, restore, rename or delete any snapshot", //Optional: the action tooltip (available in menus/toolbar)
+    129); //Optional: the action icon (shows when in menus/toolbars)
+
+
+struct ah_action_progress_pause_t : public action_handler_t
+{
+    virtual int idaapi activate(action_activation_ctx_t* ctx)
+    {
+        suspend_process();
+        return 0;
+    }
+
+    virtual action_state_t idaapi update(action_update_ctx_t* ctx)
+    {
+        if (ctx->widget_title != PROGRESS_PANEL_TITLE)
+            return AST_DISABLE_FOR_WIDGET;
+        return get_process_state() == DSTATE_RUN ? AST_ENABLE : AST_DISABLE;
+    }
+};
+static ah_action_progress_pause_t ah_action_progress_pause;
+
+action_desc_t action_progress_pause = ACTION_DESC_LITERAL(
+    "Ponce:action_progress_pause", // The action name. This acts like an ID and must be unique
+    "Pause tracing", //The action text.
+    &ah_action_progress_pause, //The action handler.
+    NULL, //Optional: the action shortcut
+    "Suspend the process, the tracing goes on when it is resumed", //Optional: the action tooltip (available in menus/toolbar)
+    -1); //Optional: the action icon (shows when in menus/toolbars)
+
+
+struct ah_action_progress_resume_t : public action_handler_t
+{
+    virtual int idaapi activate(action_activation_ctx_t* ctx)
+    {
+        continue_process();
+        return 0;
+    }
+
+    virtual action_state_t idaapi update(action_update_ctx_t* ctx)
+    {
+        if (ctx->widget_title != PROGRESS_PANEL_TITLE)
+            return AST_DISABLE_FOR_WIDGET;
+        return get_process_state() == DSTATE_SUSP ? AST_ENABLE : AST_DISABLE;
+    }
+};
+static ah_action_progress_resume_t ah_action_progress_resume;
+
+action_desc_t action_progress_resume = ACTION_DESC_LITERAL(
+    "Ponce:action_progress_resume", // The action name. This acts like an ID and must be unique
+    "Resume tracing", //The action text.
+    &ah_action_progress_resume, //The action handler.
+    NULL, //Optional: the action shortcut
+    "Continue the process", //Optional: the action tooltip (available in menus/toolbar)
+    -1); //Optional: the action icon (shows when in menus/toolbars)
+
+
+struct ah_action_progress_extend_t : public action_handler_t
+{
+    virtual int idaapi activate(action_activation_ctx_t* ctx)
+    {
+        //The budget starts again from now
+        ponce_runtime_status.current_trace_counter = 0;
+        ponce_runtime_status.tracing_start_time = GetTimeMs64();
+        msg("[+] Tracing budget extended: %u more instructions and %u more seconds\n", (unsigned int)cmdOptions.limitInstructionsTracingMode, (unsigned int)cmdOptions.limitTime);
+        refresh_progress_panel(true);
+        return 0;
+    }
+
+    virtual action_state_t idaapi update(action_update_ctx_t* ctx)
+    {
+        if (ctx->widget_title != PROGRESS_PANEL_TITLE)
+            return AST_DISABLE_FOR_WIDGET;
+        return is_debugger_on() ? AST_ENABLE : AST_DISABLE;
+    }
+};
+static ah_action_progress_extend_t ah_action_progress_extend;
+
+action_desc_t action_progress_extend = ACTION_DESC_LITERAL(
+    "Ponce:action_progress_extend", // The action name. This acts like an ID and must be unique
+    "Extend budget", //The action text.
+    &ah_action_progress_extend, //The action handler.
+    NULL, //Optional: the action shortcut
+    "Trace the configured number of instructions and seconds again before pausing", //Optional: the action tooltip (available in menus/toolbar)
+    -1); //Optional: the action icon (shows when in menus/toolbars)
+
+
 struct ah_action_chooser_add_constrain_t : public action_handler_t
 {
     virtual int idaapi activate(action_activation_ctx_t* ctx)
@@ -663,6 +890,7 @@ struct ah_action_chooser_add_constrain_t : public action_handler_t
         update_action_label(ctx->action, "Set constraint to symbolic variable");
 
         if (!ponce_table_chooser || 
+            ctx->widget_title != ponce_table_chooser->title ||
             ctx->chooser_selection.empty() ||
             cmdOptions.use_tainting_engine)
             return AST_DISABLE;
@@ -716,6 +944,7 @@ struct ah_action_chooser_comment_t : public action_handler_t
         update_action_label(ctx->action, "Set comment to symbolic variable");
 
         if (!ponce_table_chooser ||
+            ctx->widget_title != ponce_table_chooser->title ||
             ctx->chooser_selection.empty() ||
             cmdOptions.use_tainting_engine)
             return AST_DISABLE;
@@ -811,10 +1040,12 @@ struct ah_enable_disable_tracing_t : public action_handler_t
             // Ponce was already running (disable tracing)
             if (ask_for_execute_native()) {
                 //Deleting previous snapshot
-                snapshot.resetEngine();
+                snapshot_manager.resetEngine();
                 //Disabling step tracing...
                 disable_step_trace();
+                disarm_watchpoints();
                 ponce_runtime_status.runtimeTrigger.disable();
+                annotation_queue.flush();
                 if (cmdOptions.showDebugInfo)
                     msg("[+] Disabling step tracing\n");
             }
@@ -823,6 +1054,7 @@ struct ah_enable_disable_tracing_t : public action_handler_t
             // Ponce was not running (enable tracing)
             start_tainting_or_symbolic_analysis();
             tritonize(current_instruction());
+            annotation_queue.flush();
             if (cmdOptions.showDebugInfo)
                 msg("[+] Enabling step tracing\n");
         }
@@ -876,9 +1108,8 @@ struct ah_solve_formula_sub_t : public action_handler_t
         if (cmdOptions.showDebugInfo)
             msg("[+] Solving condition at address " MEM_FORMAT " with symbolic condition index %d\n", ctx->cur_ea, path_constraint_index);
         
-        std::thread t(solve_formula, ctx->cur_ea, path_constraint_index);
-        t.detach();
-        
+        solve_formula(ctx->cur_ea, path_constraint_index, nullptr);
+
         // Reset tracer timing counter since user was using IDA and not just tracing
         ponce_runtime_status.tracing_start_time = GetTimeMs64();
         return 0;
@@ -920,8 +1151,7 @@ struct ah_solve_formula_choose_index_sub_t : public action_handler_t
             if (cmdOptions.showDebugInfo)
                 msg("[+] Solving condition at address " MEM_FORMAT " with symbolic condition index %d\n", ctx->cur_ea, path_constraint_index);
             
-            std::thread t(solve_formula, ctx->cur_ea, path_constraint_index);
-            t.detach();
+            solve_formula(ctx->cur_ea, path_constraint_index, nullptr);
         }
 
         // Reset tracer timing counter since user was using IDA and not just tracing
@@ -948,6 +1178,35 @@ action_desc_t action_IDA_solve_formula_choose_index_sub = ACTION_DESC_LITERAL(
 
 
 
+struct ah_solve_all_branches_t : public action_handler_t
+{
+    virtual int idaapi activate(action_activation_ctx_t* ctx)
+    {
+        solve_all_branches();
+
+        // Reset tracer timing counter since user was using IDA and not just tracing
+        ponce_runtime_status.tracing_start_time = GetTimeMs64();
+        return 0;
+    }
+
+    virtual action_state_t idaapi update(action_update_ctx_t* ctx)
+    {
+        if (!cmdOptions.use_tainting_engine && !tritonCtx.getPathConstraints().empty())
+            return AST_ENABLE;
+        return AST_DISABLE;
+    }
+};
+static ah_solve_all_branches_t ah_solve_all_branches;
+
+action_desc_t action_IDA_solve_all_branches = ACTION_DESC_LITERAL(
+    "Ponce:solve_all_branches", // The action name. This acts like an ID and must be unique
+    "Solve all symbolic branches", //The action text.
+    &ah_solve_all_branches, //The action handler.
+    "", //Optional: the action shortcut
+    "Solve every non taken branch of the path in the background and show the results", //Optional: the action tooltip (available in menus/toolbar)
+    13); //Optional: the action icon (shows when in menus/toolbars)
+
+
 struct ah_ponce_banner_t : public action_handler_t
 {
     virtual int idaapi activate(action_activation_ctx_t* ctx)
@@ -1024,13 +1283,20 @@ struct IDA_actions action_list[] =
     // Solve formula is handled separatly to be more user friendly
     // But still we want to register it in advance so it is always disable, so we define no views
     { &action_IDA_solve_formula_sub, { __END__ }, "SMT Solver/" },
+    { &action_IDA_solve_all_branches, { BWN_DISASM, __END__ }, "SMT Solver/" },
 
     { &action_IDA_createSnapshot, { BWN_DISASM, __END__ }, "Snapshot/"},
     { &action_IDA_restoreSnapshot, { BWN_DISASM, __END__ }, "Snapshot/" },
     { &action_IDA_deleteSnapshot, { BWN_DISASM, __END__ }, "Snapshot/" },
+    { &action_IDA_saveSession, { BWN_DISASM, __END__ }, "Snapshot/" },
+    { &action_IDA_loadSession, { BWN_DISASM, __END__ }, "Snapshot/" },
 
     { &action_chooser_comment, { BWN_CHOOSER, __END__ }, "" },
     { &action_chooser_add_constrain, { BWN_CHOOSER, __END__ }, "" },
 
+    { &action_progress_pause, { BWN_CHOOSER, __END__ }, "" },
+    { &action_progress_resume, { BWN_CHOOSER, __END__ }, "" },
+    { &action_progress_extend, { BWN_CHOOSER, __END__ }, "" },
+
     { NULL, __END__, __END__ }
 };
@@ -37,6 +37,8 @@ extern struct IDA_actions action_list[];
 
 extern action_desc_t action_IDA_show_config;
 extern action_desc_t action_IDA_show_expressionsWindow;
+extern action_desc_t action_IDA_show_progress_panel;
+extern action_desc_t action_IDA_show_snapshots;
 extern action_desc_t action_IDA_clean;
 extern action_desc_t action_IDA_unload;
 extern action_desc_t action_IDA_solve_formula_sub;
@@ -46,6 +48,7 @@ extern action_desc_t action_IDA_taint_symbolize_register;
 extern action_desc_t action_IDA_taint_symbolize_memory;
 extern action_desc_t action_IDA_ponce_banner;
 extern action_desc_t action_IDA_solve_formula_choose_index_sub;
+extern action_desc_t action_IDA_solve_all_branches;
 
 
 #define SYMBOLIC "Symbolic/"
@@ -0,0 +1,105 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+//Ponce
+#include "annotation_queue.hpp"
+#include "globals.hpp"
+#include "utils.hpp"
+
+//IDA
+#include <ida.hpp>
+#include <nalt.hpp>
+#include <kernwin.hpp>
+
+// Reading the clock for every traced instruction is noticeable too, we only do it every this many instructions
+#define FLUSH_CHECK_PERIOD 256
+
+AnnotationQueue annotation_queue;
+
+AnnotationQueue::AnnotationQueue() {
+    this->last_address = BADADDR;
+    this->last_flush = 0;
+    this->ticks = 0;
+}
+
+void AnnotationQueue::comment(ea_t address, const std::string& comment, bool count_hit) {
+    pending_annotation& annotation = this->pending[address];
+    annotation.comment = comment;
+    annotation.has_comment = true;
+    if (count_hit)
+        annotation.comment_hits++;
+    else
+        annotation.comment_hits = 0;
+}
+
+void AnnotationQueue::color(ea_t address, bgcolor_t color) {
+    this->pending[address].color = color;
+}
+
+void AnnotationQueue::executed(ea_t address) {
+    if (cmdOptions.color_executed_instruction == DEFCOLOR)
+        return;
+    this->pending[address].executed = true;
+}
+
+void AnnotationQueue::rename_function(ea_t address) {
+    if (this->functions_to_rename_set.insert(address).second)
+        this->functions_to_rename.push_back(address);
+}
+
+void AnnotationQueue::show(ea_t address) {
+    this->last_address = address;
+}
+
+void AnnotationQueue::flush(void) {
+    for (const auto& [address, annotation] : this->pending) {
+        if (annotation.has_comment) {
+            if (annotation.comment_hits == 0)
+                ponce_set_cmt(address, annotation.comment.c_str(), false, false, false);
+            else
+                ponce_add_cmt_hits(address, annotation.comment.c_str(), false, annotation.comment_hits);
+        }
+        if (annotation.color != DEFCOLOR) {
+            ponce_set_item_color(address, annotation.color);
+        }
+        //We only paint the executed instructions if they don't have a previous color
+        else if (annotation.executed && get_item_color(address) == DEFCOLOR) {
+            ponce_set_item_color(address, cmdOptions.color_executed_instruction);
+        }
+    }
+
+    for (const auto& address : this->functions_to_rename)
+        rename_tainted_function(address);
+
+    // Show analized instruction in IDA UI
+    if (this->last_address != BADADDR)
+        show_addr(this->last_address);
+
+    this->clear();
+    this->last_flush = GetTimeMs64();
+}
+
+void AnnotationQueue::flush_if_due(void) {
+    if (cmdOptions.annotations_refresh_interval == 0)
+        return;
+    if (++this->ticks < FLUSH_CHECK_PERIOD)
+        return;
+    this->ticks = 0;
+    if (GetTimeMs64() - this->last_flush >= cmdOptions.annotations_refresh_interval)
+        this->flush();
+}
+
+void AnnotationQueue::clear(void) {
+    this->pending.clear();
+    this->functions_to_rename.clear();
+    this->functions_to_rename_set.clear();
+    this->last_address = BADADDR;
+    this->ticks = 0;
+}
@@ -0,0 +1,84 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+//IDA
+#include <pro.h>
+#include <kernwin.hpp>
+
+struct pending_annotation {
+    //Last comment requested for the address
+    std::string comment;
+    //How many times the comment was requested since the last flush, 0 if it has to replace the previous one
+    unsigned int comment_hits = 0;
+    bool has_comment = false;
+    //Tainted/symbolic color, it takes precedence over the executed one
+    bgcolor_t color = DEFCOLOR;
+    //The instruction was executed, it is painted only if it doesn't have any other color
+    bool executed = false;
+};
+
+//! \class AnnotationQueue
+//! \brief Comments, colors and renames produced while tracing, written to the IDB in batches instead of once per instruction.
+class AnnotationQueue {
+
+private:
+    //! Pending annotations indexed by address, repeated hits are merged.
+    std::unordered_map<ea_t, pending_annotation> pending;
+
+    //! Addresses whose function has to be renamed, in the order they were tainted.
+    std::vector<ea_t> functions_to_rename;
+    std::unordered_set<ea_t> functions_to_rename_set;
+
+    //! Last traced address, the IDA view is moved there when flushing.
+    ea_t last_address;
+
+    //! Time of the last flush in ms, used for the periodic refresh.
+    std::uint64_t last_flush;
+
+    //! Instructions seen since the last time the clock was checked.
+    unsigned int ticks;
+
+public:
+    //! Constructor.
+    AnnotationQueue();
+
+    //! Adds a comment. If count_hit is set repeated comments are prefixed with the hit count, if not it replaces the previous one.
+    void comment(ea_t address, const std::string& comment, bool count_hit = true);
+
+    //! Paints an address with a tainted/symbolic color.
+    void color(ea_t address, bgcolor_t color);
+
+    //! Paints an address with the executed color if it isn't painted with any other color.
+    void executed(ea_t address);
+
+    //! Renames the function containing address with the tainted prefix.
+    void rename_function(ea_t address);
+
+    //! Moves the IDA view to address in the next flush.
+    void show(ea_t address);
+
+    //! Writes everything to the IDB and refreshes the IDA view.
+    void flush(void);
+
+    //! Called for every traced instruction, flushes if the user asked for periodic refreshes and the interval elapsed.
+    void flush_if_due(void);
+
+    //! Forgets everything not flushed yet.
+    void clear(void);
+};
+
+extern AnnotationQueue annotation_queue;
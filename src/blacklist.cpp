@@ -10,6 +10,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <unordered_map>
 
 // Ponce
 #include "blacklist.hpp"
@@ -17,6 +18,8 @@
 #include "callbacks.hpp"
 #include "utils.hpp"
 #include "triton_logic.hpp"
+#include "shadow_state.hpp"
+#include "annotation_queue.hpp"
 
 // IDA
 #include <ida.hpp>
@@ -27,7 +30,14 @@
 
 std::list<breakpoint_pending_action> breakpoint_pending_actions;
 
-std::vector<std::string> builtin_black_functions = {
+/* Verdict for every call site seen while tracing, so loops calling the same import don't look up its name again*/
+struct blacklist_verdict {
+    qstring callee;
+    bool blacklisted;
+};
+static std::unordered_map<ea_t, blacklist_verdict> blacklist_verdicts;
+
+std::unordered_set<std::string> builtin_black_functions = {
     "printf",
     "puts",
     "putc",
@@ -126,16 +136,19 @@ void concretizeAndUntaintVolatileRegisters()
     {
         for (auto i = 0; i < sizeof(volatile_regs) / sizeof(char*); i++) {
             if (strcmp(reg.getName().c_str(), volatile_regs[i]) == 0) {
+                snapshot_manager.recordEngineRegister(reg);
                 tritonCtx.concretizeRegister(reg);
                 tritonCtx.untaintRegister(reg);
             }
         }
     }
+    shadow_state.invalidate();
 }
 
 //Helper to concretize and untaint all registers
 void concretizeAndUntaintAllRegisters()
 {
+    snapshot_manager.recordEngineRegisters();
     tritonCtx.concretizeAllRegister();
     //We untaint all the registers
     auto regs = tritonCtx.getAllRegisters();
@@ -143,6 +156,7 @@ void concretizeAndUntaintAllRegisters()
     {
         tritonCtx.untaintRegister(it->second);
     }
+    shadow_state.invalidate();
 }
 
 /* We use this function to enable the trigger after a blacklisted function.
@@ -157,63 +171,84 @@ void enableTrigger_and_concretize_registers(ea_t main_address)
 void readBlacklistfile(char* path) {
     std::ifstream file(path);
     std::string str;
-    blacklkistedUserFunctions = new std::vector<std::string>();
+    blacklkistedUserFunctions = new std::unordered_set<std::string>();
     while (std::getline(file, str)) {
         if (cmdOptions.showDebugInfo)
             msg("[+] Adding %s to the blacklist funtion list\n", str.c_str());
-        blacklkistedUserFunctions->push_back(str);
+        blacklkistedUserFunctions->insert(str);
     }
+    //The verdicts were given with the previous list
+    clear_blacklist_cache();
+}
+
+void clear_blacklist_cache() {
+    blacklist_verdicts.clear();
+}
+
+/* Gives the verdict for the call at pc, looking up the names only the first time we see that call site*/
+static const blacklist_verdict& get_blacklist_verdict(ea_t pc) {
+    auto it = blacklist_verdicts.find(pc);
+    if (it != blacklist_verdicts.end())
+        return it->second;
+
+    //Let's check if the user provided any blacklist file or we sholuld use the built in one
+    const std::unordered_set<std::string>& to_use_blacklist = blacklkistedUserFunctions != nullptr ? *blacklkistedUserFunctions : builtin_black_functions;
+
+    blacklist_verdict verdict;
+    verdict.callee = get_callee_name(pc);
+    verdict.blacklisted = to_use_blacklist.find(verdict.callee.c_str()) != to_use_blacklist.end();
+    if (!verdict.blacklisted) {
+        //We also keep matching the name of the function the call belongs to, like we always did
+        qstring func_name;
+        if (get_func_name(&func_name, pc) > 0 && to_use_blacklist.find(func_name.c_str()) != to_use_blacklist.end()) {
+            verdict.callee = func_name;
+            verdict.blacklisted = true;
+        }
+    }
+    if (verdict.blacklisted && cmdOptions.showExtraDebugInfo)
+        msg("[+] Call to %s at " MEM_FORMAT " is blacklisted\n", verdict.callee.c_str(), pc);
+
+    return blacklist_verdicts.emplace(pc, verdict).first->second;
 }
 
 
 bool should_blacklist(ea_t pc, thid_t tid) {
-    insn_t cmd;
-    decode_insn(&cmd, pc);
+    const cached_instruction* cached = instruction_cache.get(pc);
+    if (cached == nullptr)
+        return false;
 
     // We do this to blacklist API that does not change the tainted input
-    if (cmd.itype == NN_call || cmd.itype == NN_callfi || cmd.itype == NN_callni)
+    if (cached->ins.itype == NN_call || cached->ins.itype == NN_callfi || cached->ins.itype == NN_callni)
     {
-        //qstring callee = get_callee_name(pc);
-        qstring callee;
-        auto callee_lenght = get_func_name(&callee, pc);
-        std::vector<std::string>* to_use_blacklist;
-
-        //Let's check if the user provided any blacklist file or we sholuld use the built in one
-        if (blacklkistedUserFunctions != nullptr) {
-            to_use_blacklist = blacklkistedUserFunctions;
-        }
-        else {//We need to use the built in one
-            to_use_blacklist = &builtin_black_functions;
-        }
-
-        for (const auto& blacklisted_function : *to_use_blacklist) {
-            if (strcmp(callee.c_str(), blacklisted_function.c_str()) == 0)
-            {
-                //We are in a call to a blacklisted function.
-                /*We should set a BP in the next instruction right after the
-                blacklisted callback to enable tracing again*/
-                ea_t next_ea = next_head(pc, BADADDR);
-                add_bpt(next_ea, 1, BPT_EXEC);
-                //We set a comment so the user know why there is a new bp there
-                ponce_set_cmt(next_ea, "Temporal bp set by ponce for blacklisting\n", false);
-
-                breakpoint_pending_action bpa;
-                bpa.address = next_ea;
-                bpa.ignore_breakpoint = false;
-                bpa.callback = enableTrigger_and_concretize_registers; // We will enable back the trigger when this bp get's reached
-
-                //We add the action to the list
-                breakpoint_pending_actions.push_back(bpa);
-
-                //Disabling step tracing...
-                disable_step_trace();
-
-                //We want to tritonize the call, so the memory write for the ret address in the stack will be restore by the snapshot
-                tritonize(pc, tid);
-                ponce_runtime_status.runtimeTrigger.disable();
-
-                return true;
-            }
+        if (get_blacklist_verdict(pc).blacklisted)
+        {
+            //We are in a call to a blacklisted function.
+            /*We should set a BP in the next instruction right after the
+            blacklisted callback to enable tracing again*/
+            ea_t next_ea = next_head(pc, BADADDR);
+            add_bpt(next_ea, 1, BPT_EXEC);
+            //We set a comment so the user know why there is a new bp there
+            ponce_set_cmt(next_ea, "Temporal bp set by ponce for blacklisting\n", false);
+
+            breakpoint_pending_action bpa;
+            bpa.address = next_ea;
+            bpa.ignore_breakpoint = false;
+            bpa.callback = enableTrigger_and_concretize_registers; // We will enable back the trigger when this bp get's reached
+
+            //We add the action to the list
+            breakpoint_pending_actions.push_back(bpa);
+
+            //Disabling step tracing...
+            disable_step_trace();
+
+            //We want to tritonize the call, so the memory write for the ret address in the stack will be restore by the snapshot
+            tritonize(pc, tid);
+            snapshot_manager.recordUntracedSpan();
+            ponce_runtime_status.runtimeTrigger.disable();
+            //The function is going to run natively, nothing else will be annotated until it returns
+            annotation_queue.flush();
+
+            return true;
         }
     }
     return false;
@@ -12,6 +12,7 @@
 #include <vector>
 #include <string>
 #include <list>
+#include <unordered_set>
 
 #include <ida.hpp>
 #include <idd.hpp>
@@ -25,9 +26,13 @@ typedef struct
     bool ignore_breakpoint;
     //This is the callback will be executed when this breakpoint is reached
     void(*callback)(ea_t);
+    //Set for the read/write page breakpoints used by the hybrid execution, they cover [address, address + size)
+    bool watchpoint = false;
+    asize_t size = 1;
 } breakpoint_pending_action;
 
 extern std::list<breakpoint_pending_action> breakpoint_pending_actions;
 
 
-bool should_blacklist(ea_t pc, thid_t tid = 0);
\ No newline at end of file
+bool should_blacklist(ea_t pc, thid_t tid = 0);
+void clear_blacklist_cache();
\ No newline at end of file
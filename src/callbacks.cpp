@@ -20,6 +20,13 @@
 #include "blacklist.hpp"
 #include "actions.hpp"
 #include "triton_logic.hpp"
+#include "annotation_queue.hpp"
+#include "hybrid_execution.hpp"
+#include "trace_scope.hpp"
+#include "transition_sites.hpp"
+#include "progress_panel.hpp"
+#include "snapshot_chooser.hpp"
+#include "fork_checkpoint.hpp"
 
 //IDA
 #include <ida.hpp>
@@ -32,10 +39,39 @@
 #include <triton/context.hpp>
 #include "triton/x86Specifications.hpp"
 
+// Traced instructions between two reads of the clock
+#define CLOCK_CHECK_PERIOD 128
+
+/*Suspends the process when the tracing budget is exhausted. Continuing the process traces with a new budget,
+so an unattended trace is never blocked by a modal dialog*/
+static void pause_tracing_on_budget(const char* reason)
+{
+    msg("[!] %s, process suspended (Traced %d instructions). Continue the process to trace with a new budget\n", reason, ponce_runtime_status.total_number_traced_ins);
+    ponce_runtime_status.budget_exhausted = true;
+    ponce_runtime_status.current_trace_counter = 0;
+    ponce_runtime_status.tracing_start_time = 0;
+    suspend_process();
+}
+
 ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list va)
 {
     //if (cmdOptions.showExtraDebugInfo)
     //    msg("[+] Notification code: %d str: %s\n", notification_code, notification_code_to_string(notification_code).c_str());
+
+    //Every debugger event means the debuggee may have run, the registers read in the previous stop are not valid anymore
+    invalidate_register_cache();
+    //While tracing we see every write done by the traced thread. Any other event (breakpoints after running natively a blacklisted function,
+    //suspensions, user steps...) means the debuggee may have written memory we didn't see. The other threads are not traced,
+    //like Triton we follow one thread and only forget the memory when the debugger switches to another one
+    static thid_t cached_thread = NO_THREAD;
+    thid_t current_thread = get_current_thread();
+    if (notification_code != dbg_trace || current_thread != cached_thread)
+        memory_cache.clear();
+    cached_thread = current_thread;
+    //The debuggee is running code injected by Ponce or the debugger is switching to a forked snapshot
+    if (fork_switch_in_progress())
+        return 0;
+
     switch (notification_code)
     {
     case dbg_process_start:
@@ -44,12 +80,35 @@ ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list v
         if (cmdOptions.showDebugInfo)
             msg("[+] Starting the debugged process. Reseting all the engines.\n");
         triton_restart_engines();        
+        trace_scope.invalidate();
+        transition_sites.invalidate();
+        break;
+    }
+    case dbg_library_load:
+    case dbg_library_unload:
+    {
+        //The trace scope and the transition sites are given by module
+        trace_scope.invalidate();
+        transition_sites.invalidate();
         break;
     }
     case dbg_step_into:
     case dbg_step_over:
     {
+        //The step over of a WOW64 gate is not a user step, the tracing goes on
+        if (finish_transition_step())
+            break;
         ponce_runtime_status.tracing_start_time = 0;
+        annotation_queue.flush();
+        break;
+    }
+    case dbg_suspend_process:
+    {
+        //The user is going to look at the IDA view, it should show everything traced so far
+        annotation_queue.flush();
+        refresh_progress_panel(true);
+        //The checkpoints taken while tracing
+        refresh_snapshot_chooser();
         break;
     }
     case dbg_trace:
@@ -60,6 +119,8 @@ ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list v
         //If the trigger is disbaled then the user is manually stepping with the ponce tracing disabled
         if (!ponce_runtime_status.runtimeTrigger.getState())
             break;
+        //The user continued after the budget was reached
+        ponce_runtime_status.budget_exhausted = false;
 
         thid_t tid = va_arg(va, thid_t);
         ea_t pc = va_arg(va, ea_t);
@@ -71,65 +132,68 @@ ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list v
             return 0;
         }
 
+        //Library, system code... the user doesn't want to trace
+        if (!trace_scope.contains(pc) && skip_out_of_scope_code(pc))
+            return 0;
+
+        //Syscall stubs and vDSO code the user doesn't want to trace
+        if (skip_transition_site(pc))
+            return 0;
+
+        //The last instruction was a syscall we didn't give to Triton
+        if (ponce_runtime_status.syscall_skipped) {
+            ponce_runtime_status.syscall_skipped = false;
+            concretize_untraced_effects();
+        }
+
+        //IDA stepped over the last call because of the step trace options
+        if (returned_from_skipped_call(pc))
+            concretize_untraced_effects();
+
         //If the instruciton is not a blacklisted call we analyze the instruction
         //We don't want to reanalize instructions. p.e. if we put a bp we receive two events, the bp and this one
-        if (ponce_runtime_status.last_triton_instruction == NULL || (ponce_runtime_status.last_triton_instruction != NULL && ponce_runtime_status.last_triton_instruction->getAddress() != pc))
+        triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+        if (last_instruction == nullptr || last_instruction->getAddress() != pc) {
             tritonize(pc, tid);
+            last_instruction = last_triton_instructions.last();
+        }
+        annotation_queue.flush_if_due();
 
         ponce_runtime_status.current_trace_counter++;
         ponce_runtime_status.total_number_traced_ins++;
         //Every 1000 traced instructions we show with debug that info in the output
-        if (cmdOptions.showDebugInfo && ponce_runtime_status.total_number_traced_ins % 1000 == 0)
-            msg("Instructions traced: %d Symbolic instructions: %d Symbolic conditions: %d Time: %lld secs\n", ponce_runtime_status.total_number_traced_ins, ponce_runtime_status.total_number_symbolic_ins, ponce_runtime_status.total_number_symbolic_conditions, GetTimeMs64() - ponce_runtime_status.tracing_start_time);
+        if (cmdOptions.showDebugInfo && ponce_runtime_status.total_number_traced_ins % 1000 == 0) {
+            msg("Instructions traced: %d Symbolic instructions: %d Symbolic conditions: %d Fast-pathed: %d Time: %lld secs\n", ponce_runtime_status.total_number_traced_ins, ponce_runtime_status.total_number_symbolic_ins, ponce_runtime_status.total_number_symbolic_conditions, ponce_runtime_status.total_number_fast_path_ins, GetTimeMs64() - ponce_runtime_status.tracing_start_time);
+            memory_cache.print_statistics();
+        }
         //msg("[+] Instructions traced: %d\n", ponce_runtime_status.total_number_traced_ins);
 
-        //This is the wow64 switching, we need to skip it. https://forum.hex-rays.com/viewtopic.php?f=8&t=4070
-        if (ponce_runtime_status.last_triton_instruction->getDisassembly().find("call dword ptr fs:[0xc0]") != -1) {
-            if (cmdOptions.showExtraDebugInfo)
-                msg("[+] Wow64 switching! Requesting a step_over\n");
-            //And now we need to stop the tracing, do step over and reenable the tracing...
-            //disable_step_trace();
-            suspend_process();
-            //We don't want to do a real step over (it would reset the timer)
-            ponce_runtime_status.ignore_wow64_switching_step = true;
-            request_step_over();
-            request_continue_process();
-            run_requests();
+        //This is the wow64 switching, we need to skip it
+        if (last_instruction != nullptr && step_over_transition(pc))
+            break;
+
+        //Nothing but memory is tainted/symbolic, we can run natively until someone reads it
+        if (try_run_natively())
             break;
-        }
 
         //Check if the limit instructions limit was reached
         if (cmdOptions.limitInstructionsTracingMode && ponce_runtime_status.current_trace_counter >= cmdOptions.limitInstructionsTracingMode) {
-            int answer = ask_yn(1, "[?] %u instructions has been traced. Do you want to execute %u more?", ponce_runtime_status.total_number_traced_ins, (unsigned int)cmdOptions.limitInstructionsTracingMode);
-            if (answer == 0 || answer == -1)  { //No or Cancel
-                // stop the trace mode and suspend the process
-                disable_step_trace();
-                suspend_process();
-                msg("[!] Process suspended (Traced %d instructions)\n", ponce_runtime_status.total_number_traced_ins);
-            }
-            else {
-                ponce_runtime_status.current_trace_counter = 0;
-            }
+            pause_tracing_on_budget("Instruction budget reached");
+            break;
         }
 
-        //Check if the time limit for tracing was reached
-        if (cmdOptions.limitTime != 0) {
-            //This is the first time we start the tracer
-            if (ponce_runtime_status.tracing_start_time == 0) {
-                ponce_runtime_status.tracing_start_time = GetTimeMs64();
-            }
-            else if ((GetTimeMs64() - ponce_runtime_status.tracing_start_time) / 1000 >= cmdOptions.limitTime) {
-                int answer = ask_yn(1, "[?] the tracing was working for %u seconds(%u inst traced!). Do you want to execute it %u more?", (unsigned int)((GetTimeMs64() - ponce_runtime_status.tracing_start_time) / 1000), ponce_runtime_status.total_number_traced_ins, (unsigned int)cmdOptions.limitTime);
-                if (answer == 0 || answer == -1) { //No or Cancel
-                    // stop the trace mode and suspend the process
-                    disable_step_trace();
-                    suspend_process();
-                    msg("[!] Process suspended (Traced %d instructions)\n", ponce_runtime_status.total_number_traced_ins);
-                }
-                else {
-                    ponce_runtime_status.tracing_start_time = GetTimeMs64();
-                }
+        //This is the first time we start the tracer
+        if (ponce_runtime_status.tracing_start_time == 0) {
+            ponce_runtime_status.tracing_start_time = GetTimeMs64();
+        }
+        //Reading the clock for every instruction is noticeable, the time limit and the progress panel are checked every few instructions
+        else if (ponce_runtime_status.total_number_traced_ins % CLOCK_CHECK_PERIOD == 0) {
+            //Check if the time limit for tracing was reached
+            if (cmdOptions.limitTime != 0 && (GetTimeMs64() - ponce_runtime_status.tracing_start_time) / 1000 >= cmdOptions.limitTime) {
+                pause_tracing_on_budget("Time budget reached");
+                break;
             }
+            refresh_progress_panel(false);
         }
         break;
     }
@@ -138,7 +202,7 @@ ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list v
         //We only want to analyze the thread being analyzed
         if (ponce_runtime_status.analyzed_thread != get_current_thread())
             break;
-        msg("BP Instructions traced: %d Symbolic instructions: %d Symbolic conditions: %d Time: %lld secs\n", ponce_runtime_status.total_number_traced_ins, ponce_runtime_status.total_number_symbolic_ins, ponce_runtime_status.total_number_symbolic_conditions, GetTimeMs64() - ponce_runtime_status.tracing_start_time);
+        msg("BP Instructions traced: %d Symbolic instructions: %d Symbolic conditions: %d Fast-pathed: %d Time: %lld secs\n", ponce_runtime_status.total_number_traced_ins, ponce_runtime_status.total_number_symbolic_ins, ponce_runtime_status.total_number_symbolic_conditions, ponce_runtime_status.total_number_fast_path_ins, GetTimeMs64() - ponce_runtime_status.tracing_start_time);
 
         thid_t tid = va_arg(va, thid_t);
         ea_t pc = va_arg(va, ea_t);
@@ -148,6 +212,16 @@ ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list v
         //We look if there is a pending action for this breakpoint
         for (auto it = breakpoint_pending_actions.begin(); it != breakpoint_pending_actions.end(); ++it) {
             breakpoint_pending_action bpa = *it;
+            //Native code accessed tainted/symbolic memory, the callback enables the tracing again and removes every watchpoint
+            if (bpa.watchpoint && pc >= bpa.address && pc < bpa.address + bpa.size) {
+                user_bp = false;
+                bpa.callback(pc);
+                tritonize(current_instruction(), tid);
+                ponce_runtime_status.current_trace_counter++;
+                ponce_runtime_status.total_number_traced_ins++;
+                continue_process();
+                break;
+            }
             //If we find a pendign action we execute the callback
             if (pc == bpa.address) {
                 bpa.callback(pc);
@@ -156,19 +230,19 @@ ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list v
                 //The pending breakpoints are used for enable the tracing so we consider this instruction tracing too
                 ponce_runtime_status.current_trace_counter++;
                 ponce_runtime_status.total_number_traced_ins++;
+                //The action is done and the tracing goes on from here, also when the user had a breakpoint at the same address
+                breakpoint_pending_actions.erase(it);
+                enable_step_trace(true);
+                set_step_trace_options(trace_step_options());
                 //If there is a user-defined bp in the same address we should respect it and dont continue the exec
                 if (!bpa.ignore_breakpoint) {
                     //If it's a breakpoint the plugin set not a user-defined bp
                     user_bp = false;
                     //If not this is the bp we set to taint the arguments, we should rmeove it and continue the execution
                     del_bpt(pc);
-                    enable_step_trace(true);
-                    //We dont want to skip library funcions or debug segments
-                    set_step_trace_options(0);
                     continue_process();
                     //We delete the comment
                     ponce_set_cmt(pc, "", false);
-                    breakpoint_pending_actions.erase(it);
                 }
                 break;
             }
@@ -185,6 +259,7 @@ ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list v
             //if (ponce_runtime_status.runtimeTrigger.getState())
             //enable_step_trace(ponce_runtime_status.runtimeTrigger.getState());
         }
+        annotation_queue.flush();
         break;
     }
     case dbg_process_exit:
@@ -195,9 +270,14 @@ ssize_t idaapi tracer_callback(void* user_data, int notification_code, va_list v
         //unhook_from_notification_point(HT_DBG, tracer_callback, NULL);
         ponce_runtime_status.runtimeTrigger.disable();
         enable_step_trace(false);
-        //Removing snapshot if it exists
-        if (snapshot.exists())
-            snapshot.resetEngine();
+        disarm_watchpoints();
+        annotation_queue.flush();
+        refresh_progress_panel(true);
+        //Removing the snapshots if they exist
+        if (snapshot_manager.exists())
+            snapshot_manager.resetEngine();
+        forget_forks();
+        refresh_snapshot_chooser();
         break;
     }
     }
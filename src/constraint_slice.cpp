@@ -0,0 +1,157 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <algorithm>
+#include <set>
+#include <unordered_set>
+
+//Ponce
+#include "constraint_slice.hpp"
+#include "globals.hpp"
+
+//Variables of an AST, the node is kept so its address is not reused while it is in the map
+struct ast_variables {
+    triton::ast::SharedAbstractNode node;
+    std::vector<triton::usize> variables;
+};
+
+//Variables of the ASTs of the symbolic expressions and of the predicates, by node. The nodes are kept alive by the
+//cache, it is emptied when it gets too big
+#define MAX_CACHED_ASTS 1000000
+static std::unordered_map<const triton::ast::AbstractNode*, ast_variables> variables_cache;
+
+//An AST being visited: its own variables and the expressions it refers to
+struct variables_frame {
+    triton::ast::SharedAbstractNode node;
+    std::set<triton::usize> variables;
+    std::vector<triton::ast::SharedAbstractNode> references;
+    size_t next = 0;
+};
+
+/* Walks the nodes of an AST without going into the referenced expressions, they are visited as their own ASTs */
+static variables_frame scan_ast(const triton::ast::SharedAbstractNode& root)
+{
+    variables_frame frame;
+    frame.node = root;
+    std::unordered_set<const triton::ast::AbstractNode*> visited;
+    std::vector<triton::ast::AbstractNode*> pending = { root.get() };
+    while (!pending.empty()) {
+        triton::ast::AbstractNode* node = pending.back();
+        pending.pop_back();
+        if (!visited.insert(node).second)
+            continue;
+        switch (node->getType()) {
+        case triton::ast::VARIABLE_NODE:
+            frame.variables.insert(static_cast<triton::ast::VariableNode*>(node)->getSymbolicVariable()->getId());
+            break;
+        case triton::ast::REFERENCE_NODE:
+            frame.references.push_back(static_cast<triton::ast::ReferenceNode*>(node)->getSymbolicExpression()->getAst());
+            break;
+        default:
+            for (const auto& child : node->getChildren())
+                pending.push_back(child.get());
+        }
+    }
+    return frame;
+}
+
+/* The references can go very deep, the expressions are visited with a stack */
+const std::vector<triton::usize>& get_ast_variables(const triton::ast::SharedAbstractNode& node)
+{
+    auto cached = variables_cache.find(node.get());
+    if (cached != variables_cache.end())
+        return cached->second.variables;
+    if (variables_cache.size() > MAX_CACHED_ASTS)
+        variables_cache.clear();
+
+    std::vector<variables_frame> stack;
+    stack.push_back(scan_ast(node));
+    while (true) {
+        variables_frame& frame = stack.back();
+        if (frame.next < frame.references.size()) {
+            const triton::ast::SharedAbstractNode& reference = frame.references[frame.next++];
+            auto it = variables_cache.find(reference.get());
+            if (it != variables_cache.end())
+                frame.variables.insert(it->second.variables.begin(), it->second.variables.end());
+            else
+                stack.push_back(scan_ast(reference));
+            continue;
+        }
+
+        //All the referenced expressions are done
+        ast_variables entry;
+        entry.node = frame.node;
+        entry.variables.assign(frame.variables.begin(), frame.variables.end());
+        auto inserted = variables_cache.emplace(frame.node.get(), std::move(entry)).first;
+        stack.pop_back();
+        if (stack.empty())
+            return inserted->second.variables;
+        stack.back().variables.insert(inserted->second.variables.begin(), inserted->second.variables.end());
+    }
+}
+
+/* The variables used together in a predicate end up in the same set */
+static triton::usize find_root(std::unordered_map<triton::usize, triton::usize>& parents, triton::usize variable)
+{
+    auto it = parents.emplace(variable, variable).first;
+    triton::usize root = it->second;
+    while (parents[root] != root)
+        root = parents[root];
+    //Path compression
+    while (parents[variable] != root) {
+        triton::usize next = parents[variable];
+        parents[variable] = root;
+        variable = next;
+    }
+    return root;
+}
+
+std::vector<triton::ast::SharedAbstractNode> slice_path_predicates(size_t path_constraint_index, const std::vector<triton::ast::SharedAbstractNode>& seeds)
+{
+    const auto& path_constraints = tritonCtx.getPathConstraints();
+    std::vector<triton::ast::SharedAbstractNode> predicates;
+    for (size_t i = 0; i < path_constraint_index && i < path_constraints.size(); i++)
+        predicates.push_back(path_constraints[i].getTakenPredicate());
+
+    std::unordered_map<triton::usize, triton::usize> parents;
+    auto join = [&parents](const std::vector<triton::usize>& variables) {
+        if (variables.empty())
+            return;
+        triton::usize root = find_root(parents, variables[0]);
+        for (size_t i = 1; i < variables.size(); i++)
+            parents[find_root(parents, variables[i])] = root;
+    };
+    for (const auto& predicate : predicates)
+        join(get_ast_variables(predicate));
+    for (const auto& seed : seeds)
+        join(get_ast_variables(seed));
+
+    std::unordered_set<triton::usize> seed_roots;
+    for (const auto& seed : seeds) {
+        for (const auto& variable : get_ast_variables(seed))
+            seed_roots.insert(find_root(parents, variable));
+    }
+
+    std::vector<triton::ast::SharedAbstractNode> slice;
+    for (const auto& predicate : predicates) {
+        const auto& variables = get_ast_variables(predicate);
+        if (!variables.empty() && seed_roots.count(find_root(parents, variables[0])) != 0)
+            slice.push_back(predicate);
+    }
+
+    if (cmdOptions.showExtraDebugInfo)
+        msg("[+] Constraint slicing kept %u of %u predicates, %u dropped\n", (unsigned int)slice.size(), (unsigned int)predicates.size(), (unsigned int)(predicates.size() - slice.size()));
+    return slice;
+}
+
+void constraint_slice_reset(void)
+{
+    variables_cache.clear();
+}
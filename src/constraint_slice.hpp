@@ -0,0 +1,32 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+//Triton
+#include <triton/context.hpp>
+#include <triton/ast.hpp>
+
+/*Constraint independence: the taken predicates that don't share symbolic variables with the branch to solve, directly
+or through other predicates, don't change the answer. The current input already satisfies them and the model doesn't
+touch their variables, so they are left out of the query.*/
+
+//! Returns the taken predicates before path_constraint_index that depend on the variables of the seeds.
+std::vector<triton::ast::SharedAbstractNode> slice_path_predicates(size_t path_constraint_index, const std::vector<triton::ast::SharedAbstractNode>& seeds);
+
+//! Returns the symbolic variables an AST depends on, sorted. The variables of the symbolic expressions are remembered,
+//! the vector is valid until the next call.
+const std::vector<triton::usize>& get_ast_variables(const triton::ast::SharedAbstractNode& node);
+
+//! Forgets the variables of the expressions, they belong to the old context.
+void constraint_slice_reset(void);
@@ -10,6 +10,10 @@
 
 #include <cstring>
 #include <stdexcept>
+#include <unordered_map>
+#include <map>
+#include <string>
+#include <algorithm>
 
 //Triton
 #include <triton/cpuSize.hpp>
@@ -35,10 +39,7 @@ triton::uint512 IDA_getCurrentMemoryValue(ea_t addr, triton::uint32 size)
         return -1;
     }
     triton::uint8 buffer[64] = { 0 };
-    //This is the way to force IDA to read the value from the debugger
-    //More info here: https://www.hex-rays.com/products/ida/support/sdkdoc/dbg_8hpp.html#ac67a564945a2c1721691aa2f657a908c
-    invalidate_dbgmem_contents(addr, size);
-    get_bytes(&buffer, size, addr, GMB_READALL, NULL);
+    memory_cache.read(addr, buffer, size);
 
     triton::uint512 value = 0;
     switch (size) {
@@ -88,26 +89,177 @@ void needConcreteMemoryValue_cb(triton::Context& tritonCtx, const triton::arch::
     }
 }
 
+/* Registers read from IDA during the current debugger stop, indexed by the Triton register id*/
+static std::unordered_map<triton::arch::register_e, triton::uint512> register_cache;
+/* Set when the debugger stopped again and IDA's copy of the registers needs to be refreshed*/
+static bool register_cache_stale = true;
+
+/* Bit of every x86 flag inside its parent register, for the flags the debugger doesn't expose by name*/
+static const std::unordered_map<triton::arch::register_e, std::pair<triton::arch::register_e, triton::uint32>> x86_flag_bits = {
+    { triton::arch::ID_REG_X86_CF, { triton::arch::ID_REG_X86_EFLAGS, 0 } },
+    { triton::arch::ID_REG_X86_PF, { triton::arch::ID_REG_X86_EFLAGS, 2 } },
+    { triton::arch::ID_REG_X86_AF, { triton::arch::ID_REG_X86_EFLAGS, 4 } },
+    { triton::arch::ID_REG_X86_ZF, { triton::arch::ID_REG_X86_EFLAGS, 6 } },
+    { triton::arch::ID_REG_X86_SF, { triton::arch::ID_REG_X86_EFLAGS, 7 } },
+    { triton::arch::ID_REG_X86_TF, { triton::arch::ID_REG_X86_EFLAGS, 8 } },
+    { triton::arch::ID_REG_X86_IF, { triton::arch::ID_REG_X86_EFLAGS, 9 } },
+    { triton::arch::ID_REG_X86_DF, { triton::arch::ID_REG_X86_EFLAGS, 10 } },
+    { triton::arch::ID_REG_X86_OF, { triton::arch::ID_REG_X86_EFLAGS, 11 } },
+    { triton::arch::ID_REG_X86_NT, { triton::arch::ID_REG_X86_EFLAGS, 14 } },
+    { triton::arch::ID_REG_X86_RF, { triton::arch::ID_REG_X86_EFLAGS, 16 } },
+    { triton::arch::ID_REG_X86_VM, { triton::arch::ID_REG_X86_EFLAGS, 17 } },
+    { triton::arch::ID_REG_X86_AC, { triton::arch::ID_REG_X86_EFLAGS, 18 } },
+    { triton::arch::ID_REG_X86_VIF, { triton::arch::ID_REG_X86_EFLAGS, 19 } },
+    { triton::arch::ID_REG_X86_VIP, { triton::arch::ID_REG_X86_EFLAGS, 20 } },
+    { triton::arch::ID_REG_X86_ID, { triton::arch::ID_REG_X86_EFLAGS, 21 } },
+    { triton::arch::ID_REG_X86_SSE_IE, { triton::arch::ID_REG_X86_MXCSR, 0 } },
+    { triton::arch::ID_REG_X86_SSE_DE, { triton::arch::ID_REG_X86_MXCSR, 1 } },
+    { triton::arch::ID_REG_X86_SSE_ZE, { triton::arch::ID_REG_X86_MXCSR, 2 } },
+    { triton::arch::ID_REG_X86_SSE_OE, { triton::arch::ID_REG_X86_MXCSR, 3 } },
+    { triton::arch::ID_REG_X86_SSE_UE, { triton::arch::ID_REG_X86_MXCSR, 4 } },
+    { triton::arch::ID_REG_X86_SSE_PE, { triton::arch::ID_REG_X86_MXCSR, 5 } },
+    { triton::arch::ID_REG_X86_SSE_DAZ, { triton::arch::ID_REG_X86_MXCSR, 6 } },
+    { triton::arch::ID_REG_X86_SSE_IM, { triton::arch::ID_REG_X86_MXCSR, 7 } },
+    { triton::arch::ID_REG_X86_SSE_DM, { triton::arch::ID_REG_X86_MXCSR, 8 } },
+    { triton::arch::ID_REG_X86_SSE_ZM, { triton::arch::ID_REG_X86_MXCSR, 9 } },
+    { triton::arch::ID_REG_X86_SSE_OM, { triton::arch::ID_REG_X86_MXCSR, 10 } },
+    { triton::arch::ID_REG_X86_SSE_UM, { triton::arch::ID_REG_X86_MXCSR, 11 } },
+    { triton::arch::ID_REG_X86_SSE_PM, { triton::arch::ID_REG_X86_MXCSR, 12 } },
+    { triton::arch::ID_REG_X86_SSE_RL, { triton::arch::ID_REG_X86_MXCSR, 13 } },
+    { triton::arch::ID_REG_X86_SSE_RH, { triton::arch::ID_REG_X86_MXCSR, 14 } },
+    { triton::arch::ID_REG_X86_SSE_FZ, { triton::arch::ID_REG_X86_MXCSR, 15 } },
+};
+
+/* Names used by the IDA debuggers for the registers Triton calls differently*/
+static const std::unordered_map<triton::arch::register_e, const char*> ida_register_aliases = {
+    { triton::arch::ID_REG_X86_EFLAGS, "efl" },
+};
+
+/* Forgets the registers read so far, they need to be read again from the debugger*/
+void invalidate_register_cache(void)
+{
+    register_cache.clear();
+    register_cache_stale = true;
+}
+
+/* Reads a register by name from IDA. The wide registers (SIMD, FPU) don't fit in regval_t.ival so they are built from the raw bytes*/
+bool IDA_getRegisterValueByName(const char* name, triton::uint512& value)
+{
+    //We need to invalidate the registers once per stop. If not IDA uses the last value when program was stopped
+    //IDA reads the whole register class on the first access and serves the rest of the step from its own copy
+    if (register_cache_stale) {
+        invalidate_dbg_state(DBGINV_REGS);
+        register_cache_stale = false;
+    }
+
+    regval_t reg_value;
+    if (!get_reg_val(name, &reg_value))
+        return false;
+
+    if (reg_value.rvtype == RVT_INT) {
+        value = reg_value.ival;
+        return true;
+    }
+    if (reg_value.rvtype == RVT_UNAVAILABLE)
+        return false;
+
+    const triton::uint8* data = reinterpret_cast<const triton::uint8*>(reg_value.get_data());
+    size_t size = std::min<size_t>(reg_value.get_data_size(), triton::size::max_supported);
+    value = 0;
+    for (size_t i = size; i > 0; i--)
+        value = (value << 8) | data[i - 1];
+    return true;
+}
+
+/* Writes a register by name in IDA, the same way IDA_getRegisterValueByName reads it. Returns false if the debugger refuses it*/
+bool IDA_setRegisterValueByName(const char* name, const triton::uint512& value)
+{
+    regval_t reg_value;
+    if (!get_reg_val(name, &reg_value) || reg_value.rvtype == RVT_UNAVAILABLE)
+        return false;
+
+    if (reg_value.rvtype == RVT_INT) {
+        reg_value.ival = static_cast<uint64>(value);
+    }
+    else {
+        bytevec_t data;
+        triton::uint512 rest = value;
+        for (size_t i = 0; i < reg_value.get_data_size(); i++) {
+            data.push_back(static_cast<uchar>(rest & 0xFF));
+            rest >>= 8;
+        }
+        reg_value.set_bytes(data);
+    }
+    return set_reg_val(name, &reg_value);
+}
+
+/* Reads the registers of the debugger. They are the architectural registers, they don't overlap like the Triton
+sub-registers and flags do. IDA reads each register class from the debugger once and the rest come from its copy*/
+void IDA_readRegisterFile(std::map<std::string, triton::uint512>& registers)
+{
+    invalidate_register_cache();
+    for (int i = 0; i < dbg->nregs; i++) {
+        const register_info_t& info = dbg->regs(i);
+        if ((info.flags & (REGISTER_READONLY | REGISTER_NOVAL)) != 0)
+            continue;
+        triton::uint512 value;
+        if (IDA_getRegisterValueByName(info.name, value))
+            registers[info.name] = value;
+    }
+}
+
+/* Writes back a register file read by IDA_readRegisterFile, only the registers that changed. Returns how many were written*/
+unsigned int IDA_writeRegisterFile(const std::map<std::string, triton::uint512>& registers)
+{
+    std::map<std::string, triton::uint512> current_registers;
+    IDA_readRegisterFile(current_registers);
+    unsigned int written = 0;
+    for (const auto& [reg_name, value] : registers) {
+        auto current = current_registers.find(reg_name);
+        if (current != current_registers.end() && current->second == value)
+            continue;
+        if (!IDA_setRegisterValueByName(reg_name.c_str(), value))
+            msg("[!] ERROR restoring register %s\n", reg_name.c_str());
+        written++;
+    }
+    invalidate_register_cache();
+    return written;
+}
+
 /* Get a reg value from IDA debugger*/
 triton::uint512 IDA_getCurrentRegisterValue(const triton::arch::Register& reg)
 {
-    regval_t reg_value;
+    auto cached = register_cache.find(reg.getId());
+    if (cached != register_cache.end())
+        return cached->second;
+
     triton::uint512 value = 0;
     auto reg_name = reg.getName();
     assert(!reg_name.empty());
-    //We need to invalidate the registers. If not IDA uses the last value when program was stopped
-    invalidate_dbg_state(DBGINV_REGS);
-    get_reg_val(reg_name.c_str(), &reg_value);
-    value = reg_value.ival;
-    /* Sync with the libTriton */
-    triton::arch::Register syncReg;
-    if (reg.getId() >= tritonCtx.registers.x86_af.getId() && reg.getId() <= tritonCtx.registers.x86_zf.getId())
-        syncReg = tritonCtx.registers.x86_eflags;
-    else if (reg.getId() >= tritonCtx.registers.x86_sse_ie.getId() && reg.getId() <= tritonCtx.registers.x86_sse_fz.getId())
-        syncReg = tritonCtx.registers.x86_mxcsr;
-    else
-        syncReg = tritonCtx.getRegister(reg.getParent());
 
+    auto alias = ida_register_aliases.find(reg.getId());
+    bool found = IDA_getRegisterValueByName(reg_name.c_str(), value);
+    if (!found && alias != ida_register_aliases.end())
+        found = IDA_getRegisterValueByName(alias->second, value);
+
+    if (!found) {
+        /* The debugger doesn't know this register by name (flags, eax in a 64 bits process...).
+        We read the register that contains it and extract its bits*/
+        auto flag = x86_flag_bits.find(reg.getId());
+        if (flag != x86_flag_bits.end()) {
+            value = (IDA_getCurrentRegisterValue(tritonCtx.getRegister(flag->second.first)) >> flag->second.second) & 1;
+        }
+        else if (reg.getParent() != reg.getId()) {
+            const triton::arch::Register& parent = tritonCtx.getParentRegister(reg);
+            triton::uint512 mask = (triton::uint512(1) << reg.getBitSize()) - 1;
+            value = (IDA_getCurrentRegisterValue(parent) >> reg.getLow()) & mask;
+        }
+        else if (cmdOptions.showExtraDebugInfo) {
+            msg("[!] IDA doesn't provide the value of the register %s\n", reg_name.c_str());
+        }
+    }
+
+    register_cache[reg.getId()] = value;
     return value;
 }
 
@@ -9,6 +9,8 @@
 */
 
 #pragma once
+#include <map>
+#include <string>
 //Triton
 #include <triton/context.hpp>
 //IDA
@@ -17,4 +19,9 @@
 void needConcreteMemoryValue_cb(triton::Context& tritonCtx, const triton::arch::MemoryAccess& mem);
 void needConcreteRegisterValue_cb(triton::Context& tritonCtx, const triton::arch::Register& reg);
 triton::uint512 IDA_getCurrentMemoryValue(ea_t addr, triton::uint32 size);
-triton::uint512 IDA_getCurrentRegisterValue(const triton::arch::Register& reg);
\ No newline at end of file
+triton::uint512 IDA_getCurrentRegisterValue(const triton::arch::Register& reg);
+bool IDA_getRegisterValueByName(const char* name, triton::uint512& value);
+bool IDA_setRegisterValueByName(const char* name, const triton::uint512& value);
+void IDA_readRegisterFile(std::map<std::string, triton::uint512>& registers);
+unsigned int IDA_writeRegisterFile(const std::map<std::string, triton::uint512>& registers);
+void invalidate_register_cache(void);
\ No newline at end of file
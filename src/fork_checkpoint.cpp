@@ -0,0 +1,251 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+//IDA
+#include <ida.hpp>
+#include <dbg.hpp>
+
+//Ponce
+#include "fork_checkpoint.hpp"
+#include "globals.hpp"
+#include "context.hpp"
+#include "trace_scope.hpp"
+#include "transition_sites.hpp"
+
+/* The code is written at the instruction pointer and runs until its last byte, a nop. Then the bytes and the registers
+are put back. The child of the fork runs the loop after the jnz: it stops itself with SIGSTOP and does it again if it is
+continued, so it waits without using the CPU and it is not inside a syscall when the debugger attaches to it. */
+
+//mov eax, SYS_fork; syscall; test eax, eax; jnz parent; child: mov eax, SYS_getpid; syscall; mov edi, eax; mov esi, SIGSTOP;
+//mov eax, SYS_kill; syscall; jmp child; parent: nop
+static const std::uint8_t fork_x64[] = {
+    0xB8, 0x39, 0x00, 0x00, 0x00, 0x0F, 0x05, 0x85, 0xC0, 0x75, 0x17,
+    0xB8, 0x27, 0x00, 0x00, 0x00, 0x0F, 0x05, 0x89, 0xC7, 0xBE, 0x13, 0x00, 0x00, 0x00, 0xB8, 0x3E, 0x00, 0x00, 0x00, 0x0F, 0x05, 0xEB, 0xE9,
+    0x90 };
+
+//The same with int 0x80 and the arguments in ebx and ecx
+static const std::uint8_t fork_x86[] = {
+    0xB8, 0x02, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x85, 0xC0, 0x75, 0x17,
+    0xB8, 0x14, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x89, 0xC3, 0xB9, 0x13, 0x00, 0x00, 0x00, 0xB8, 0x25, 0x00, 0x00, 0x00, 0xCD, 0x80, 0xEB, 0xE9,
+    0x90 };
+
+//Code injected in a child, it has to be removed when the debugger switches to it
+struct injected_code {
+    ea_t address;
+    std::vector<std::uint8_t> original;
+};
+
+//Children forked and waiting, by pid
+static std::map<int, injected_code> forks;
+
+//Children that couldn't be killed, the user is told about them when the process exits
+static std::vector<int> leaked_forks;
+
+//Set while the debuggee runs the injected code or the debugger switches to a child
+static bool injecting = false;
+static bool switching = false;
+
+static bool is_x86_64(void)
+{
+    return tritonCtx.getArchitecture() == triton::arch::ARCH_X86_64;
+}
+
+/* Code can be injected in the Linux debugger, on x86 and x86_64, while the process is suspended.
+It can't be done in the debugger events, run_to needs the UI thread */
+static bool can_inject(void)
+{
+    if (dbg == nullptr || strcmp(dbg->name, "linux") != 0)
+        return false;
+    if (tritonCtx.getArchitecture() != triton::arch::ARCH_X86 && tritonCtx.getArchitecture() != triton::arch::ARCH_X86_64)
+        return false;
+    return !injecting && !switching && get_process_state() == DSTATE_SUSP;
+}
+
+/* Runs the code at the instruction pointer until its last byte. eax/rax is returned in result. The bytes and the registers
+are restored before returning. The original bytes are returned too, a forked child still has the code */
+static bool run_injected(const std::vector<std::uint8_t>& code, triton::uint512& result, injected_code& injected)
+{
+    ea_t ip;
+    if (!get_ip_val(&ip))
+        return false;
+    injected.address = ip;
+    injected.original.resize(code.size());
+    if (read_dbg_memory(ip, injected.original.data(), code.size()) != (ssize_t)code.size()) {
+        msg("[!] Couldn't read the code at " MEM_FORMAT "\n", ip);
+        return false;
+    }
+    std::map<std::string, triton::uint512> registers;
+    IDA_readRegisterFile(registers);
+
+    //Ponce doesn't trace the injected code
+    injecting = true;
+    bool step_trace = is_step_trace_enabled();
+    if (step_trace)
+        enable_step_trace(false);
+
+    bool ok = false;
+    ea_t stop = ip + code.size() - 1;
+    if (write_dbg_memory(ip, code.data(), code.size()) == (ssize_t)code.size()) {
+        if (run_to(stop))
+            wait_for_next_event(WFNE_SUSP, -1);
+        ea_t current_ip;
+        ok = get_process_state() == DSTATE_SUSP && get_ip_val(&current_ip) && current_ip == stop;
+        if (ok)
+            ok = IDA_getRegisterValueByName(is_x86_64() ? "RAX" : "EAX", result);
+        else
+            msg("[!] The code injected at " MEM_FORMAT " didn't stop where expected\n", ip);
+    }
+
+    if (get_process_state() == DSTATE_SUSP) {
+        write_dbg_memory(ip, injected.original.data(), code.size());
+        IDA_writeRegisterFile(registers);
+    }
+    instruction_cache.invalidate(ip, code.size());
+    memory_cache.clear();
+
+    if (step_trace)
+        enable_step_trace(true);
+    injecting = false;
+    return ok;
+}
+
+bool fork_checkpoints_available(void)
+{
+    return cmdOptions.fork_checkpoints && can_inject();
+}
+
+int fork_checkpoint(void)
+{
+    if (!can_inject())
+        return 0;
+    std::vector<std::uint8_t> code;
+    if (is_x86_64())
+        code.assign(fork_x64, fork_x64 + sizeof(fork_x64));
+    else
+        code.assign(fork_x86, fork_x86 + sizeof(fork_x86));
+
+    /*The child would inherit the int3 of the software breakpoints, and the debugger would take them for the original bytes
+    when it attaches to it. IDA removes them from the memory when the debuggee runs the injected code. The temporary one
+    of run_to is on the last byte of the injected code, it is overwritten when we switch to the child*/
+    std::vector<ea_t> disabled_breakpoints;
+    for (int i = 0; i < get_bpt_qty(); i++) {
+        bpt_t bpt;
+        if (getn_bpt(i, &bpt) && bpt.enabled() && (bpt.type & BPT_SOFT) != 0)
+            disabled_breakpoints.push_back(bpt.ea);
+    }
+    for (const auto& ea : disabled_breakpoints)
+        disable_bpt(ea);
+
+    triton::uint512 result;
+    injected_code injected;
+    bool forked = run_injected(code, result, injected);
+    for (const auto& ea : disabled_breakpoints)
+        enable_bpt(ea);
+    if (!forked)
+        return 0;
+    int pid = (int)(std::uint32_t)(result & 0xFFFFFFFF);
+    if (pid <= 0) {
+        msg("[!] fork() failed in the debuggee: %d\n", pid);
+        return 0;
+    }
+    forks[pid] = std::move(injected);
+    if (cmdOptions.showDebugInfo)
+        msg("[+] Debuggee forked, the checkpoint is process %d\n", pid);
+    return pid;
+}
+
+bool switch_to_fork(int pid)
+{
+    auto it = forks.find(pid);
+    if (it == forks.end() || !can_inject())
+        return false;
+    injected_code injected = std::move(it->second);
+    forks.erase(it);
+
+    switching = true;
+    exit_process();
+    for (int i = 0; i < 100 && get_process_state() != DSTATE_NOTASK; i++)
+        wait_for_next_event(WFNE_ANY, 1);
+
+    if (attach_process(pid, -1) != 1) {
+        switching = false;
+        msg("[!] Couldn't attach to the checkpoint process %d. If kernel.yama.ptrace_scope is 1 only the children of the debugger can be attached\n", pid);
+        ponce_runtime_status.runtimeTrigger.disable();
+        return false;
+    }
+    if (get_process_state() != DSTATE_SUSP) {
+        suspend_process();
+        wait_for_next_event(WFNE_SUSP, -1);
+    }
+
+    //The child is still running the code injected to fork it
+    if (write_dbg_memory(injected.address, injected.original.data(), injected.original.size()) != (ssize_t)injected.original.size())
+        msg("[!] Couldn't remove the code injected at " MEM_FORMAT " in process %d\n", injected.address, pid);
+
+    //Another process, nothing cached is valid. Unlike a new process the engines are kept
+    invalidate_register_cache();
+    instruction_cache.clear();
+    memory_cache.clear();
+    trace_scope.invalidate();
+    transition_sites.invalidate();
+    enable_step_trace(ponce_runtime_status.runtimeTrigger.getState());
+    switching = false;
+    return true;
+}
+
+void release_fork(int pid)
+{
+    auto it = forks.find(pid);
+    if (it == forks.end())
+        return;
+    forks.erase(it);
+
+    if (can_inject()) {
+        //mov eax, SYS_kill; mov edi/ebx, pid; mov esi/ecx, SIGKILL; syscall/int 0x80; nop
+        std::vector<std::uint8_t> code = { 0xB8, (std::uint8_t)(is_x86_64() ? 0x3E : 0x25), 0x00, 0x00, 0x00, (std::uint8_t)(is_x86_64() ? 0xBF : 0xBB) };
+        for (int i = 0; i < 4; i++)
+            code.push_back((std::uint8_t)((std::uint32_t)pid >> (8 * i)));
+        const std::uint8_t tail_x64[] = { 0xBE, 0x09, 0x00, 0x00, 0x00, 0x0F, 0x05, 0x90 };
+        const std::uint8_t tail_x86[] = { 0xB9, 0x09, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x90 };
+        const std::uint8_t* tail = is_x86_64() ? tail_x64 : tail_x86;
+        code.insert(code.end(), tail, tail + sizeof(tail_x64));
+
+        triton::uint512 result;
+        injected_code injected;
+        if (run_injected(code, result, injected) && (result & 0xFFFFFFFF) == 0)
+            return;
+    }
+    leaked_forks.push_back(pid);
+}
+
+void forget_forks(void)
+{
+    for (const auto& [pid, injected] : forks)
+        leaked_forks.push_back(pid);
+    forks.clear();
+    if (leaked_forks.empty())
+        return;
+
+    qstring pids;
+    for (const auto& pid : leaked_forks)
+        pids.cat_sprnt("%s%d", pids.empty() ? "" : " ", pid);
+    msg("[!] The processes forked for the snapshots are still waiting, kill them if they are not needed: kill -9 %s\n", pids.c_str());
+    leaked_forks.clear();
+}
+
+bool fork_switch_in_progress(void)
+{
+    return injecting || switching;
+}
@@ -0,0 +1,37 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+//IDA
+#include <ida.hpp>
+
+/*Fork checkpoints: on Linux x86/x86_64 a fork() is injected in the suspended debuggee. The child waits in pause() with
+the whole process state of the snapshot: memory, mappings, file offsets... Restoring the snapshot kills the debuggee and
+attaches to the child, nothing is written back. Only the processes can be forked, the engines are restored as usual.*/
+
+//! Tells if the debuggee can be forked now: the option is enabled, it is Linux x86/x86_64 and the process is suspended.
+bool fork_checkpoints_available(void);
+
+//! Forks the debuggee, the child is left waiting. Returns its pid, 0 if it couldn't be forked.
+int fork_checkpoint(void);
+
+//! Kills the debuggee and attaches to a forked child, the code injected in it is removed. Ponce keeps its state.
+//! Returns false if the child couldn't be attached, the debugging session is over then.
+bool switch_to_fork(int pid);
+
+//! Kills a forked child that is not needed anymore. If the debuggee can't run the kill it is reported when the process exits.
+void release_fork(int pid);
+
+//! Called when the process exits, tells the user about the forked children that are still waiting.
+void forget_forks(void);
+
+//! True while the debugger switches to a forked child, the debugger events don't reset Ponce.
+bool fork_switch_in_progress(void);
@@ -18,6 +18,7 @@
 #include "formConfiguration.hpp"
 #include "globals.hpp"
 #include "utils.hpp"
+#include "trace_scope.hpp"
 
 //--------------------------------------------------------------------------
 //This function is used to activate or deactivate other items in the form while using it
@@ -72,7 +73,7 @@ If you want to create a new checkbox you should:
 - add it to the msg at the end of the function for debug purposes*/
 void prompt_conf_window(void) {
     /*We should create as many ushort variables as groups of checkboxes we have in the form window*/
-    ushort chkgroup1, chkgroup2, chkgroup3;
+    ushort chkgroup1, chkgroup2, chkgroup3, chkgroup4, chkgroup5, chkgroup6, chkgroup7;
     ushort symbolic_or_taint_engine = 0;
 
     if (!cmdOptions.already_configured) {
@@ -82,6 +83,8 @@ void prompt_conf_window(void) {
         chkgroup3 = 1 | 2;
 
         cmdOptions.blacklist_path[0] = '\0'; // Will use this to check if the user set some path for the blacklist
+        cmdOptions.trace_include[0] = '\0';
+        cmdOptions.trace_exclude[0] = '\0';
     }
     else {
         /*By default all the variables are set to false. If the user wants to change the configuration
@@ -89,20 +92,35 @@ void prompt_conf_window(void) {
         don't do this the variables will be always initialized to  the previous lines
         NOTE: Parenthesis are mandatory or it won't work!*/
         chkgroup1 = (cmdOptions.showDebugInfo ? 1 : 0) | (cmdOptions.showExtraDebugInfo ? 2 : 0);
-        chkgroup2 = (cmdOptions.CONCRETIZE_UNDEFINED_REGISTERS ? 1 : 0) | (cmdOptions.CONSTANT_FOLDING ? 2 : 0) | (cmdOptions.SYMBOLIZE_INDEX_ROTATION ? 4 : 0) | (cmdOptions.AST_OPTIMIZATIONS ? 8 : 0) | (cmdOptions.TAINT_THROUGH_POINTERS ? 16 : 0);
+        chkgroup2 = (cmdOptions.CONCRETIZE_UNDEFINED_REGISTERS ? 1 : 0) | (cmdOptions.CONSTANT_FOLDING ? 2 : 0) | (cmdOptions.SYMBOLIZE_INDEX_ROTATION ? 4 : 0) | (cmdOptions.AST_OPTIMIZATIONS ? 8 : 0) | (cmdOptions.TAINT_THROUGH_POINTERS ? 16 : 0) | (cmdOptions.hybrid_execution ? 32 : 0);
         chkgroup3 = (cmdOptions.addCommentsControlledOperands ? 1 : 0) | (cmdOptions.RenameTaintedFunctionNames ? 2 : 0) | (cmdOptions.addCommentsSymbolicExpresions ? 4 : 0);
 
         symbolic_or_taint_engine = cmdOptions.use_symbolic_engine ? 0 : 1;
     }
+    //The first time these show the defaults of cmdOptions
+    chkgroup4 = (cmdOptions.trace_over_library_functions ? 1 : 0) | (cmdOptions.trace_over_debug_segments ? 2 : 0);
+    chkgroup5 = (cmdOptions.skip_wow64_gates ? 1 : 0) | (cmdOptions.skip_syscalls ? 2 : 0) | (cmdOptions.skip_vdso ? 4 : 0);
+    chkgroup6 = (cmdOptions.auto_checkpoints ? 1 : 0) | (cmdOptions.fork_checkpoints ? 2 : 0);
+    chkgroup7 = (cmdOptions.persist_solver_cache ? 1 : 0) | (cmdOptions.solver_portfolio ? 2 : 0);
     if (ask_form(form,
         modcb,
         &symbolic_or_taint_engine,
         &chkgroup1,
         &chkgroup2,
         &chkgroup3,
+        &chkgroup4,
+        cmdOptions.trace_include,
+        cmdOptions.trace_exclude,
+        &chkgroup5,
+        &chkgroup6,
+        &cmdOptions.checkpoint_interval,
+        &cmdOptions.checkpoint_count,
+        &cmdOptions.checkpoint_memory,
         &cmdOptions.limitTime,
         &cmdOptions.limitInstructionsTracingMode,
         &cmdOptions.solver_timeout,
+        &chkgroup7,
+        &cmdOptions.annotations_refresh_interval,
         &cmdOptions.color_tainted,
         &cmdOptions.color_executed_instruction,
         &cmdOptions.color_tainted_condition,
@@ -134,6 +152,7 @@ void prompt_conf_window(void) {
         cmdOptions.SYMBOLIZE_INDEX_ROTATION = chkgroup2 & 4 ? 1 : 0;
         cmdOptions.AST_OPTIMIZATIONS = chkgroup2 & 8 ? 1 : 0;
         cmdOptions.TAINT_THROUGH_POINTERS = chkgroup2 & 16 ? 1 : 0;
+        cmdOptions.hybrid_execution = chkgroup2 & 32 ? 1 : 0;
         
         // Make sure that modes are correctly set since some engines
         // can't have some modes activated
@@ -151,6 +170,20 @@ void prompt_conf_window(void) {
         cmdOptions.RenameTaintedFunctionNames = chkgroup3 & 2 ? 1 : 0;
         cmdOptions.addCommentsSymbolicExpresions = chkgroup3 & 4 ? 1 : 0;
 
+        cmdOptions.trace_over_library_functions = chkgroup4 & 1 ? 1 : 0;
+        cmdOptions.trace_over_debug_segments = chkgroup4 & 2 ? 1 : 0;
+        trace_scope.invalidate();
+
+        cmdOptions.skip_wow64_gates = chkgroup5 & 1 ? 1 : 0;
+        cmdOptions.skip_syscalls = chkgroup5 & 2 ? 1 : 0;
+        cmdOptions.skip_vdso = chkgroup5 & 4 ? 1 : 0;
+
+        cmdOptions.auto_checkpoints = chkgroup6 & 1 ? 1 : 0;
+        cmdOptions.fork_checkpoints = chkgroup6 & 2 ? 1 : 0;
+
+        cmdOptions.persist_solver_cache = chkgroup7 & 1 ? 1 : 0;
+        cmdOptions.solver_portfolio = chkgroup7 & 2 ? 1 : 0;
+
         if (cmdOptions.blacklist_path[0] != '\0') {
             //Means that the user set a path for custom blacklisted functions
             if (blacklkistedUserFunctions != NULL) {
@@ -168,6 +201,7 @@ void prompt_conf_window(void) {
                 "limitTime: %lld\n"
                 "limitInstructionsTracingMode: %lld\n"
                 "solver_timeout: %lld\n"
+                "annotations_refresh_interval: %lld\n"
                 "use_symbolic_engine: %s\n"
                 "showDebugInfo: %s\n"
                 "showExtraDebugInfo: %s\n"
@@ -176,15 +210,31 @@ void prompt_conf_window(void) {
                 "SYMBOLIZE_INDEX_ROTATION: %s\n"
                 "AST_OPTIMIZATIONS: %s\n"
                 "TAINT_THROUGH_POINTERS: %s\n"
+                "hybrid_execution: %s\n"
                 "addCommentsControlledOperands: %s\n"
                 "RenameTaintedFunctionNames: %s\n"
                 "addCommentssymbolizexpresions: %s\n"
+                "trace_over_library_functions: %s\n"
+                "trace_over_debug_segments: %s\n"
+                "trace_include: %s\n"
+                "trace_exclude: %s\n"
+                "skip_wow64_gates: %s\n"
+                "skip_syscalls: %s\n"
+                "skip_vdso: %s\n"
+                "auto_checkpoints: %s\n"
+                "checkpoint_interval: %lld\n"
+                "checkpoint_count: %lld\n"
+                "checkpoint_memory: %lld\n"
+                "fork_checkpoints: %s\n"
+                "persist_solver_cache: %s\n"
+                "solver_portfolio: %s\n"
                 "color_tainted: %x\n"
                 "color_executed_instruction: %x\n"
                 "color_tainted_condition: %x\n",
                 cmdOptions.limitTime,
                 cmdOptions.limitInstructionsTracingMode,
                 cmdOptions.solver_timeout,
+                cmdOptions.annotations_refresh_interval,
                 cmdOptions.use_symbolic_engine ? "symbolic engine enabled" : "tainting engine enabled",
                 cmdOptions.showDebugInfo ? "true" : "false",
                 cmdOptions.showExtraDebugInfo ? "true" : "false",
@@ -193,9 +243,24 @@ void prompt_conf_window(void) {
                 cmdOptions.SYMBOLIZE_INDEX_ROTATION ? "true" : "false",
                 cmdOptions.AST_OPTIMIZATIONS ? "true" : "false",
                 cmdOptions.TAINT_THROUGH_POINTERS ? "true" : "false",
+                cmdOptions.hybrid_execution ? "true" : "false",
                 cmdOptions.addCommentsControlledOperands ? "true" : "false",
                 cmdOptions.RenameTaintedFunctionNames ? "true" : "false",
                 cmdOptions.addCommentsSymbolicExpresions ? "true" : "false",
+                cmdOptions.trace_over_library_functions ? "true" : "false",
+                cmdOptions.trace_over_debug_segments ? "true" : "false",
+                cmdOptions.trace_include,
+                cmdOptions.trace_exclude,
+                cmdOptions.skip_wow64_gates ? "true" : "false",
+                cmdOptions.skip_syscalls ? "true" : "false",
+                cmdOptions.skip_vdso ? "true" : "false",
+                cmdOptions.auto_checkpoints ? "true" : "false",
+                cmdOptions.checkpoint_interval,
+                cmdOptions.checkpoint_count,
+                cmdOptions.checkpoint_memory,
+                cmdOptions.fork_checkpoints ? "true" : "false",
+                cmdOptions.persist_solver_cache ? "true" : "false",
+                cmdOptions.solver_portfolio ? "true" : "false",
                 cmdOptions.color_tainted,
                 cmdOptions.color_executed_instruction,
                 cmdOptions.color_tainted_condition
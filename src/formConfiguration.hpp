@@ -33,17 +33,36 @@ static const char form[] =
 "<#Perform a constant folding optimization of sub ASTs which do not contain symbolic variables#CONSTANT_FOLDING:C9>\n"
 "<#Symbolize index rotation for bvrol and bvror. This mode increases the complexity of solving#SYMBOLIZE_INDEX_ROTATION:C12>\n"
 "<#Classical arithmetic optimisations to reduce the depth of the trees#AST_OPTIMIZATIONS:C13>\n"
-"<#Spread the taint if an index pointer is already tainted#TAINT_THROUGH_POINTERS:C14>>\n"
+"<#Spread the taint if an index pointer is already tainted#TAINT_THROUGH_POINTERS:C14>\n"
+"<#Run natively while no register is tainted/symbolic. The pages with tainted/symbolic memory are watched with page breakpoints to go back to tracing#HYBRID_EXECUTION:C25>>\n"
 //
 "<#Add comments to controlled operands#IDA View expand info#Add comments with controlled operands:C15>\n"
 "<#This helps to track the tainted functions in large programms#Add prefix to tainted function names:C16>\n"
 "<#Will add a comment for every instruction with his symbolic expression. Will pollute the IDA view.#Add comments with symbolic expresions:C17>>\n"
+//
+"<#IDA steps over the library functions, what they did is concretized when they return#Trace scope#Step over library functions:C27>\n"
+"<#IDA steps over the debug segments#Step over debug segments:C28>>\n"
+"<#Modules or segments to trace separated by commas, the rest runs natively. Empty traces everything#Trace only                    :A29:1023:40::>\n"
+"<#Modules or segments that run natively separated by commas, p.e. kernel32.dll,ntdll.dll#Don't trace                   :A30:1023:40::>\n"
+//
+"<#Step over the call dword ptr fs:[0xC0] and run Wow64SystemServiceCall natively, what they change is concretized#Transitions to the kernel#Skip WOW64 gates:C31>\n"
+"<#Don't give the syscalls to Triton and run the syscall stubs natively, what the kernel changes is concretized#Skip syscalls:C32>\n"
+"<#Run the vDSO natively, what it changes is concretized#Skip vDSO code:C33>>\n"
+//
+"<#Take a snapshot automatically at the symbolic branches, restore it from the snapshots window to flip the branch#Checkpoints#Take checkpoints at symbolic branches:C34>\n"
+"<#Linux x86/x86_64 only. The snapshots taken by hand fork the process, restoring them switches the debugger to the fork#Fork the process for the snapshots:C38>>\n"
+"<#A checkpoint is taken every this many symbolic branches#Symbolic branches per checkpoint:D35:12:12>\n"
+"<#The oldest checkpoint is deleted when there are more than this#Checkpoints kept              :D36:12:12>\n"
+"<#The oldest checkpoints are deleted when they use more memory than this#Checkpoints memory (MB)       :D37:12:12>\n"
 "\n"
 "Ponce will heads up you after:\n"
 "<#Time in seconds#Seconds running               :D1:12:12>\n"
 "<#Number of the instructions executed during tracing before ask to the user#Instructions executed         :D2:12:12>\n"
 "\n"
 "<#Time in seconds#Solver timeout               :D23:12:12>\n"
+"<#The queries already solved are not solved again. Keep them in a file next to the IDB for the next sessions#Solver#Save the solved queries next to the IDB:C39>\n"
+"<#Solve every query with several Z3 configurations in parallel, the first answer wins.#Race solver configurations:C40>>\n"
+"<#While tracing comments and colors are written every this many ms. 0 writes them only when the process is suspended#IDA view refresh (ms)         :D24:12:12>\n"
 "\n"
 "<#-1 is default colour#Color Tainted Instruction     :K19:::>\n"
 "<#-1 is default colour#Color Executed Instruction    :K20:::>\n"
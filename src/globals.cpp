@@ -27,11 +27,17 @@ runtime_status_t ponce_runtime_status;
 //Options
 struct cmdOptionStruct cmdOptions;
 
-//Snapshot object, defined in the snapshot.cpp
-Snapshot snapshot = Snapshot();
+//Instruction cache, defined in the instruction_cache.cpp
+InstructionCache instruction_cache;
+
+//Memory cache, defined in the memory_cache.cpp
+MemoryCache memory_cache;
+
+//Instruction ring, defined in the instruction_ring.cpp
+InstructionRing last_triton_instructions;
 
 //Used to point to the vector of blacklisted user functions
-std::vector<std::string>* blacklkistedUserFunctions = nullptr;
+std::unordered_set<std::string>* blacklkistedUserFunctions = nullptr;
 
 triton::Context tritonCtx;
 
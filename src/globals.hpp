@@ -11,9 +11,12 @@
 #pragma once
 //Ponce
 #include "trigger.hpp"
-#include "snapshot.hpp"
+#include "snapshot_manager.hpp"
 #include "runtime_status.hpp"
 #include "symVarTable.hpp"
+#include "instruction_cache.hpp"
+#include "memory_cache.hpp"
+#include "instruction_ring.hpp"
 
 //IDA
 #include <kernwin.hpp>
@@ -24,6 +27,7 @@
 #define strtol_m strtoll
 
 #include <inttypes.h>
+#include <unordered_set>
 
 //stdcall does not exist in Linux so lets define it to nothing
 #if defined(__LINUX__) || defined(__MAC__)
@@ -41,7 +45,18 @@
 #define RENAME_TAINTED_FUNCTIONS_PATTERN RENAME_TAINTED_FUNCTIONS_PREFIX"%03d_"
 #define RENAME_TAINTED_FUNCTIONS_PATTERN_LEN 6 
 
-extern Snapshot snapshot;
+//Granularity used by the caches that track the debuggee memory
+#define PONCE_PAGE_SIZE 0x1000
+
+//Decoded instructions seen while tracing
+extern InstructionCache instruction_cache;
+
+//Debuggee memory read by Triton
+extern MemoryCache memory_cache;
+
+//These are the last instructions executed by triton, we need to reference them to reanalize if the user taint a register.
+//They are not part of ponce_runtime_status so the snapshots don't copy them
+extern InstructionRing last_triton_instructions;
 
 //All the global variables:
 extern bool hooked;
@@ -72,16 +87,45 @@ struct cmdOptionStruct {
     bool CONSTANT_FOLDING = false;
     bool SYMBOLIZE_INDEX_ROTATION = false;
     bool TAINT_THROUGH_POINTERS = false;
+    //Run natively while only memory is tainted/symbolic, using page breakpoints to go back to tracing
+    bool hybrid_execution = false;
 
     bool addCommentsControlledOperands = false;
     bool RenameTaintedFunctionNames = false;
     bool addCommentsSymbolicExpresions = false;
 
+    //While tracing the comments and colors are written to the IDB every this many ms, 0 means only when the process is suspended
+    uint64 annotations_refresh_interval = 500;
+
     char blacklist_path[QMAXPATH];
+
+    //Let IDA step over library functions and debug segments while tracing
+    bool trace_over_library_functions = false;
+    bool trace_over_debug_segments = false;
+    //Modules/segments to trace or not, separated by commas. The code out of the scope runs natively
+    char trace_include[MAXSTR];
+    char trace_exclude[MAXSTR];
+
+    //Transitions to the kernel that run natively, the registers and memory they change are concretized
+    bool skip_wow64_gates = true;
+    bool skip_syscalls = false;
+    bool skip_vdso = true;
+
+    //Take a snapshot every checkpoint_interval symbolic branches, the oldest ones are deleted over checkpoint_count or checkpoint_memory MB
+    bool auto_checkpoints = false;
+    uint64 checkpoint_interval = 1;
+    uint64 checkpoint_count = 32;
+    uint64 checkpoint_memory = 256;
+    //On Linux x86/x86_64 fork the debuggee for the snapshots taken by hand, restoring them switches to the child
+    bool fork_checkpoints = false;
+    //Write the verdicts and models of the queries solved next to the IDB and read them in the next session
+    bool persist_solver_cache = false;
+    //Solve every query with several solver configurations at the same time, the first definitive answer is used
+    bool solver_portfolio = false;
 };
 extern struct cmdOptionStruct cmdOptions;
 
-extern std::vector<std::string>* blacklkistedUserFunctions;
+extern std::unordered_set<std::string>* blacklkistedUserFunctions;
 
 extern void idaapi term(void);
 
@@ -91,7 +135,8 @@ struct instruction_info {
     std::string comment;
     std::string snapshot_comment;
     bgcolor_t color = DEFCOLOR;
-
+    //Number of times the comment was written while tracing, shown as "N hits."
+    unsigned int hits = 0;
 };
 extern std::map<ea_t, struct instruction_info> ponce_comments;
 /* For backwards compatibility with IDA SDKs < 7.3 */
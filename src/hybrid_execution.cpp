@@ -0,0 +1,173 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <vector>
+#include <utility>
+
+//Ponce
+#include "hybrid_execution.hpp"
+#include "globals.hpp"
+#include "blacklist.hpp"
+#include "shadow_state.hpp"
+#include "context.hpp"
+#include "annotation_queue.hpp"
+#include "utils.hpp"
+#include "trace_scope.hpp"
+
+//IDA
+#include <dbg.hpp>
+
+//Triton
+#include <triton/context.hpp>
+
+// Ranges of pages watched at most, every access to a clean byte in them costs a trip back to tracing
+#define WATCHED_RANGES_LIMIT 16
+// Traced instructions to wait before trying again when the tainted memory couldn't be watched
+#define UNAVAILABLE_RETRY_PERIOD 4096
+// Traced instructions to wait after a watchpoint hit, the code touching the input usually keeps doing it for a while
+#define WATCHPOINT_HIT_COOLDOWN 64
+
+#define PAGE_BASE(address) ((address) & ~(ea_t)(PONCE_PAGE_SIZE - 1))
+
+static unsigned int instructions_until_retry = 0;
+//Set once we told the user the memory can't be watched, until it can again
+static bool unavailable_reported = false;
+
+static void watchpoint_hit(ea_t address);
+
+/*The page breakpoints fault before the access, the instruction touching the memory is still to be traced. The tainted or
+symbolic ranges are grown to whole pages and the ranges sharing a page merged. Returns false if there are too many ranges*/
+static bool watchable_pages(std::vector<std::pair<ea_t, size_t>>& watched)
+{
+    std::vector<std::pair<ea_t, size_t>> ranges;
+    if (!shadow_state.dirty_ranges(ranges, PONCE_PAGE_SIZE, WATCHED_RANGES_LIMIT))
+        return false;
+    for (const auto& [address, size] : ranges) {
+        ea_t first = PAGE_BASE(address);
+        ea_t end = PAGE_BASE(address + size - 1) + PONCE_PAGE_SIZE;
+        if (!watched.empty() && first <= watched.back().first + watched.back().second)
+            watched.back().second = end - watched.back().first;
+        else
+            watched.emplace_back(first, end - first);
+    }
+    return true;
+}
+
+static void report_unavailable(const char* reason)
+{
+    if (!unavailable_reported)
+        msg("[!] Hybrid execution not available, %s. We keep tracing\n", reason);
+    unavailable_reported = true;
+    instructions_until_retry = UNAVAILABLE_RETRY_PERIOD;
+}
+
+void disarm_watchpoints(void)
+{
+    for (auto it = breakpoint_pending_actions.begin(); it != breakpoint_pending_actions.end();) {
+        if (it->watchpoint) {
+            del_bpt(it->address);
+            it = breakpoint_pending_actions.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    ponce_runtime_status.running_natively = false;
+}
+
+void resume_tracing(void)
+{
+    if (!ponce_runtime_status.running_natively)
+        return;
+    disarm_watchpoints();
+    enable_step_trace(true);
+    set_step_trace_options(trace_step_options());
+    if (cmdOptions.showDebugInfo)
+        msg("[+] Back to step tracing\n");
+}
+
+bool try_run_natively(void)
+{
+    if (!cmdOptions.hybrid_execution || ponce_runtime_status.running_natively)
+        return false;
+    if (instructions_until_retry > 0) {
+        instructions_until_retry--;
+        return false;
+    }
+    //The snapshot needs to see every write, and a pending blacklist breakpoint expects the tracing to be there
+    if (snapshot_manager.exists() || !breakpoint_pending_actions.empty())
+        return false;
+    //A tainted/symbolic register can spread to anything without touching the watched memory
+    if (!shadow_state.registers_clean())
+        return false;
+
+    std::vector<std::pair<ea_t, size_t>> watched;
+    if (!watchable_pages(watched)) {
+        qstring reason;
+        reason.sprnt("the tainted/symbolic memory is spread over more than %u ranges of pages", WATCHED_RANGES_LIMIT);
+        report_unavailable(reason.c_str());
+        return false;
+    }
+    if (watched.empty()) {
+        instructions_until_retry = UNAVAILABLE_RETRY_PERIOD;
+        return false;
+    }
+
+    //Every push and call would fault in a watched stack page
+    ea_t sp = (ea_t)IDA_getCurrentRegisterValue(tritonCtx.getStackPointer());
+    for (const auto& [address, size] : watched) {
+        if (sp >= address && sp < address + size) {
+            report_unavailable("the tainted/symbolic memory shares a page with the stack");
+            return false;
+        }
+    }
+
+    for (const auto& [address, size] : watched) {
+        //We don't want to take over a breakpoint set by the user
+        bool added = !exist_bpt(address) && add_bpt(address, size, BPT_RDWR);
+        //Only a page breakpoint stops before the access, a hardware one would let the native code read the input
+        bpt_t bpt;
+        bool page = added && get_bpt(address, &bpt) && (bpt.props & BKPT_PAGE) != 0;
+        if (added) {
+            breakpoint_pending_action bpa;
+            bpa.address = address;
+            bpa.size = size;
+            bpa.watchpoint = true;
+            bpa.ignore_breakpoint = false;
+            bpa.callback = watchpoint_hit;
+            breakpoint_pending_actions.push_back(bpa);
+        }
+        if (!page) {
+            if (cmdOptions.showDebugInfo)
+                msg("[!] Could not set a page breakpoint at " MEM_FORMAT " (%u bytes)\n", address, (unsigned int)size);
+            disarm_watchpoints();
+            report_unavailable("the debugger couldn't set page breakpoints on it");
+            return false;
+        }
+    }
+    unavailable_reported = false;
+
+    disable_step_trace();
+    ponce_runtime_status.running_natively = true;
+    annotation_queue.flush();
+    if (cmdOptions.showDebugInfo)
+        msg("[+] No register is tainted/symbolic, running natively until one of the %u watched ranges of pages is accessed\n", (unsigned int)watched.size());
+    return true;
+}
+
+/*Called from the dbg_bpt event when native code is about to access a watched page. The access didn't happen yet, the
+tracing goes on from the current instruction*/
+static void watchpoint_hit(ea_t address)
+{
+    resume_tracing();
+    instructions_until_retry = WATCHPOINT_HIT_COOLDOWN;
+    if (cmdOptions.showDebugInfo)
+        msg("[+] Watched page at " MEM_FORMAT " accessed at " MEM_FORMAT "\n", address, current_instruction());
+}
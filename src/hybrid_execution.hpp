@@ -0,0 +1,27 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+//IDA
+#include <ida.hpp>
+
+/*Hybrid execution: while no register is tainted or symbolic the process runs natively with page breakpoints on
+the pages holding tainted or symbolic memory. They fault before the access, so the tracing goes on from the instruction
+that accesses that memory. When the debugger can't set page breakpoints the process keeps being traced.*/
+
+//! Leaves the step tracing if nothing but watchable memory is tainted or symbolic. Returns true if the process runs natively now.
+bool try_run_natively(void);
+
+//! Removes the watchpoints and enables the step tracing again. The caller continues the process.
+void resume_tracing(void);
+
+//! Removes the watchpoints without touching the step tracing.
+void disarm_watchpoints(void);
@@ -0,0 +1,90 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+//Ponce
+#include "instruction_cache.hpp"
+#include "globals.hpp"
+
+//IDA
+#include <ida.hpp>
+#include <bytes.hpp>
+#include <kernwin.hpp>
+
+const cached_instruction* InstructionCache::get(ea_t address)
+{
+    auto it = this->instructions.find(address);
+    if (it != this->instructions.end())
+        return &it->second;
+
+    /*This will fill the 'cmd' (to get the instruction size) which is a insn_t structure https://www.hex-rays.com/products/ida/support/sdkdoc/classinsn__t.html */
+    cached_instruction cached;
+    decode_insn(&cached.ins, address);
+    cached.size = cached.ins.size;
+    if (cached.size <= 0 || cached.size > MAX_INSTRUCTION_SIZE)
+        return nullptr;
+
+    if (get_bytes(&cached.opcodes, cached.size, address, GMB_READALL, NULL) != cached.size)
+        return nullptr;
+    cached.transition = classify_transition_opcode(address, cached);
+
+    this->code_pages[address & ~(ea_t)(PONCE_PAGE_SIZE - 1)]++;
+    return &this->instructions.emplace(address, cached).first->second;
+}
+
+void InstructionCache::erase(std::unordered_map<ea_t, cached_instruction>::iterator it)
+{
+    auto page = this->code_pages.find(it->first & ~(ea_t)(PONCE_PAGE_SIZE - 1));
+    if (page != this->code_pages.end() && --page->second == 0)
+        this->code_pages.erase(page);
+    this->instructions.erase(it);
+}
+
+void InstructionCache::invalidate(ea_t address, size_t size)
+{
+    if (this->instructions.empty() || size == 0)
+        return;
+
+    // An instruction starting up to MAX_INSTRUCTION_SIZE - 1 bytes before the write may overlap it
+    ea_t start = address > MAX_INSTRUCTION_SIZE - 1 ? address - (MAX_INSTRUCTION_SIZE - 1) : 0;
+    ea_t end = address + size;
+
+    // Most of the writes go to data pages, we don't need to look for anything there
+    bool touches_code = false;
+    for (ea_t page = start & ~(ea_t)(PONCE_PAGE_SIZE - 1); page < end; page += PONCE_PAGE_SIZE) {
+        if (this->code_pages.find(page) != this->code_pages.end()) {
+            touches_code = true;
+            break;
+        }
+    }
+    if (!touches_code)
+        return;
+
+    if (end - start > this->instructions.size()) {
+        for (auto it = this->instructions.begin(); it != this->instructions.end();) {
+            auto next = std::next(it);
+            if (it->first >= start && it->first < end && it->first + it->second.size > address)
+                this->erase(it);
+            it = next;
+        }
+    }
+    else {
+        for (ea_t ea = start; ea < end; ea++) {
+            auto it = this->instructions.find(ea);
+            if (it != this->instructions.end() && ea + it->second.size > address)
+                this->erase(it);
+        }
+    }
+}
+
+void InstructionCache::clear(void)
+{
+    this->instructions.clear();
+    this->code_pages.clear();
+}
@@ -0,0 +1,55 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <unordered_map>
+
+//IDA
+#include <pro.h>
+#include <ua.hpp>
+
+//Ponce
+#include "transition_sites.hpp"
+
+// x86 instructions are up to 15 bytes long, ARM and AArch64 ones 4 bytes
+#define MAX_INSTRUCTION_SIZE 16
+
+struct cached_instruction {
+    insn_t ins;
+    unsigned char opcodes[MAX_INSTRUCTION_SIZE];
+    ssize_t size = 0;
+    //Syscalls and WOW64 gates, classified when the instruction is decoded
+    transition_kind_t transition = TRANSITION_NONE;
+};
+
+//! \class InstructionCache
+//! \brief Per-address cache of the instructions decoded while tracing, so loops are only decoded once.
+class InstructionCache {
+
+private:
+    //! Decoded instructions indexed by address.
+    std::unordered_map<ea_t, cached_instruction> instructions;
+
+    //! Number of cached instructions in every page, used to ignore writes to data pages quickly.
+    std::unordered_map<ea_t, unsigned int> code_pages;
+
+    void erase(std::unordered_map<ea_t, cached_instruction>::iterator it);
+
+public:
+    //! Returns the instruction at address decoding it on a miss, nullptr if it can not be decoded.
+    const cached_instruction* get(ea_t address);
+
+    //! Drops every cached instruction overlapping [address, address + size).
+    void invalidate(ea_t address, size_t size);
+
+    //! Drops all the cached instructions.
+    void clear(void);
+};
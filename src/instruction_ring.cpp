@@ -0,0 +1,47 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include "instruction_ring.hpp"
+
+InstructionRing::InstructionRing(size_t capacity) {
+    this->slots.resize(capacity ? capacity : 1);
+    this->head = 0;
+    this->count = 0;
+}
+
+triton::arch::Instruction* InstructionRing::next(void) {
+    this->head = (this->head + 1) % this->slots.size();
+    if (this->count < this->slots.size())
+        this->count++;
+
+    triton::arch::Instruction* instruction = &this->slots[this->head];
+    instruction->clear();
+    return instruction;
+}
+
+triton::arch::Instruction* InstructionRing::last(void) {
+    if (this->count == 0)
+        return nullptr;
+    return &this->slots[this->head];
+}
+
+const triton::arch::Instruction* InstructionRing::at(size_t age) const {
+    if (age >= this->count)
+        return nullptr;
+    return &this->slots[(this->head + this->slots.size() - age) % this->slots.size()];
+}
+
+size_t InstructionRing::size(void) const {
+    return this->count;
+}
+
+void InstructionRing::clear(void) {
+    this->count = 0;
+}
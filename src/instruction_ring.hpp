@@ -0,0 +1,53 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <vector>
+
+//Triton
+#include <triton/instruction.hpp>
+
+// Number of processed instructions we keep around
+#define INSTRUCTION_RING_SIZE 16
+
+//! \class InstructionRing
+//! \brief Fixed size ring with the last instructions processed by Triton. The slots are reused so tracing doesn't allocate an instruction per step.
+class InstructionRing {
+
+private:
+    //! Storage, allocated once.
+    std::vector<triton::arch::Instruction> slots;
+
+    //! Index of the last instruction.
+    size_t head;
+
+    //! Number of valid instructions.
+    size_t count;
+
+public:
+    //! Constructor.
+    InstructionRing(size_t capacity = INSTRUCTION_RING_SIZE);
+
+    //! Recycles the oldest slot, clears it and makes it the last instruction.
+    triton::arch::Instruction* next(void);
+
+    //! Returns the last instruction or nullptr if the ring is empty.
+    triton::arch::Instruction* last(void);
+
+    //! Returns the instruction processed 'age' steps ago (0 is the last one) or nullptr.
+    const triton::arch::Instruction* at(size_t age) const;
+
+    //! Number of instructions in the ring.
+    size_t size(void) const;
+
+    //! Forgets every instruction, the storage is kept.
+    void clear(void);
+};
@@ -26,6 +26,9 @@
 #include "utils.hpp"
 #include "formConfiguration.hpp"
 #include "triton_logic.hpp"
+#include "solver_cache.hpp"
+#include "solver_pool.hpp"
+#include "solver.hpp"
 #include "actions.hpp"
 
 #ifdef BUILD_HEXRAYS_SUPPORT
@@ -58,6 +61,12 @@ bool idaapi run(size_t)
         //Registering action for the Ponce taint window
         register_action(action_IDA_show_expressionsWindow);
         attach_action_to_menu("Edit/Ponce/", action_IDA_show_expressionsWindow.name, SETMENU_APP);
+        //Registering action for the tracing progress panel
+        register_action(action_IDA_show_progress_panel);
+        attach_action_to_menu("Edit/Ponce/", action_IDA_show_progress_panel.name, SETMENU_APP);
+        //Registering action for the snapshots window
+        register_action(action_IDA_show_snapshots);
+        attach_action_to_menu("Edit/Ponce/", action_IDA_show_snapshots.name, SETMENU_APP);
         //Registering action for the unload action
         register_action(action_IDA_unload);
         attach_action_to_menu("Edit/Ponce/", action_IDA_unload.name, SETMENU_APP);
@@ -173,7 +182,12 @@ int idaapi init(void)
 void idaapi term(void)
 {
     // remove snapshot if exists
-    snapshot.resetEngine();
+    snapshot_manager.resetEngine();
+    // the solver threads and the wait box timer can't outlive the plugin
+    solve_formula_reset();
+    solver_pool_stop();
+    // keep the queries solved for the next session if the user wants to
+    solver_cache_save();
     // We want to delete Ponce comments and colours before terminating
     delete_ponce_comments();
 #ifdef BUILD_HEXRAYS_SUPPORT
@@ -189,6 +203,10 @@ void idaapi term(void)
     detach_action_from_menu("Edit/Ponce/", action_IDA_show_config.name);
     unregister_action(action_IDA_show_expressionsWindow.name);
     detach_action_from_menu("Edit/Ponce/", action_IDA_show_expressionsWindow.name);
+    unregister_action(action_IDA_show_progress_panel.name);
+    detach_action_from_menu("Edit/Ponce/", action_IDA_show_progress_panel.name);
+    unregister_action(action_IDA_show_snapshots.name);
+    detach_action_from_menu("Edit/Ponce/", action_IDA_show_snapshots.name);
     unregister_action(action_IDA_unload.name);
     detach_action_from_menu("Edit/Ponce/", action_IDA_unload.name);
     unregister_action(action_IDA_clean.name);
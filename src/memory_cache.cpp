@@ -0,0 +1,111 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <cstring>
+#include <algorithm>
+
+//Ponce
+#include "memory_cache.hpp"
+#include "globals.hpp"
+
+//IDA
+#include <ida.hpp>
+#include <dbg.hpp>
+#include <bytes.hpp>
+#include <kernwin.hpp>
+
+#define PAGE_BASE(address) ((address) & ~(ea_t)(PONCE_PAGE_SIZE - 1))
+
+MemoryCache::MemoryCache() {
+    this->reads = 0;
+    this->hits = 0;
+    this->round_trips = 0;
+}
+
+const std::vector<std::uint8_t>* MemoryCache::fetch(ea_t page) {
+    auto it = this->pages.find(page);
+    if (it != this->pages.end())
+        return &it->second;
+    if (this->partial_pages.find(page) != this->partial_pages.end())
+        return nullptr;
+
+    std::vector<std::uint8_t> bytes(PONCE_PAGE_SIZE);
+    //This is the way to force IDA to read the value from the debugger
+    //More info here: https://www.hex-rays.com/products/ida/support/sdkdoc/dbg_8hpp.html#ac67a564945a2c1721691aa2f657a908c
+    invalidate_dbgmem_contents(page, PONCE_PAGE_SIZE);
+    this->round_trips++;
+    if (get_bytes(bytes.data(), PONCE_PAGE_SIZE, page, GMB_READALL, NULL) != PONCE_PAGE_SIZE) {
+        this->partial_pages.insert(page);
+        return nullptr;
+    }
+
+    return &this->pages.emplace(page, std::move(bytes)).first->second;
+}
+
+bool MemoryCache::read(ea_t address, void* buffer, size_t size) {
+    this->reads++;
+    std::uint64_t round_trips_before = this->round_trips;
+
+    size_t done = 0;
+    while (done < size) {
+        ea_t current = address + done;
+        ea_t page = PAGE_BASE(current);
+        size_t offset = current - page;
+        size_t chunk = std::min<size_t>(size - done, PONCE_PAGE_SIZE - offset);
+
+        const std::vector<std::uint8_t>* bytes = this->fetch(page);
+        if (bytes != nullptr) {
+            memcpy(static_cast<std::uint8_t*>(buffer) + done, bytes->data() + offset, chunk);
+        }
+        else {
+            //The page is not fully mapped, we only read what was asked
+            invalidate_dbgmem_contents(current, chunk);
+            this->round_trips++;
+            if (get_bytes(static_cast<std::uint8_t*>(buffer) + done, chunk, current, GMB_READALL, NULL) != (ssize_t)chunk)
+                return false;
+        }
+        done += chunk;
+    }
+
+    if (this->round_trips == round_trips_before)
+        this->hits++;
+    return true;
+}
+
+void MemoryCache::prefetch(ea_t address, size_t size) {
+    if (size == 0)
+        return;
+    for (ea_t page = PAGE_BASE(address); page < address + size; page += PONCE_PAGE_SIZE)
+        this->fetch(page);
+}
+
+void MemoryCache::invalidate(ea_t address, size_t size) {
+    if (this->pages.empty() || size == 0)
+        return;
+    for (ea_t page = PAGE_BASE(address); page < address + size; page += PONCE_PAGE_SIZE)
+        this->pages.erase(page);
+}
+
+void MemoryCache::clear(void) {
+    this->pages.clear();
+    this->partial_pages.clear();
+}
+
+void MemoryCache::print_statistics(void) {
+    if (this->reads == 0)
+        return;
+    // Without the cache every read was a round trip to the debugger
+    std::uint64_t saved = this->reads > this->round_trips ? this->reads - this->round_trips : 0;
+    msg("[+] Memory cache: %" PRIu64 " reads, hit rate %.1f%%, %" PRIu64 " debugger round trips, %" PRIu64 " saved\n",
+        this->reads,
+        100.0 * this->hits / this->reads,
+        this->round_trips,
+        saved);
+}
@@ -0,0 +1,62 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <cstdint>
+
+//IDA
+#include <pro.h>
+
+//! \class MemoryCache
+//! \brief Page granular copy of the debuggee memory read by Triton, so every load doesn't go to the debugger.
+class MemoryCache {
+
+private:
+    //! Cached pages indexed by their base address.
+    std::unordered_map<ea_t, std::vector<std::uint8_t>> pages;
+
+    //! Pages that couldn't be fully read, they are read access by access.
+    std::unordered_set<ea_t> partial_pages;
+
+    //! Number of reads served.
+    std::uint64_t reads;
+
+    //! Number of reads served without going to the debugger.
+    std::uint64_t hits;
+
+    //! Number of times we asked the debugger for memory.
+    std::uint64_t round_trips;
+
+    //! Reads a whole page from the debugger. Returns nullptr if the page can't be fully read.
+    const std::vector<std::uint8_t>* fetch(ea_t page);
+
+public:
+    //! Constructor.
+    MemoryCache();
+
+    //! Reads size bytes at address. Returns false if the memory can not be read.
+    bool read(ea_t address, void* buffer, size_t size);
+
+    //! Brings the pages covering [address, address + size) in the cache.
+    void prefetch(ea_t address, size_t size);
+
+    //! Drops the pages covering [address, address + size), they have been written.
+    void invalidate(ea_t address, size_t size);
+
+    //! Drops all the pages. The debuggee may have run code we didn't trace or written memory Triton didn't see.
+    void clear(void);
+
+    //! Prints the hit rate and the debugger round trips saved.
+    void print_statistics(void);
+};
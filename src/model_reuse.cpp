@@ -0,0 +1,289 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <deque>
+
+//Ponce
+#include "model_reuse.hpp"
+#include "globals.hpp"
+
+//Models tried before calling the solver
+#define RECENT_MODELS 16
+
+//Values of the variables by id
+typedef std::unordered_map<triton::usize, triton::uint512> model_values;
+
+static std::deque<model_values> recent_models;
+
+static triton::uint512 bit_mask(triton::uint32 size)
+{
+    if (size >= 512)
+        return ~triton::uint512(0);
+    return (triton::uint512(1) << size) - 1;
+}
+
+//Evaluates the ASTs of a query with some values for the variables, following the SMT-LIB semantics
+class ModelEvaluator {
+
+private:
+    const model_values& values;
+    std::unordered_map<const triton::ast::AbstractNode*, triton::uint512> results;
+
+    triton::uint512 neg(const triton::uint512& a, triton::uint32 size) const {
+        return (~a + 1) & bit_mask(size);
+    }
+
+    triton::uint512 udiv(const triton::uint512& a, const triton::uint512& b, triton::uint32 size) const {
+        return b == 0 ? bit_mask(size) : a / b;
+    }
+
+    triton::uint512 urem(const triton::uint512& a, const triton::uint512& b) const {
+        return b == 0 ? a : a % b;
+    }
+
+    static std::vector<triton::ast::AbstractNode*> children_of(triton::ast::AbstractNode* node) {
+        std::vector<triton::ast::AbstractNode*> children;
+        if (node->getType() == triton::ast::REFERENCE_NODE)
+            children.push_back(static_cast<triton::ast::ReferenceNode*>(node)->getSymbolicExpression()->getAst().get());
+        else if (node->getType() != triton::ast::VARIABLE_NODE)
+            for (const auto& child : node->getChildren())
+                children.push_back(child.get());
+        return children;
+    }
+
+    //Returns false if the node is not supported
+    bool compute(triton::ast::AbstractNode* node, const std::vector<triton::ast::AbstractNode*>& children, triton::uint512& r) {
+        std::vector<triton::uint512> c;
+        for (const auto& child : children)
+            c.push_back(this->results.at(child));
+        triton::uint32 size = node->isLogical() ? 1 : node->getBitvectorSize();
+        triton::uint512 mask = bit_mask(size);
+        triton::uint512 sign = size ? triton::uint512(1) << (size - 1) : 0;
+        //The operands of the comparisons have the size of their first child
+        triton::uint32 operand_size = children.empty() || children[0]->isLogical() ? 1 : children[0]->getBitvectorSize();
+        triton::uint512 operand_sign = operand_size ? triton::uint512(1) << (operand_size - 1) : 0;
+
+        switch (node->getType()) {
+        case triton::ast::INTEGER_NODE:
+            r = static_cast<triton::ast::IntegerNode*>(node)->getInteger();
+            return true;
+        case triton::ast::VARIABLE_NODE: {
+            const auto& variable = static_cast<triton::ast::VariableNode*>(node)->getSymbolicVariable();
+            auto it = this->values.find(variable->getId());
+            r = (it != this->values.end() ? it->second : tritonCtx.getConcreteVariableValue(variable)) & mask;
+            return true;
+        }
+        case triton::ast::REFERENCE_NODE: r = c[0]; return true;
+        case triton::ast::BV_NODE:        r = c[0] & mask; return true;
+        case triton::ast::BVADD_NODE:     r = (c[0] + c[1]) & mask; return true;
+        case triton::ast::BVSUB_NODE:     r = (c[0] - c[1]) & mask; return true;
+        case triton::ast::BVMUL_NODE:     r = (c[0] * c[1]) & mask; return true;
+        case triton::ast::BVAND_NODE:     r = c[0] & c[1]; return true;
+        case triton::ast::BVOR_NODE:      r = c[0] | c[1]; return true;
+        case triton::ast::BVXOR_NODE:     r = c[0] ^ c[1]; return true;
+        case triton::ast::BVNAND_NODE:    r = ~(c[0] & c[1]) & mask; return true;
+        case triton::ast::BVNOR_NODE:     r = ~(c[0] | c[1]) & mask; return true;
+        case triton::ast::BVXNOR_NODE:    r = ~(c[0] ^ c[1]) & mask; return true;
+        case triton::ast::BVNOT_NODE:     r = ~c[0] & mask; return true;
+        case triton::ast::BVNEG_NODE:     r = this->neg(c[0], size); return true;
+        case triton::ast::BVUDIV_NODE:    r = this->udiv(c[0], c[1], size); return true;
+        case triton::ast::BVUREM_NODE:    r = this->urem(c[0], c[1]); return true;
+        case triton::ast::BVSHL_NODE:
+            r = c[1] >= size ? 0 : (c[0] << static_cast<triton::uint32>(c[1])) & mask;
+            return true;
+        case triton::ast::BVLSHR_NODE:
+            r = c[1] >= size ? 0 : c[0] >> static_cast<triton::uint32>(c[1]);
+            return true;
+        case triton::ast::BVASHR_NODE:
+            if (c[1] >= size)
+                r = (c[0] & sign) ? mask : 0;
+            else {
+                triton::uint32 shift = static_cast<triton::uint32>(c[1]);
+                r = c[0] >> shift;
+                if (c[0] & sign)
+                    r |= mask & ~(mask >> shift);
+            }
+            return true;
+        case triton::ast::BVROL_NODE:
+        case triton::ast::BVROR_NODE: {
+            triton::uint32 rotation = static_cast<triton::uint32>(c[1] % size);
+            if (node->getType() == triton::ast::BVROR_NODE)
+                rotation = (size - rotation) % size;
+            r = rotation == 0 ? c[0] : ((c[0] << rotation) | (c[0] >> (size - rotation))) & mask;
+            return true;
+        }
+        case triton::ast::BVSDIV_NODE:
+        case triton::ast::BVSREM_NODE:
+        case triton::ast::BVSMOD_NODE: {
+            bool negative_a = (c[0] & sign) != 0;
+            bool negative_b = (c[1] & sign) != 0;
+            triton::uint512 a = negative_a ? this->neg(c[0], size) : c[0];
+            triton::uint512 b = negative_b ? this->neg(c[1], size) : c[1];
+            if (node->getType() == triton::ast::BVSDIV_NODE) {
+                r = this->udiv(a, b, size);
+                if (negative_a != negative_b)
+                    r = this->neg(r, size);
+            }
+            else if (node->getType() == triton::ast::BVSREM_NODE) {
+                r = this->urem(a, b);
+                if (negative_a)
+                    r = this->neg(r, size);
+            }
+            else {
+                triton::uint512 u = this->urem(a, b);
+                if (u == 0 || (!negative_a && !negative_b))
+                    r = u;
+                else if (negative_a && !negative_b)
+                    r = (this->neg(u, size) + c[1]) & mask;
+                else if (!negative_a && negative_b)
+                    r = (u + c[1]) & mask;
+                else
+                    r = this->neg(u, size);
+            }
+            return true;
+        }
+        case triton::ast::BSWAP_NODE:
+            r = 0;
+            for (triton::uint32 i = 0; i < size / 8; i++)
+                r = (r << 8) | ((c[0] >> (8 * i)) & 0xFF);
+            return true;
+        case triton::ast::CONCAT_NODE:
+            r = 0;
+            for (size_t i = 0; i < children.size(); i++)
+                r = (r << children[i]->getBitvectorSize()) | c[i];
+            return true;
+        case triton::ast::EXTRACT_NODE: {
+            triton::uint32 high = static_cast<triton::uint32>(c[0]);
+            triton::uint32 low = static_cast<triton::uint32>(c[1]);
+            r = (c[2] >> low) & bit_mask(high - low + 1);
+            return true;
+        }
+        case triton::ast::ZX_NODE:
+            r = c[1];
+            return true;
+        case triton::ast::SX_NODE: {
+            triton::uint32 child_size = children[1]->getBitvectorSize();
+            r = c[1];
+            if (child_size && (c[1] & (triton::uint512(1) << (child_size - 1))))
+                r |= mask & ~bit_mask(child_size);
+            return true;
+        }
+        case triton::ast::ITE_NODE:       r = c[0] != 0 ? c[1] : c[2]; return true;
+        case triton::ast::EQUAL_NODE:     r = c[0] == c[1]; return true;
+        case triton::ast::DISTINCT_NODE:  r = c[0] != c[1]; return true;
+        case triton::ast::BVUGE_NODE:     r = c[0] >= c[1]; return true;
+        case triton::ast::BVUGT_NODE:     r = c[0] > c[1]; return true;
+        case triton::ast::BVULE_NODE:     r = c[0] <= c[1]; return true;
+        case triton::ast::BVULT_NODE:     r = c[0] < c[1]; return true;
+        case triton::ast::BVSGE_NODE:     r = (c[0] ^ operand_sign) >= (c[1] ^ operand_sign); return true;
+        case triton::ast::BVSGT_NODE:     r = (c[0] ^ operand_sign) > (c[1] ^ operand_sign); return true;
+        case triton::ast::BVSLE_NODE:     r = (c[0] ^ operand_sign) <= (c[1] ^ operand_sign); return true;
+        case triton::ast::BVSLT_NODE:     r = (c[0] ^ operand_sign) < (c[1] ^ operand_sign); return true;
+        case triton::ast::IFF_NODE:       r = (c[0] != 0) == (c[1] != 0); return true;
+        case triton::ast::LNOT_NODE:      r = c[0] == 0; return true;
+        case triton::ast::LAND_NODE:
+            r = 1;
+            for (const auto& value : c)
+                r = r != 0 && value != 0;
+            return true;
+        case triton::ast::LOR_NODE:
+            r = 0;
+            for (const auto& value : c)
+                r = r != 0 || value != 0;
+            return true;
+        case triton::ast::LXOR_NODE:
+            r = 0;
+            for (const auto& value : c)
+                r = (r != 0) != (value != 0);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+public:
+    ModelEvaluator(const model_values& values) : values(values) {
+    }
+
+    //! Evaluates a formula, post order without recursion. Returns false if it has a node that can't be evaluated.
+    bool evaluate(const triton::ast::SharedAbstractNode& formula, triton::uint512& result) {
+        std::vector<std::pair<triton::ast::AbstractNode*, bool>> pending = { { formula.get(), false } };
+        while (!pending.empty()) {
+            auto [node, expanded] = pending.back();
+            pending.pop_back();
+            if (this->results.count(node) != 0)
+                continue;
+            auto children = children_of(node);
+            if (!expanded) {
+                pending.emplace_back(node, true);
+                for (auto it = children.rbegin(); it != children.rend(); ++it)
+                    pending.emplace_back(*it, false);
+                continue;
+            }
+            triton::uint512 r;
+            if (!this->compute(node, children, r))
+                return false;
+            this->results[node] = r;
+        }
+        result = this->results.at(formula.get());
+        return true;
+    }
+};
+
+bool model_reuse_lookup(const std::vector<triton::ast::SharedAbstractNode>& formulas, const std::vector<triton::engines::symbolic::SharedSymbolicVariable>& variables,
+    std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model)
+{
+    for (const auto& values : recent_models) {
+        //A model without any variable of the query leaves the current input, it doesn't take the other branch
+        bool shared = false;
+        for (const auto& variable : variables)
+            shared = shared || values.count(variable->getId()) != 0;
+        if (!shared)
+            continue;
+
+        //The branch to solve is the last formula, it is the one most likely to be false
+        ModelEvaluator evaluator(values);
+        bool satisfied = true;
+        for (auto it = formulas.rbegin(); it != formulas.rend() && satisfied; ++it) {
+            triton::uint512 result;
+            satisfied = evaluator.evaluate(*it, result) && result != 0;
+        }
+        if (!satisfied)
+            continue;
+
+        model.clear();
+        for (const auto& variable : variables) {
+            auto value = values.find(variable->getId());
+            if (value != values.end())
+                model.emplace(variable->getId(), triton::engines::solver::SolverModel(variable, value->second));
+        }
+        if (cmdOptions.showExtraDebugInfo)
+            msg("[+] A previous model satisfies the query, the solver is not needed\n");
+        return true;
+    }
+    return false;
+}
+
+void model_reuse_store(const std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model)
+{
+    if (model.empty())
+        return;
+    model_values values;
+    for (const auto& [id, solver_model] : model)
+        values[id] = solver_model.getValue();
+    recent_models.push_front(std::move(values));
+    if (recent_models.size() > RECENT_MODELS)
+        recent_models.pop_back();
+}
+
+void model_reuse_reset(void)
+{
+    recent_models.clear();
+}
@@ -0,0 +1,31 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+//Triton
+#include <triton/context.hpp>
+#include <triton/ast.hpp>
+
+/*Model reuse: the branches of a parser are often satisfied by a model found for a branch near them. Before calling the
+solver the query is evaluated with the last models found, the variables they don't have keep their current value.*/
+
+//! Returns true if one of the last models satisfies all the formulas, it is returned in model.
+bool model_reuse_lookup(const std::vector<triton::ast::SharedAbstractNode>& formulas, const std::vector<triton::engines::symbolic::SharedSymbolicVariable>& variables,
+    std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model);
+
+//! Remembers a model found, the oldest one is forgotten.
+void model_reuse_store(const std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model);
+
+//! Forgets the models, their variables don't exist anymore.
+void model_reuse_reset(void);
@@ -0,0 +1,143 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+//IDA
+#include <ida.hpp>
+#include <dbg.hpp>
+#include <kernwin.hpp>
+
+//Triton
+#include <triton/context.hpp>
+
+//Ponce
+#include "progress_panel.hpp"
+#include "globals.hpp"
+#include "blacklist.hpp"
+#include "utils.hpp"
+#include "solver.hpp"
+#include "solver_pool.hpp"
+
+// Minimum time between two refreshes of the panel while tracing, in ms
+#define PROGRESS_REFRESH_PERIOD 500
+
+struct ponce_progress_chooser_t* ponce_progress_chooser = nullptr;
+
+static std::uint64_t last_refresh = 0;
+
+const int ponce_progress_chooser_t::widths_[] = {
+    30,
+    30
+};
+
+// column headers
+const char* ponce_progress_chooser_t::header_[] =
+{
+    "Statistic",
+    "Value"
+};
+
+ponce_progress_chooser_t::ponce_progress_chooser_t()
+    : chooser_t(CH_CAN_REFRESH, qnumber(widths_), widths_, header_, PROGRESS_PANEL_TITLE) {
+    CASSERT(qnumber(widths_) == qnumber(header_));
+
+    fill_entryList();
+}
+
+static std::string tracing_state(void)
+{
+    if (!is_debugger_on())
+        return "Not debugging";
+    if (ponce_runtime_status.budget_exhausted)
+        return "Paused, budget reached";
+    if (ponce_runtime_status.running_natively)
+        return "Running natively, watching tainted/symbolic memory";
+    if (!ponce_runtime_status.runtimeTrigger.getState())
+        return breakpoint_pending_actions.empty() ? "Disabled" : "Running natively until the traced code is reached";
+    if (get_process_state() == DSTATE_SUSP)
+        return "Suspended";
+    return "Tracing";
+}
+
+void ponce_progress_chooser_t::fill_entryList() {
+    std::uint64_t now = GetTimeMs64();
+    if (ponce_runtime_status.total_number_traced_ins < last_sample_instructions) {
+        //The engines were restarted
+        instructions_per_second = 0;
+    }
+    else if (last_sample_time != 0 && now > last_sample_time) {
+        instructions_per_second = (ponce_runtime_status.total_number_traced_ins - last_sample_instructions) * 1000.0 / (now - last_sample_time);
+    }
+    last_sample_instructions = ponce_runtime_status.total_number_traced_ins;
+    last_sample_time = now;
+
+    rows.clear();
+    rows.emplace_back("State", tracing_state());
+    rows.emplace_back("Instructions/s", std::to_string((unsigned int)instructions_per_second));
+    rows.emplace_back("Traced instructions", std::to_string(ponce_runtime_status.total_number_traced_ins));
+    rows.emplace_back(cmdOptions.use_tainting_engine ? "Tainted instructions" : "Symbolic instructions", std::to_string(ponce_runtime_status.total_number_symbolic_ins));
+    rows.emplace_back("Fast-pathed instructions", std::to_string(ponce_runtime_status.total_number_fast_path_ins));
+    rows.emplace_back(cmdOptions.use_tainting_engine ? "Tainted conditions" : "Symbolic conditions", std::to_string(ponce_runtime_status.total_number_symbolic_conditions));
+    rows.emplace_back("Path constraints", std::to_string(tritonCtx.getPathConstraints().size()));
+
+    //The time saved is estimated with the average time of the solver
+    std::uint64_t solver_hits = solver_statistics.cache_hits + solver_statistics.model_reuse_hits;
+    rows.emplace_back("Solver queries", std::to_string(solver_statistics.queries));
+    rows.emplace_back("Solver time (ms)", std::to_string(solver_statistics.solver_time));
+    rows.emplace_back("Solver cache hits", std::to_string(solver_statistics.cache_hits));
+    rows.emplace_back("Model reuse hits", std::to_string(solver_statistics.model_reuse_hits));
+    if (solver_statistics.queries) {
+        rows.emplace_back("Queries without solver", std::to_string(solver_hits * 100 / solver_statistics.queries) + "%");
+        rows.emplace_back("Solver time saved (ms)", solver_statistics.solver_calls ? std::to_string(solver_hits * solver_statistics.solver_time / solver_statistics.solver_calls) : "Unknown");
+    }
+    if (cmdOptions.solver_portfolio) {
+        std::string wins;
+        for (const auto& [name, count] : solver_portfolio_ranking())
+            wins += (wins.empty() ? "" : ", ") + name + " " + std::to_string(count);
+        rows.emplace_back("Portfolio wins", wins);
+    }
+
+    if (cmdOptions.limitInstructionsTracingMode) {
+        auto left = cmdOptions.limitInstructionsTracingMode > ponce_runtime_status.current_trace_counter ? cmdOptions.limitInstructionsTracingMode - ponce_runtime_status.current_trace_counter : 0;
+        rows.emplace_back("Instruction budget left", std::to_string(left));
+    }
+    else {
+        rows.emplace_back("Instruction budget left", "Unlimited");
+    }
+
+    if (cmdOptions.limitTime && ponce_runtime_status.tracing_start_time != 0) {
+        std::uint64_t elapsed = (now - ponce_runtime_status.tracing_start_time) / 1000;
+        rows.emplace_back("Time budget left (s)", std::to_string(cmdOptions.limitTime > elapsed ? cmdOptions.limitTime - elapsed : 0));
+    }
+    else {
+        rows.emplace_back("Time budget left (s)", cmdOptions.limitTime ? std::to_string(cmdOptions.limitTime) : "Unlimited");
+    }
+}
+
+// function that generates the list line
+void idaapi ponce_progress_chooser_t::get_row(qstrvec_t* cols_, int*, chooser_item_attrs_t*,
+    size_t n) const {
+    qstrvec_t& cols = *cols_;
+
+    const auto& row = rows.at(n);
+    cols[0].sprnt("%s", row.first.c_str());
+    cols[1].sprnt("%s", row.second.c_str());
+}
+
+void refresh_progress_panel(bool force)
+{
+    if (ponce_progress_chooser == nullptr)
+        return;
+
+    std::uint64_t now = GetTimeMs64();
+    if (!force && now - last_refresh < PROGRESS_REFRESH_PERIOD)
+        return;
+    last_refresh = now;
+    refresh_chooser(PROGRESS_PANEL_TITLE);
+}
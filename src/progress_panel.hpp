@@ -0,0 +1,64 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "kernwin.hpp"
+
+#define PROGRESS_PANEL_TITLE "Ponce Tracing Progress"
+
+extern struct ponce_progress_chooser_t* ponce_progress_chooser;
+
+// Live statistics of the tracing, the pause/resume/extend budget actions are in its popup menu
+struct ponce_progress_chooser_t : public chooser_t
+{
+protected:
+    static const int widths_[];
+    static const char* header_[];
+
+    //Instructions traced and time the last time the speed was computed
+    unsigned int last_sample_instructions = 0;
+    std::uint64_t last_sample_time = 0;
+    double instructions_per_second = 0;
+
+public:
+    //Name and value of every statistic
+    std::vector<std::pair<std::string, std::string>> rows;
+
+    // function that returns number of lines in the list
+    virtual size_t idaapi get_count() const { return rows.size(); }
+
+    // function that generates the list line
+    virtual void idaapi get_row(qstrvec_t* cols, int* icon_,
+        chooser_item_attrs_t* attrs,
+        size_t n) const;
+
+    // function that is called when the user wants to refresh the chooser
+    virtual cbret_t idaapi refresh(ssize_t n) {
+        fill_entryList();
+        return adjust_last_item(n);  // try to preserve the cursor
+    }
+
+    // function that is called when the user wants to close the chooser
+    virtual void idaapi closed() {
+        rows.clear();
+        ponce_progress_chooser = nullptr;
+    }
+
+    ponce_progress_chooser_t();
+    void fill_entryList();
+};
+
+//! Refreshes the panel if it is open. While tracing it is only refreshed a couple of times per second unless force is set.
+void refresh_progress_panel(bool force);
@@ -27,21 +27,27 @@ typedef struct runtime_status_t
     unsigned int total_number_symbolic_ins;
     //This variable is use to have statistics
     unsigned int total_number_symbolic_conditions;
+    //Number of traced instructions that didn't need the Triton semantics because they couldn't touch tainted/symbolic state
+    unsigned int total_number_fast_path_ins;
     //This variable is used to count how many instructions were executed after the user was asked
     unsigned int current_trace_counter;
     //This index is used when we are renaming the tainted funcitons, to know the index
     unsigned int tainted_functions_index;
     //Trigger to enable/disable triton
     Trigger runtimeTrigger;
-    //This is the last instruction executed by triton, we need to reference to reanalize if the user taint a register
-    triton::arch::Instruction* last_triton_instruction;
     //This variable is used to know how much time the tracing was working, and stop if this time is bigger than the user defined value
     std::uint64_t tracing_start_time = 0;
     thid_t analyzed_thread;
     //Flag used to skip the step over done to deal with wow64 switching
     bool ignore_wow64_switching_step = false;
+    //Set when the Triton semantics of a syscall were skipped, what the kernel changed is concretized in the next instruction
+    bool syscall_skipped = false;
     // Set when user uses run & break on symbolic
     bool run_and_break_on_symbolic_branch = false;
+    //Set while the process runs natively waiting for a page breakpoint on the tainted/symbolic memory
+    bool running_natively = false;
+    //Set when the process was suspended because the instruction or time budget was reached
+    bool budget_exhausted = false;
 } runtime_status_t;
 
 extern runtime_status_t ponce_runtime_status;
\ No newline at end of file
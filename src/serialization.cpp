@@ -0,0 +1,66 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+//Ponce
+#include "serialization.hpp"
+
+std::uint64_t bytes_left(std::istream& in)
+{
+    std::streampos position = in.tellg();
+    if (position == std::streampos(-1))
+        return 0;
+    in.seekg(0, std::ios::end);
+    std::streampos end = in.tellg();
+    in.seekg(position);
+    return end > position ? (std::uint64_t)(end - position) : 0;
+}
+
+/* The integers of the AST can be up to 512 bits, most of them fit in one word */
+void write_integer(std::ostream& out, const triton::uint512& v)
+{
+    std::uint64_t words[8];
+    std::uint8_t count = 0;
+    triton::uint512 rest = v;
+    while (rest != 0) {
+        words[count++] = static_cast<std::uint64_t>(rest & triton::uint512(0xFFFFFFFFFFFFFFFFull));
+        rest >>= 64;
+    }
+    out.put((char)count);
+    out.write(reinterpret_cast<const char*>(words), count * sizeof(std::uint64_t));
+}
+
+bool read_integer(std::istream& in, triton::uint512& v)
+{
+    std::uint8_t count = (std::uint8_t)in.get();
+    if (!in || count > 8)
+        return false;
+    std::uint64_t words[8];
+    in.read(reinterpret_cast<char*>(words), count * sizeof(std::uint64_t));
+    v = 0;
+    for (int i = count - 1; i >= 0; i--)
+        v = (v << 64) | words[i];
+    return (bool)in;
+}
+
+void write_string(std::ostream& out, const std::string& s)
+{
+    write_value<std::uint32_t>(out, (std::uint32_t)s.size());
+    out.write(s.data(), s.size());
+}
+
+bool read_string(std::istream& in, std::string& s)
+{
+    std::uint32_t size;
+    //A corrupted size would allocate up to 4 GB
+    if (!read_value(in, size) || size > bytes_left(in))
+        return false;
+    s.assign(size, '\0');
+    return size == 0 || (bool)in.read(&s[0], size);
+}
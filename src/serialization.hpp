@@ -0,0 +1,48 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+//Triton
+#include <triton/tritonTypes.hpp>
+
+//Helpers shared by the files Ponce writes next to the IDB, the session and the solver cache
+
+//! Writes a value as it is in memory.
+template <typename T>
+void write_value(std::ostream& out, T v) {
+    out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+//! Reads a value written by write_value. Returns false if the stream is too short.
+template <typename T>
+bool read_value(std::istream& in, T& v) {
+    return (bool)in.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+
+//! Bytes between the read position and the end of the stream, 0 if it can't be told. Sizes read from a file are checked against it before allocating.
+std::uint64_t bytes_left(std::istream& in);
+
+//! Writes an integer of up to 512 bits, only the 64 bits words it needs.
+void write_integer(std::ostream& out, const triton::uint512& v);
+
+//! Reads an integer written by write_integer. Returns false if the stream is too short or corrupted.
+bool read_integer(std::istream& in, triton::uint512& v);
+
+//! Writes a string preceded by its size.
+void write_string(std::ostream& out, const std::string& s);
+
+//! Reads a string written by write_string. Returns false if the stream is too short.
+bool read_string(std::istream& in, std::string& s);
@@ -0,0 +1,796 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+
+//Ponce
+#include "session.hpp"
+#include "globals.hpp"
+#include "utils.hpp"
+#include "snapshot.hpp"
+#include "snapshot_chooser.hpp"
+#include "triton_logic.hpp"
+#include "shadow_state.hpp"
+
+//IDA
+#include <dbg.hpp>
+#include <loader.hpp>
+#include <nalt.hpp>
+
+#define PAGE_BASE(address) ((address) & ~(ea_t)(PONCE_PAGE_SIZE - 1))
+
+//The first bytes of a session file
+static const char session_magic[8] = { 'P', 'O', 'N', 'C', 'E', 'S', 'E', 'S' };
+//Changes every time the format changes, older files are refused
+static const std::uint32_t session_version = 4;
+
+//Kinds of entries of the table
+enum session_object_t : std::uint8_t {
+    SESSION_NODE = 0,
+    SESSION_EXPRESSION = 1,
+};
+
+//Pages written while tracing since the engines were restarted
+static std::set<ea_t> written_pages;
+//Most stores go to the page of the previous one
+static ea_t last_written_page = BADADDR;
+
+void session_record_store(ea_t address, size_t size)
+{
+    for (ea_t page_base = PAGE_BASE(address); page_base < address + size; page_base += PONCE_PAGE_SIZE) {
+        if (page_base == last_written_page)
+            continue;
+        written_pages.insert(page_base);
+        last_written_page = page_base;
+    }
+}
+
+void session_reset(void)
+{
+    written_pages.clear();
+    last_written_page = BADADDR;
+}
+
+qstring default_session_path(void)
+{
+    char path[QMAXPATH];
+    set_file_ext(path, sizeof(path), get_path(PATH_TYPE_IDB), "ponce");
+    return qstring(path);
+}
+
+/* The nodes that SessionReader knows how to build again */
+static bool is_supported_node(triton::ast::ast_e type)
+{
+    switch (type) {
+    case triton::ast::BSWAP_NODE:
+    case triton::ast::BVADD_NODE:
+    case triton::ast::BVAND_NODE:
+    case triton::ast::BVASHR_NODE:
+    case triton::ast::BVLSHR_NODE:
+    case triton::ast::BVMUL_NODE:
+    case triton::ast::BVNAND_NODE:
+    case triton::ast::BVNEG_NODE:
+    case triton::ast::BVNOR_NODE:
+    case triton::ast::BVNOT_NODE:
+    case triton::ast::BVOR_NODE:
+    case triton::ast::BVROL_NODE:
+    case triton::ast::BVROR_NODE:
+    case triton::ast::BVSDIV_NODE:
+    case triton::ast::BVSGE_NODE:
+    case triton::ast::BVSGT_NODE:
+    case triton::ast::BVSHL_NODE:
+    case triton::ast::BVSLE_NODE:
+    case triton::ast::BVSLT_NODE:
+    case triton::ast::BVSMOD_NODE:
+    case triton::ast::BVSREM_NODE:
+    case triton::ast::BVSUB_NODE:
+    case triton::ast::BVUDIV_NODE:
+    case triton::ast::BVUGE_NODE:
+    case triton::ast::BVUGT_NODE:
+    case triton::ast::BVULE_NODE:
+    case triton::ast::BVULT_NODE:
+    case triton::ast::BVUREM_NODE:
+    case triton::ast::BVXNOR_NODE:
+    case triton::ast::BVXOR_NODE:
+    case triton::ast::BV_NODE:
+    case triton::ast::CONCAT_NODE:
+    case triton::ast::DISTINCT_NODE:
+    case triton::ast::EQUAL_NODE:
+    case triton::ast::EXTRACT_NODE:
+    case triton::ast::IFF_NODE:
+    case triton::ast::INTEGER_NODE:
+    case triton::ast::ITE_NODE:
+    case triton::ast::LAND_NODE:
+    case triton::ast::LNOT_NODE:
+    case triton::ast::LOR_NODE:
+    case triton::ast::LXOR_NODE:
+    case triton::ast::REFERENCE_NODE:
+    case triton::ast::STRING_NODE:
+    case triton::ast::SX_NODE:
+    case triton::ast::VARIABLE_NODE:
+    case triton::ast::ZX_NODE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+SessionWriter::SessionWriter() {
+    this->objects_count = 0;
+}
+
+void SessionWriter::string(const std::string& s) {
+    write_string(this->data, s);
+}
+
+void SessionWriter::bytes(const std::uint8_t* buffer, size_t size) {
+    this->data.write(reinterpret_cast<const char*>(buffer), size);
+}
+
+void SessionWriter::integer(const triton::uint512& v) {
+    write_integer(this->data, v);
+}
+
+/* Depth first without recursion, the chains of references are as long as the trace */
+std::uint32_t SessionWriter::add_object(const triton::ast::SharedAbstractNode& root_node, const triton::engines::symbolic::SharedSymbolicExpression& root_expression) {
+    struct pending_object {
+        triton::ast::SharedAbstractNode node;
+        triton::engines::symbolic::SharedSymbolicExpression expression;
+        bool expanded;
+    };
+    std::vector<pending_object> pending;
+    pending.push_back({ root_node, root_expression, false });
+
+    while (!pending.empty()) {
+        pending_object object = pending.back();
+        pending.pop_back();
+        const void* key = object.node ? (const void*)object.node.get() : (const void*)object.expression.get();
+        if (this->indexes.count(key))
+            continue;
+
+        if (!object.expanded) {
+            //We come back to it once what it refers to is in the table
+            pending.push_back({ object.node, object.expression, true });
+            if (object.expression) {
+                pending.push_back({ object.expression->getAst(), nullptr, false });
+            }
+            else if (object.node->getType() == triton::ast::REFERENCE_NODE) {
+                auto reference = reinterpret_cast<triton::ast::ReferenceNode*>(object.node.get());
+                pending.push_back({ nullptr, reference->getSymbolicExpression(), false });
+            }
+            else {
+                for (const auto& child : object.node->getChildren())
+                    pending.push_back({ child, nullptr, false });
+            }
+            continue;
+        }
+
+        std::ostringstream& out = this->objects;
+        auto write_u32 = [&out](std::uint32_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+        if (object.expression) {
+            out.put(SESSION_EXPRESSION);
+            write_u32(this->indexes[object.expression->getAst().get()]);
+            write_string(out, object.expression->getComment());
+        }
+        else {
+            auto type = object.node->getType();
+            if (!is_supported_node(type) && this->error.empty())
+                this->error = "the AST has nodes that can't be saved";
+            out.put(SESSION_NODE);
+            out.put((char)type);
+            switch (type) {
+            case triton::ast::INTEGER_NODE:
+                write_integer(out, reinterpret_cast<triton::ast::IntegerNode*>(object.node.get())->getInteger());
+                break;
+            case triton::ast::VARIABLE_NODE: {
+                std::uint64_t id = reinterpret_cast<triton::ast::VariableNode*>(object.node.get())->getSymbolicVariable()->getId();
+                out.write(reinterpret_cast<const char*>(&id), sizeof(id));
+                break;
+            }
+            case triton::ast::REFERENCE_NODE:
+                write_u32(this->indexes[reinterpret_cast<triton::ast::ReferenceNode*>(object.node.get())->getSymbolicExpression().get()]);
+                break;
+            case triton::ast::STRING_NODE:
+                write_string(out, reinterpret_cast<triton::ast::StringNode*>(object.node.get())->getString());
+                break;
+            default:
+                write_u32((std::uint32_t)object.node->getChildren().size());
+                for (const auto& child : object.node->getChildren())
+                    write_u32(this->indexes[child.get()]);
+                break;
+            }
+        }
+        this->indexes[key] = this->objects_count++;
+    }
+
+    const void* root = root_node ? (const void*)root_node.get() : (const void*)root_expression.get();
+    return this->indexes[root];
+}
+
+void SessionWriter::node(const triton::ast::SharedAbstractNode& node) {
+    this->value<std::uint32_t>(this->add_object(node, nullptr));
+}
+
+void SessionWriter::expression(const triton::engines::symbolic::SharedSymbolicExpression& expression) {
+    this->value<std::uint32_t>(this->add_object(nullptr, expression));
+}
+
+void SessionWriter::path_constraint(const triton::engines::symbolic::PathConstraint& path_constraint) {
+    const auto& branches = path_constraint.getBranchConstraints();
+    this->value<std::uint32_t>((std::uint32_t)branches.size());
+    for (const auto& [taken, srcAddr, dstAddr, constraint] : branches) {
+        this->value<std::uint8_t>(taken);
+        this->value<std::uint64_t>(srcAddr);
+        this->value<std::uint64_t>(dstAddr);
+        this->node(constraint);
+    }
+}
+
+void SessionWriter::status(const runtime_status_t& status) {
+    this->value<std::uint32_t>(status.total_number_traced_ins);
+    this->value<std::uint32_t>(status.total_number_symbolic_ins);
+    this->value<std::uint32_t>(status.total_number_symbolic_conditions);
+    this->value<std::uint32_t>(status.total_number_fast_path_ins);
+    this->value<std::uint32_t>(status.tainted_functions_index);
+}
+
+bool SessionWriter::save(const char* path) {
+    if (!this->error.empty()) {
+        msg("[!] The session can't be saved, %s\n", this->error.c_str());
+        return false;
+    }
+
+    std::ofstream session_file;
+    session_file.open(path, std::ios::out | std::ios::binary);
+    if (!session_file.is_open()) {
+        msg("[!] Error opening session file %s\n", path);
+        return false;
+    }
+
+    //The header, the file is only valid for the same binary loaded at the same address
+    std::uint32_t arch = (std::uint32_t)tritonCtx.getArchitecture();
+    std::uint64_t imagebase = get_imagebase();
+    session_file.write(session_magic, sizeof(session_magic));
+    session_file.write(reinterpret_cast<const char*>(&session_version), sizeof(session_version));
+    session_file.write(reinterpret_cast<const char*>(&arch), sizeof(arch));
+    session_file.write(reinterpret_cast<const char*>(&imagebase), sizeof(imagebase));
+
+    //The variables go first, the table refers to them
+    std::vector<triton::engines::symbolic::SharedSymbolicVariable> variables;
+    for (const auto& [id, variable] : tritonCtx.getSymbolicVariables())
+        variables.push_back(variable);
+    std::sort(variables.begin(), variables.end(), [](const auto& a, const auto& b) { return a->getId() < b->getId(); });
+    std::uint32_t variables_count = (std::uint32_t)variables.size();
+    session_file.write(reinterpret_cast<const char*>(&variables_count), sizeof(variables_count));
+    for (const auto& variable : variables) {
+        std::uint64_t id = variable->getId();
+        std::uint8_t type = (std::uint8_t)variable->getType();
+        std::uint64_t origin = variable->getOrigin();
+        std::uint32_t size = variable->getSize();
+        session_file.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        session_file.write(reinterpret_cast<const char*>(&type), sizeof(type));
+        session_file.write(reinterpret_cast<const char*>(&origin), sizeof(origin));
+        session_file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        write_string(session_file, variable->getAlias());
+        write_string(session_file, variable->getComment());
+        write_integer(session_file, tritonCtx.getConcreteVariableValue(variable));
+    }
+
+    session_file.write(reinterpret_cast<const char*>(&this->objects_count), sizeof(this->objects_count));
+    session_file << this->objects.str();
+    session_file << this->data.str();
+    session_file.close();
+    if (!session_file) {
+        msg("[!] Error writing session file %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+SessionReader::SessionReader() {
+    this->failed = false;
+}
+
+bool SessionReader::ok(void) const {
+    return !this->failed;
+}
+
+std::string SessionReader::string(void) {
+    std::string s;
+    if (!read_string(this->data, s))
+        this->failed = true;
+    return s;
+}
+
+bool SessionReader::bytes(std::uint8_t* buffer, size_t size) {
+    if (!this->data.read(reinterpret_cast<char*>(buffer), size))
+        this->failed = true;
+    return !this->failed;
+}
+
+triton::uint512 SessionReader::integer(void) {
+    triton::uint512 v = 0;
+    if (!read_integer(this->data, v))
+        this->failed = true;
+    return v;
+}
+
+triton::ast::SharedAbstractNode SessionReader::node(void) {
+    std::uint32_t index = this->value<std::uint32_t>();
+    if (index >= this->nodes.size() || !this->nodes[index]) {
+        this->failed = true;
+        return nullptr;
+    }
+    return this->nodes[index];
+}
+
+triton::engines::symbolic::SharedSymbolicExpression SessionReader::expression(void) {
+    std::uint32_t index = this->value<std::uint32_t>();
+    if (index >= this->expressions.size() || !this->expressions[index]) {
+        this->failed = true;
+        return nullptr;
+    }
+    return this->expressions[index];
+}
+
+triton::engines::symbolic::PathConstraint SessionReader::path_constraint(void) {
+    triton::engines::symbolic::PathConstraint path_constraint;
+    std::uint32_t branches = this->value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < branches && !this->failed; i++) {
+        bool taken = this->value<std::uint8_t>() != 0;
+        triton::uint64 srcAddr = this->value<std::uint64_t>();
+        triton::uint64 dstAddr = this->value<std::uint64_t>();
+        auto constraint = this->node();
+        if (!this->failed)
+            path_constraint.addBranchConstraint(taken, srcAddr, dstAddr, constraint);
+    }
+    return path_constraint;
+}
+
+/* Only the counters, the rest belongs to the current process */
+void SessionReader::status(runtime_status_t& status) {
+    status.total_number_traced_ins = this->value<std::uint32_t>();
+    status.total_number_symbolic_ins = this->value<std::uint32_t>();
+    status.total_number_symbolic_conditions = this->value<std::uint32_t>();
+    status.total_number_fast_path_ins = this->value<std::uint32_t>();
+    status.tainted_functions_index = this->value<std::uint32_t>();
+}
+
+bool SessionReader::open(const char* path) {
+    std::ifstream session_file;
+    session_file.open(path, std::ios::in | std::ios::binary);
+    if (!session_file.is_open()) {
+        msg("[!] Session file %s not found\n", path);
+        return false;
+    }
+    std::ostringstream content;
+    content << session_file.rdbuf();
+    this->data.str(content.str());
+
+    char magic[sizeof(session_magic)] = {};
+    this->data.read(magic, sizeof(magic));
+    std::uint32_t version = this->value<std::uint32_t>();
+    std::uint32_t arch = this->value<std::uint32_t>();
+    std::uint64_t imagebase = this->value<std::uint64_t>();
+    if (this->failed || memcmp(magic, session_magic, sizeof(magic)) != 0 || version != session_version) {
+        msg("[!] %s is not a session saved by this version of Ponce\n", path);
+        return false;
+    }
+    if (arch != (std::uint32_t)tritonCtx.getArchitecture()) {
+        msg("[!] The session in %s was saved for another architecture\n", path);
+        return false;
+    }
+    //The addresses in the file would be wrong
+    if (imagebase != get_imagebase()) {
+        msg("[!] The session was saved with the binary loaded at %#" PRIx64 " and now it is at " MEM_FORMAT ", disable ASLR to load it\n", imagebase, get_imagebase());
+        return false;
+    }
+    return true;
+}
+
+bool SessionReader::rebuild(void) {
+    /* 1 - The symbolic variables, symbolizing again what they came from */
+    std::uint32_t variables_count = this->value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < variables_count && !this->failed; i++) {
+        triton::usize id = (triton::usize)this->value<std::uint64_t>();
+        auto type = (triton::engines::symbolic::variable_e)this->value<std::uint8_t>();
+        std::uint64_t origin = this->value<std::uint64_t>();
+        std::uint32_t size = this->value<std::uint32_t>();
+        std::string alias = this->string();
+        std::string comment = this->string();
+        triton::uint512 concrete_value = this->integer();
+        if (this->failed)
+            break;
+
+        triton::engines::symbolic::SharedSymbolicVariable variable;
+        if (type == triton::engines::symbolic::variable_e::MEMORY_VARIABLE)
+            variable = tritonCtx.symbolizeMemory(triton::arch::MemoryAccess(origin, size / 8), alias);
+        else if (type == triton::engines::symbolic::variable_e::REGISTER_VARIABLE)
+            variable = tritonCtx.symbolizeRegister(tritonCtx.getRegister((triton::arch::register_e)origin), alias);
+        else
+            variable = tritonCtx.newSymbolicVariable(size, alias);
+        variable->setComment(comment);
+        tritonCtx.setConcreteVariableValue(variable, concrete_value);
+        this->variables[id] = variable;
+    }
+    //What the variables were assigned to comes later with the rest of the symbolic state
+    tritonCtx.concretizeAllRegister();
+    tritonCtx.concretizeAllMemory();
+
+    return !this->failed && this->read_objects();
+}
+
+bool SessionReader::read_objects(void) {
+    auto ast = tritonCtx.getAstContext();
+    std::uint32_t count = this->value<std::uint32_t>();
+    //Every object takes a byte at least, a corrupted count would allocate gigabytes
+    if (this->failed || count > bytes_left(this->data))
+        return false;
+    this->nodes.resize(count);
+    this->expressions.resize(count);
+
+    auto integer_of = [](const triton::ast::SharedAbstractNode& node) -> triton::uint512 {
+        return reinterpret_cast<triton::ast::IntegerNode*>(node.get())->getInteger();
+    };
+
+    for (std::uint32_t index = 0; index < count && !this->failed; index++) {
+        auto kind = this->value<std::uint8_t>();
+        if (kind == SESSION_EXPRESSION) {
+            auto node = this->node();
+            std::string comment = this->string();
+            if (!this->failed)
+                this->expressions[index] = tritonCtx.newSymbolicExpression(node, comment);
+            continue;
+        }
+        if (kind != SESSION_NODE) {
+            this->failed = true;
+            break;
+        }
+
+        auto type = (triton::ast::ast_e)this->value<std::uint8_t>();
+        triton::ast::SharedAbstractNode node;
+        switch (type) {
+        case triton::ast::INTEGER_NODE:
+            node = ast->integer(this->integer());
+            break;
+        case triton::ast::VARIABLE_NODE: {
+            auto it = this->variables.find((triton::usize)this->value<std::uint64_t>());
+            if (it == this->variables.end()) {
+                this->failed = true;
+                break;
+            }
+            node = ast->variable(it->second);
+            break;
+        }
+        case triton::ast::REFERENCE_NODE: {
+            auto expression = this->expression();
+            if (!this->failed)
+                node = ast->reference(expression);
+            break;
+        }
+        case triton::ast::STRING_NODE:
+            node = ast->string(this->string());
+            break;
+        default: {
+            std::uint32_t children_count = this->value<std::uint32_t>();
+            std::vector<triton::ast::SharedAbstractNode> c;
+            for (std::uint32_t i = 0; i < children_count && !this->failed; i++)
+                c.push_back(this->node());
+            if (this->failed)
+                break;
+
+            //The number and the kind of the children are checked by the nodes, they throw if they are wrong
+            try {
+                switch (type) {
+                case triton::ast::BSWAP_NODE:    node = ast->bswap(c.at(0)); break;
+                case triton::ast::BVNEG_NODE:    node = ast->bvneg(c.at(0)); break;
+                case triton::ast::BVNOT_NODE:    node = ast->bvnot(c.at(0)); break;
+                case triton::ast::LNOT_NODE:     node = ast->lnot(c.at(0)); break;
+                case triton::ast::BVADD_NODE:    node = ast->bvadd(c.at(0), c.at(1)); break;
+                case triton::ast::BVAND_NODE:    node = ast->bvand(c.at(0), c.at(1)); break;
+                case triton::ast::BVASHR_NODE:   node = ast->bvashr(c.at(0), c.at(1)); break;
+                case triton::ast::BVLSHR_NODE:   node = ast->bvlshr(c.at(0), c.at(1)); break;
+                case triton::ast::BVMUL_NODE:    node = ast->bvmul(c.at(0), c.at(1)); break;
+                case triton::ast::BVNAND_NODE:   node = ast->bvnand(c.at(0), c.at(1)); break;
+                case triton::ast::BVNOR_NODE:    node = ast->bvnor(c.at(0), c.at(1)); break;
+                case triton::ast::BVOR_NODE:     node = ast->bvor(c.at(0), c.at(1)); break;
+                case triton::ast::BVSDIV_NODE:   node = ast->bvsdiv(c.at(0), c.at(1)); break;
+                case triton::ast::BVSGE_NODE:    node = ast->bvsge(c.at(0), c.at(1)); break;
+                case triton::ast::BVSGT_NODE:    node = ast->bvsgt(c.at(0), c.at(1)); break;
+                case triton::ast::BVSHL_NODE:    node = ast->bvshl(c.at(0), c.at(1)); break;
+                case triton::ast::BVSLE_NODE:    node = ast->bvsle(c.at(0), c.at(1)); break;
+                case triton::ast::BVSLT_NODE:    node = ast->bvslt(c.at(0), c.at(1)); break;
+                case triton::ast::BVSMOD_NODE:   node = ast->bvsmod(c.at(0), c.at(1)); break;
+                case triton::ast::BVSREM_NODE:   node = ast->bvsrem(c.at(0), c.at(1)); break;
+                case triton::ast::BVSUB_NODE:    node = ast->bvsub(c.at(0), c.at(1)); break;
+                case triton::ast::BVUDIV_NODE:   node = ast->bvudiv(c.at(0), c.at(1)); break;
+                case triton::ast::BVUGE_NODE:    node = ast->bvuge(c.at(0), c.at(1)); break;
+                case triton::ast::BVUGT_NODE:    node = ast->bvugt(c.at(0), c.at(1)); break;
+                case triton::ast::BVULE_NODE:    node = ast->bvule(c.at(0), c.at(1)); break;
+                case triton::ast::BVULT_NODE:    node = ast->bvult(c.at(0), c.at(1)); break;
+                case triton::ast::BVUREM_NODE:   node = ast->bvurem(c.at(0), c.at(1)); break;
+                case triton::ast::BVXNOR_NODE:   node = ast->bvxnor(c.at(0), c.at(1)); break;
+                case triton::ast::BVXOR_NODE:    node = ast->bvxor(c.at(0), c.at(1)); break;
+                case triton::ast::DISTINCT_NODE: node = ast->distinct(c.at(0), c.at(1)); break;
+                case triton::ast::EQUAL_NODE:    node = ast->equal(c.at(0), c.at(1)); break;
+                case triton::ast::IFF_NODE:      node = ast->iff(c.at(0), c.at(1)); break;
+                case triton::ast::ITE_NODE:      node = ast->ite(c.at(0), c.at(1), c.at(2)); break;
+                case triton::ast::CONCAT_NODE:   node = ast->concat(c); break;
+                case triton::ast::LAND_NODE:     node = ast->land(c); break;
+                case triton::ast::LOR_NODE:      node = ast->lor(c); break;
+                case triton::ast::LXOR_NODE:
+                    node = c.at(0);
+                    for (size_t i = 1; i < c.size(); i++)
+                        node = ast->lxor(node, c[i]);
+                    break;
+                //The sizes and the positions are integer children
+                case triton::ast::BVROL_NODE:    node = ast->bvrol(c.at(0), (triton::uint32)integer_of(c.at(1))); break;
+                case triton::ast::BVROR_NODE:    node = ast->bvror(c.at(0), (triton::uint32)integer_of(c.at(1))); break;
+                case triton::ast::BV_NODE:       node = ast->bv(integer_of(c.at(0)), (triton::uint32)integer_of(c.at(1))); break;
+                case triton::ast::EXTRACT_NODE:  node = ast->extract((triton::uint32)integer_of(c.at(0)), (triton::uint32)integer_of(c.at(1)), c.at(2)); break;
+                case triton::ast::SX_NODE:       node = ast->sx((triton::uint32)integer_of(c.at(0)), c.at(1)); break;
+                case triton::ast::ZX_NODE:       node = ast->zx((triton::uint32)integer_of(c.at(0)), c.at(1)); break;
+                default:
+                    this->failed = true;
+                    break;
+                }
+            }
+            catch (const std::exception&) {
+                this->failed = true;
+            }
+            break;
+        }
+        }
+        if (!node)
+            this->failed = true;
+        this->nodes[index] = node;
+    }
+    return !this->failed;
+}
+
+/* The whole symbolic and taint state, the snapshots only keep what changed after them */
+static void save_engines(SessionWriter& writer)
+{
+    const auto& path_constraints = tritonCtx.getPathConstraints();
+    writer.value<std::uint32_t>((std::uint32_t)path_constraints.size());
+    for (const auto& path_constraint : path_constraints)
+        writer.path_constraint(path_constraint);
+
+    const auto& symbolic_registers = tritonCtx.getSymbolicRegisters();
+    writer.value<std::uint32_t>((std::uint32_t)symbolic_registers.size());
+    for (const auto& [reg_id, expression] : symbolic_registers) {
+        writer.value<std::uint32_t>((std::uint32_t)reg_id);
+        writer.expression(expression);
+    }
+    const auto& symbolic_memory = tritonCtx.getSymbolicMemory();
+    writer.value<std::uint32_t>((std::uint32_t)symbolic_memory.size());
+    for (const auto& [address, expression] : symbolic_memory) {
+        writer.value<std::uint64_t>(address);
+        writer.expression(expression);
+    }
+
+    const auto& tainted_registers = tritonCtx.getTaintedRegisters();
+    writer.value<std::uint32_t>((std::uint32_t)tainted_registers.size());
+    for (const auto& reg : tainted_registers)
+        writer.value<std::uint32_t>((std::uint32_t)reg->getId());
+    const auto& tainted_memory = tritonCtx.getTaintedMemory();
+    writer.value<std::uint32_t>((std::uint32_t)tainted_memory.size());
+    for (const auto& address : tainted_memory)
+        writer.value<std::uint64_t>(address);
+}
+
+//The symbolic and taint state read from a session, it is put in the engines once the whole file was read
+struct session_engines {
+    std::vector<triton::engines::symbolic::PathConstraint> path_constraints;
+    std::map<triton::arch::register_e, triton::engines::symbolic::SharedSymbolicExpression> symbolic_registers;
+    std::map<triton::uint64, triton::engines::symbolic::SharedSymbolicExpression> symbolic_memory;
+    std::vector<triton::arch::register_e> tainted_registers;
+    std::vector<triton::uint64> tainted_memory;
+};
+
+/* Reads the state written by save_engines */
+static bool read_engines(SessionReader& reader, session_engines& engines)
+{
+    std::uint32_t count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++)
+        engines.path_constraints.push_back(reader.path_constraint());
+
+    count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++) {
+        auto reg_id = (triton::arch::register_e)reader.value<std::uint32_t>();
+        engines.symbolic_registers[reg_id] = reader.expression();
+    }
+    count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++) {
+        triton::uint64 address = reader.value<std::uint64_t>();
+        engines.symbolic_memory[address] = reader.expression();
+    }
+
+    count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++)
+        engines.tainted_registers.push_back((triton::arch::register_e)reader.value<std::uint32_t>());
+    count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++)
+        engines.tainted_memory.push_back(reader.value<std::uint64_t>());
+    return reader.ok();
+}
+
+/* Puts the state read in the engines, they must be reset before */
+static void apply_engines(const session_engines& engines)
+{
+    for (const auto& path_constraint : engines.path_constraints)
+        tritonCtx.pushPathConstraint(path_constraint);
+    for (const auto& [reg_id, expression] : engines.symbolic_registers)
+        tritonCtx.assignSymbolicExpressionToRegister(expression, tritonCtx.getRegister(reg_id));
+    for (const auto& [address, expression] : engines.symbolic_memory)
+        tritonCtx.assignSymbolicExpressionToMemory(expression, triton::arch::MemoryAccess(address, 1));
+    for (const auto& reg_id : engines.tainted_registers)
+        tritonCtx.taintRegister(tritonCtx.getRegister(reg_id));
+    for (const auto& address : engines.tainted_memory)
+        tritonCtx.taintMemory(address);
+}
+
+bool save_session(const char* path)
+{
+    if (!is_debugger_on() || get_process_state() != DSTATE_SUSP) {
+        msg("[!] The process must be suspended to save the session\n");
+        return false;
+    }
+
+    SessionWriter writer;
+
+    /* 1 - The pages written while tracing and the ones with tainted/symbolic bytes, most of the memory is the same in every run */
+    std::set<ea_t> pages = written_pages;
+    for (const auto& [address, expression] : tritonCtx.getSymbolicMemory())
+        pages.insert(PAGE_BASE((ea_t)address));
+    for (const auto& address : tritonCtx.getTaintedMemory())
+        pages.insert(PAGE_BASE((ea_t)address));
+
+    std::vector<std::pair<ea_t, std::vector<std::uint8_t>>> contents;
+    unsigned int unreadable = 0;
+    for (const auto& page_base : pages) {
+        std::vector<std::uint8_t> content(PONCE_PAGE_SIZE);
+        //Freed in the meantime
+        if (!memory_cache.read(page_base, content.data(), PONCE_PAGE_SIZE)) {
+            unreadable++;
+            continue;
+        }
+        contents.emplace_back(page_base, std::move(content));
+    }
+    writer.value<std::uint32_t>((std::uint32_t)contents.size());
+    for (const auto& [page_base, content] : contents) {
+        writer.value<std::uint64_t>(page_base);
+        writer.bytes(content.data(), content.size());
+    }
+
+    /* 2 - The current state, the engines and then the registers and the counters like a snapshot */
+    save_engines(writer);
+    Snapshot state;
+    state.takeSnapshot();
+    state.address = current_instruction();
+    state.save(writer);
+
+    /* 3 - The snapshot tree */
+    snapshot_manager.save(writer);
+
+    /* 4 - The comments and colors, so they can be cleaned after loading the session */
+    writer.value<std::uint32_t>((std::uint32_t)ponce_comments.size());
+    for (const auto& [address, insinfo] : ponce_comments) {
+        writer.value<std::uint64_t>(address);
+        writer.string(insinfo.comment);
+        writer.value<std::uint32_t>((std::uint32_t)insinfo.color);
+        writer.value<std::uint32_t>(insinfo.hits);
+    }
+
+    if (!writer.save(path))
+        return false;
+    msg("[+] Session saved in %s: %u pages, %u path constraints, %u symbolic variables\n", path, (unsigned int)contents.size(),
+        (unsigned int)tritonCtx.getPathConstraints().size(), (unsigned int)tritonCtx.getSymbolicVariables().size());
+    if (unreadable > 0)
+        msg("[!] %u pages written while tracing couldn't be read, they are not in the session\n", unreadable);
+    return true;
+}
+
+bool load_session(const char* path)
+{
+    if (!is_debugger_on() || get_process_state() != DSTATE_SUSP) {
+        msg("[!] The process must be suspended to load a session\n");
+        return false;
+    }
+
+    SessionReader reader;
+    if (!reader.open(path))
+        return false;
+
+    /*The expressions of the file are created in the engines, so what Ponce knew about the process is replaced here.
+    The rest of the file is read before the debuggee, the snapshots and the IDB are touched*/
+    snapshot_manager.resetEngine();
+    triton_restart_engines();
+    if (!reader.rebuild()) {
+        msg("[!] The session file %s is corrupted\n", path);
+        triton_restart_engines();
+        return false;
+    }
+
+    /* 1 - The memory */
+    std::vector<std::pair<ea_t, std::vector<std::uint8_t>>> pages;
+    std::uint32_t pages_count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < pages_count && reader.ok(); i++) {
+        ea_t page_base = (ea_t)reader.value<std::uint64_t>();
+        std::vector<std::uint8_t> content(PONCE_PAGE_SIZE);
+        if (!reader.bytes(content.data(), content.size()))
+            break;
+        pages.emplace_back(page_base, std::move(content));
+    }
+
+    /* 2 - The engines, the registers and the counters */
+    session_engines engines;
+    Snapshot state;
+    bool state_read = reader.ok() && read_engines(reader, engines) && state.load(reader);
+
+    /* 3 - The snapshot tree */
+    SnapshotManager snapshots;
+    bool snapshots_read = state_read && snapshots.load(reader);
+
+    /* 4 - The comments and colors, the snapshot ones are written by the snapshot manager */
+    std::vector<std::pair<ea_t, instruction_info>> comments;
+    std::uint32_t comments_count = snapshots_read ? reader.value<std::uint32_t>() : 0;
+    for (std::uint32_t i = 0; i < comments_count && reader.ok(); i++) {
+        ea_t address = (ea_t)reader.value<std::uint64_t>();
+        instruction_info insinfo;
+        insinfo.comment = reader.string();
+        insinfo.color = (bgcolor_t)reader.value<std::uint32_t>();
+        insinfo.hits = reader.value<std::uint32_t>();
+        comments.emplace_back(address, insinfo);
+    }
+
+    if (!snapshots_read || !reader.ok()) {
+        msg("[!] The session file %s is corrupted\n", path);
+        triton_restart_engines();
+        return false;
+    }
+
+    /* Everything was read, now the process and the IDB get it. The pages that are not mapped yet in this process are lost */
+    start_tainting_or_symbolic_analysis();
+    unsigned int unmapped = 0;
+    for (const auto& [page_base, content] : pages) {
+        if (write_dbg_memory(page_base, content.data(), content.size()) != (ssize_t)content.size())
+            unmapped++;
+        invalidate_dbgmem_contents(page_base, content.size());
+        instruction_cache.invalidate(page_base, content.size());
+    }
+    memory_cache.clear();
+
+    apply_engines(engines);
+    state.restoreSnapshot();
+    snapshot_manager = std::move(snapshots);
+
+    for (const auto& [address, insinfo] : comments) {
+        if (!insinfo.comment.empty())
+            ponce_add_cmt_hits(address, insinfo.comment.c_str(), false, insinfo.hits);
+        if (insinfo.color != DEFCOLOR)
+            ponce_set_item_color(address, insinfo.color);
+    }
+
+    ponce_runtime_status.analyzed_thread = get_current_thread();
+    shadow_state.invalidate();
+    snapshot_manager.showComments();
+    refresh_snapshot_chooser();
+
+    msg("[+] Session loaded from %s: %u pages, %u path constraints, %u symbolic variables\n", path, pages_count,
+        (unsigned int)tritonCtx.getPathConstraints().size(), (unsigned int)tritonCtx.getSymbolicVariables().size());
+    if (unmapped > 0)
+        msg("[!] %u pages are not mapped in this process, continue until they are allocated and load the session again\n", unmapped);
+    return true;
+}
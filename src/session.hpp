@@ -0,0 +1,140 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//IDA
+#include <pro.h>
+
+//Triton
+#include <triton/context.hpp>
+#include <triton/ast.hpp>
+
+//Ponce
+#include "runtime_status.hpp"
+#include "serialization.hpp"
+
+//! \class SessionWriter
+//! \brief Builds a session file. The AST nodes and the symbolic expressions are written once in a table, in the order
+//! they depend on each other, and the rest of the file refers to them by their index.
+class SessionWriter {
+
+private:
+    //! Nodes and expressions already in the table.
+    std::unordered_map<const void*, std::uint32_t> indexes;
+
+    //! Table of nodes and expressions.
+    std::ostringstream objects;
+    std::uint32_t objects_count;
+
+    //! Everything else.
+    std::ostringstream data;
+
+    //! Set if a node can't be written, the session is not saved.
+    std::string error;
+
+    //! Adds the node to the table, and what it refers to before it. Returns its index.
+    std::uint32_t add_object(const triton::ast::SharedAbstractNode& node, const triton::engines::symbolic::SharedSymbolicExpression& expression);
+
+public:
+    //! Constructor.
+    SessionWriter();
+
+    template <typename T>
+    void value(T v) {
+        write_value(this->data, v);
+    }
+    void string(const std::string& s);
+    void bytes(const std::uint8_t* buffer, size_t size);
+    void integer(const triton::uint512& v);
+
+    //! Writes the index of a node or an expression in the table.
+    void node(const triton::ast::SharedAbstractNode& node);
+    void expression(const triton::engines::symbolic::SharedSymbolicExpression& expression);
+
+    //! A path constraint with its branches.
+    void path_constraint(const triton::engines::symbolic::PathConstraint& path_constraint);
+
+    //! The Ponce counters kept in the snapshots.
+    void status(const runtime_status_t& status);
+
+    //! Writes the header, the symbolic variables, the table and the data. Returns false if anything couldn't be written.
+    bool save(const char* path);
+};
+
+//! \class SessionReader
+//! \brief Reads a session file written by SessionWriter and rebuilds its nodes, expressions and variables in the engine.
+class SessionReader {
+
+private:
+    std::istringstream data;
+
+    //! Nodes and expressions of the table.
+    std::vector<triton::ast::SharedAbstractNode> nodes;
+    std::vector<triton::engines::symbolic::SharedSymbolicExpression> expressions;
+
+    //! Variables recreated, indexed by the id they had.
+    std::unordered_map<triton::usize, triton::engines::symbolic::SharedSymbolicVariable> variables;
+
+    //! Set when the file is truncated or refers to something that doesn't exist.
+    bool failed;
+
+    //! Reads and rebuilds the table.
+    bool read_objects(void);
+
+public:
+    //! Constructor.
+    SessionReader();
+
+    //! Reads the file and checks it belongs to this binary. Nothing is changed if it returns false.
+    bool open(const char* path);
+
+    //! Creates the symbolic variables and the table in the engine, it must be reset before.
+    bool rebuild(void);
+
+    template <typename T>
+    T value(void) {
+        T v{};
+        if (!read_value(this->data, v))
+            this->failed = true;
+        return v;
+    }
+    std::string string(void);
+    bool bytes(std::uint8_t* buffer, size_t size);
+    triton::uint512 integer(void);
+    triton::ast::SharedAbstractNode node(void);
+    triton::engines::symbolic::SharedSymbolicExpression expression(void);
+    triton::engines::symbolic::PathConstraint path_constraint(void);
+    void status(runtime_status_t& status);
+
+    //! Tells if everything read so far was right.
+    bool ok(void) const;
+};
+
+//! Remembers the pages written while tracing, their content is saved with the session.
+void session_record_store(ea_t address, size_t size);
+
+//! Forgets the pages written, the process is not the same anymore.
+void session_reset(void);
+
+//! Path of the session file by default, next to the IDB.
+qstring default_session_path(void);
+
+//! Saves the engines, the pages written, the registers, the snapshots and the comments of Ponce.
+bool save_session(const char* path);
+
+//! Loads a session saved for this binary and goes on tracing from where it was saved.
+bool load_session(const char* path);
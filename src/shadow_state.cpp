@@ -0,0 +1,221 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <algorithm>
+
+//Ponce
+#include "shadow_state.hpp"
+#include "context.hpp"
+
+//Triton
+#include <triton/x86Specifications.hpp>
+
+#define PAGE_BASE(address) ((address) & ~(ea_t)(PONCE_PAGE_SIZE - 1))
+
+// Bytes around the stack pointer that push, pop, call, ret... may access without an explicit memory operand
+#define STACK_WINDOW 64
+
+ShadowState shadow_state;
+
+ShadowState::ShadowState() {
+    this->stale = true;
+}
+
+void ShadowState::invalidate(void) {
+    this->stale = true;
+}
+
+void ShadowState::clear(void) {
+    this->registers.reset();
+    this->memory.clear();
+    this->stale = true;
+}
+
+void ShadowState::refresh_registers(void) {
+    this->registers.reset();
+    for (const auto& [reg_id, expression] : tritonCtx.getSymbolicRegisters()) {
+        if (expression != nullptr && expression->isSymbolized())
+            this->registers.set(tritonCtx.getRegister(reg_id).getParent());
+    }
+    for (const auto* reg : tritonCtx.getTaintedRegisters()) {
+        this->registers.set(reg->getParent());
+    }
+}
+
+void ShadowState::refresh_if_stale(void) {
+    if (!this->stale)
+        return;
+
+    this->refresh_registers();
+    this->memory.clear();
+    for (const auto& [address, expression] : tritonCtx.getSymbolicMemory()) {
+        if (expression != nullptr && expression->isSymbolized())
+            this->mark_memory((ea_t)address, true);
+    }
+    for (const auto& address : tritonCtx.getTaintedMemory()) {
+        this->mark_memory((ea_t)address, true);
+    }
+    this->stale = false;
+}
+
+void ShadowState::mark_memory(ea_t address, bool dirty) {
+    ea_t page = PAGE_BASE(address);
+    if (dirty) {
+        this->memory[page].set(address - page);
+    }
+    else {
+        auto it = this->memory.find(page);
+        if (it == this->memory.end())
+            return;
+        it->second.reset(address - page);
+        if (it->second.none())
+            this->memory.erase(it);
+    }
+}
+
+bool ShadowState::is_memory_dirty(ea_t address, size_t size) const {
+    if (this->memory.empty())
+        return false;
+    for (ea_t ea = address; ea < address + size; ea++) {
+        ea_t page = PAGE_BASE(ea);
+        auto it = this->memory.find(page);
+        if (it == this->memory.end()) {
+            //Nothing dirty in this page, jump to the next one
+            ea = page + PONCE_PAGE_SIZE - 1;
+            continue;
+        }
+        if (it->second.test(ea - page))
+            return true;
+    }
+    return false;
+}
+
+bool ShadowState::registers_clean(void) {
+    this->refresh_if_stale();
+    return this->registers.none();
+}
+
+const std::bitset<triton::arch::ID_REG_LAST_ITEM>& ShadowState::dirty_registers(void) {
+    this->refresh_if_stale();
+    return this->registers;
+}
+
+bool ShadowState::is_clean(const triton::arch::Instruction& instruction, std::vector<std::pair<ea_t, size_t>>& accesses) {
+    if (!this->registers_clean())
+        return false;
+
+    if (tritonCtx.getArchitecture() == triton::arch::ARCH_X86 || tritonCtx.getArchitecture() == triton::arch::ARCH_X86_64) {
+        //A rep prefix accesses as many bytes as rcx says, we let Triton do it
+        auto prefix = instruction.getPrefix();
+        if (prefix == triton::arch::x86::ID_PREFIX_REP || prefix == triton::arch::x86::ID_PREFIX_REPE || prefix == triton::arch::x86::ID_PREFIX_REPNE)
+            return false;
+    }
+
+    if (!this->possible_accesses(instruction, accesses))
+        return false;
+
+    for (const auto& [address, size] : accesses) {
+        if (this->is_memory_dirty(address, size))
+            return false;
+    }
+    return true;
+}
+
+bool ShadowState::possible_accesses(const triton::arch::Instruction& instruction, std::vector<std::pair<ea_t, size_t>>& accesses) {
+    const triton::arch::Register* stack_pointer = nullptr;
+    switch (tritonCtx.getArchitecture()) {
+    case triton::arch::ARCH_X86_64:
+        stack_pointer = &tritonCtx.registers.x86_rsp;
+        break;
+    case triton::arch::ARCH_X86:
+        stack_pointer = &tritonCtx.registers.x86_esp;
+        break;
+    case triton::arch::ARCH_AARCH64:
+        stack_pointer = &tritonCtx.registers.aarch64_sp;
+        break;
+    case triton::arch::ARCH_ARM32:
+        stack_pointer = &tritonCtx.registers.arm32_sp;
+        break;
+    default:
+        return false;
+    }
+
+    //The explicit memory operands. We compute their address with the concrete registers
+    for (const auto& operand : instruction.operands) {
+        if (operand.getType() != triton::arch::OP_MEM)
+            continue;
+        triton::arch::MemoryAccess mem = operand.getConstMemory();
+        tritonCtx.getSymbolicEngine()->initLeaAst(mem);
+        accesses.emplace_back((ea_t)mem.getAddress(), mem.getSize());
+    }
+
+    //The implicit stack accesses
+    ea_t sp = (ea_t)IDA_getCurrentRegisterValue(*stack_pointer);
+    accesses.emplace_back(sp - STACK_WINDOW, 2 * STACK_WINDOW);
+    //leave reads the saved frame pointer where the frame pointer points to
+    if (instruction.getType() == triton::arch::x86::ID_INS_LEAVE &&
+        (tritonCtx.getArchitecture() == triton::arch::ARCH_X86 || tritonCtx.getArchitecture() == triton::arch::ARCH_X86_64)) {
+        const triton::arch::Register& frame_pointer = tritonCtx.getArchitecture() == triton::arch::ARCH_X86_64 ? tritonCtx.registers.x86_rbp : tritonCtx.registers.x86_ebp;
+        accesses.emplace_back((ea_t)IDA_getCurrentRegisterValue(frame_pointer), 2 * frame_pointer.getSize());
+    }
+    return true;
+}
+
+bool ShadowState::is_dirty(ea_t address, size_t size) {
+    this->refresh_if_stale();
+    return this->is_memory_dirty(address, size);
+}
+
+bool ShadowState::dirty_ranges(std::vector<std::pair<ea_t, size_t>>& ranges, size_t max_gap, size_t max_ranges) {
+    this->refresh_if_stale();
+
+    std::vector<ea_t> pages;
+    pages.reserve(this->memory.size());
+    for (const auto& [page, bitmap] : this->memory)
+        pages.push_back(page);
+    std::sort(pages.begin(), pages.end());
+
+    for (const auto& page : pages) {
+        const auto& bitmap = this->memory[page];
+        for (size_t i = 0; i < PONCE_PAGE_SIZE; i++) {
+            if (!bitmap.test(i))
+                continue;
+            ea_t address = page + i;
+            if (!ranges.empty() && address - (ranges.back().first + ranges.back().second) <= max_gap) {
+                ranges.back().second = address - ranges.back().first + 1;
+            }
+            else {
+                if (ranges.size() == max_ranges)
+                    return false;
+                ranges.emplace_back(address, 1);
+            }
+        }
+    }
+    return true;
+}
+
+void ShadowState::update(const triton::arch::Instruction& instruction) {
+    if (this->stale) {
+        this->refresh_if_stale();
+        return;
+    }
+
+    //Only the registers the instruction wrote can have changed
+    for (const auto& [reg, node] : instruction.getWrittenRegisters()) {
+        const triton::arch::Register& parent = tritonCtx.getParentRegister(reg);
+        this->registers.set(parent.getId(), tritonCtx.isRegisterSymbolized(parent) || tritonCtx.isRegisterTainted(parent));
+    }
+    for (const auto& [memory_access, node] : instruction.getStoreAccess()) {
+        for (triton::uint32 i = 0; i < memory_access.getSize(); i++) {
+            triton::uint64 address = memory_access.getAddress() + i;
+            this->mark_memory((ea_t)address, tritonCtx.isMemorySymbolized(address) || tritonCtx.isMemoryTainted(address));
+        }
+    }
+}
@@ -0,0 +1,85 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <bitset>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+
+//Triton
+#include <triton/context.hpp>
+
+//Ponce
+#include "globals.hpp"
+
+//! \class ShadowState
+//! \brief Cheap copy of which registers and memory bytes are tainted or symbolic, used to skip the semantics of clean instructions.
+class ShadowState {
+
+private:
+    //! Parent registers holding a tainted or symbolic value.
+    std::bitset<triton::arch::ID_REG_LAST_ITEM> registers;
+
+    //! Tainted or symbolic bytes, one bitmap per page.
+    std::unordered_map<ea_t, std::bitset<PONCE_PAGE_SIZE>> memory;
+
+    //! Set when the Triton state was modified outside tritonize() and the shadow needs to be rebuilt.
+    bool stale;
+
+    //! Rebuilds the register mask from the engines.
+    void refresh_registers(void);
+
+    //! Rebuilds everything from the engines if needed.
+    void refresh_if_stale(void);
+
+    //! Marks or clears a byte in the memory bitmap.
+    void mark_memory(ea_t address, bool dirty);
+
+    //! Returns true if any byte in [address, address + size) is tainted or symbolic.
+    bool is_memory_dirty(ea_t address, size_t size) const;
+
+public:
+    //! Constructor.
+    ShadowState();
+
+    //! The engines were modified by other means (user actions, concretizations, snapshots...).
+    void invalidate(void);
+
+    //! Returns true if no register is tainted or symbolic.
+    bool registers_clean(void);
+
+    //! Parent registers holding a tainted or symbolic value.
+    const std::bitset<triton::arch::ID_REG_LAST_ITEM>& dirty_registers(void);
+
+    /*! Returns true if the already disassembled instruction can't touch tainted or symbolic state.
+    In that case accesses is filled with the memory ranges it may write. */
+    bool is_clean(const triton::arch::Instruction& instruction, std::vector<std::pair<ea_t, size_t>>& accesses);
+
+    /*! Fills accesses with the memory the already disassembled instruction may read or write: its memory operands and
+    the stack around the stack pointer. Returns false if the architecture is not supported. */
+    bool possible_accesses(const triton::arch::Instruction& instruction, std::vector<std::pair<ea_t, size_t>>& accesses);
+
+    //! Returns true if any byte in [address, address + size) is tainted or symbolic.
+    bool is_dirty(ea_t address, size_t size);
+
+    /*! Fills ranges with the tainted or symbolic memory, sorted by address. Ranges closer than max_gap bytes are merged.
+    Returns false if there are more than max_ranges ranges. */
+    bool dirty_ranges(std::vector<std::pair<ea_t, size_t>>& ranges, size_t max_gap, size_t max_ranges);
+
+    //! Updates the shadow with the result of an instruction processed by Triton.
+    void update(const triton::arch::Instruction& instruction);
+
+    //! Forgets everything.
+    void clear(void);
+};
+
+extern ShadowState shadow_state;
@@ -6,191 +6,149 @@
 */
 
 #include <iostream>
+#include <set>
+#include <tuple>
 
 #include "snapshot.hpp"
 #include "globals.hpp"
 #include "utils.hpp"
+#include "context.hpp"
+#include "shadow_state.hpp"
+#include "session.hpp"
 
 #include "dbg.hpp"
 
 Snapshot::Snapshot() {
-    this->locked = true;
-    this->snapshotTaintEngine = nullptr;
-    this->snapshotSymEngine = nullptr;
-    this->mustBeRestore = false;
-    this->snapshotTaken = false;
-}
-
-
-Snapshot::~Snapshot() {
-}
-
-/* Check if the snapshot has been taken */
-bool Snapshot::exists(void) {
-    return this->snapshotTaken;
-}
-
-/* Add the modification byte. */
-void Snapshot::addModification(ea_t mem, char byte) {
-    if (this->locked == false && this->memory.find(mem) == this->memory.end())
-        this->memory[mem] = byte;
+    this->id = 0;
+    this->parent = 0;
+    this->address = 0;
+    this->automatic = false;
+    this->forkPid = 0;
+    this->parentUntracedSpans = 0;
 }
 
 
-/* Enable the snapshot engine. */
+/* Save the registers and the Ponce status. The engines and the memory are journaled by the SnapshotManager */
 void Snapshot::takeSnapshot() {
-    this->snapshotTaken = true;
-
-    /* 1 - Unlock the engine */
-    this->locked = false;
-
-    /* 2 - Save current symbolic engine state */
-    this->snapshotSymEngine = new triton::engines::symbolic::SymbolicEngine(*tritonCtx.getSymbolicEngine());
-
-    /* 3 - Save current taint engine state */
-    this->snapshotTaintEngine = new triton::engines::taint::TaintEngine(*tritonCtx.getTaintEngine());
-
-    /* 4 - Save current set of nodes */
-    this->astCtx = new triton::ast::AstContext(*tritonCtx.getAstContext());
-    //this->nodesList = tritonCtx.getAllocatedAstNodes();
-
-    /* 5 - Save the Triton CPU state. It depens on the analyzed binary*/   
-    switch (tritonCtx.getArchitecture()) {
-    case triton::arch::ARCH_X86_64:
-        this->cpu_x8664 = new triton::arch::x86::x8664Cpu(*dynamic_cast<triton::arch::x86::x8664Cpu*>(tritonCtx.getCpuInstance()));
-        break;
-    case triton::arch::ARCH_X86:
-        this->cpu_x86 = new triton::arch::x86::x86Cpu(*reinterpret_cast<triton::arch::x86::x86Cpu*>(tritonCtx.getCpuInstance()));
-        break;
-    case triton::arch::ARCH_AARCH64:
-        this->cpu_AArch64 = new triton::arch::arm::aarch64::AArch64Cpu(*reinterpret_cast<triton::arch::arm::aarch64::AArch64Cpu*>(tritonCtx.getCpuInstance()));
-        break;
-    case triton::arch::ARCH_ARM32:
-        this->cpu_Arm32 = new triton::arch::arm::arm32::Arm32Cpu(*reinterpret_cast<triton::arch::arm::arm32::Arm32Cpu*>(tritonCtx.getCpuInstance()));
-        break;
-    default:
-        throw triton::exceptions::Architecture("Architecture not supported.");
-        break;
-    }
+    /* 1 - The Triton CPU doesn't need to be saved, the concrete values are synchronized with IDA when they are read */
 
-    /* 6 - Save IDA registers context */
-    auto regs = tritonCtx.getAllRegisters();
-    for (auto it = regs.begin(); it != regs.end(); it++)
-    {
-        const triton::arch::Register reg = (*it).second;
-        uint64 ival;
-        if (get_reg_val(reg.getName().c_str(), &ival)) {
-            this->IDAContext[reg.getName()] = ival;
-        }
-    }
+    /* 2 - Save IDA registers context */
+    this->IDAContext.clear();
+    IDA_readRegisterFile(this->IDAContext);
 
     //We also saved the ponce status
     this->saved_ponce_runtime_status = ponce_runtime_status;
-}
 
-void Snapshot::setAddress(ea_t address) {
-    this->address = address;
+    /* 3 - The instruction the engines stopped at, a checkpoint's is the branch to negate */
+    const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+    if (last_instruction != nullptr)
+        this->lastInstruction = *last_instruction;
+    else
+        this->lastInstruction.reset();
 }
 
 
 /* Restore the snapshot. */
 void Snapshot::restoreSnapshot() {
-
-    /* 1 - Restore all memory modification. */
-    for (auto i = this->memory.begin(); i != this->memory.end(); ++i) {
-        put_bytes(i->first, &i->second, 1);
-    }
-    this->memory.clear();
-
-    /* 2 - Restore current symbolic engine state */
-    *tritonCtx.getSymbolicEngine() = *this->snapshotSymEngine;
-
-    /* 3 - Restore current taint engine state */
-    *tritonCtx.getTaintEngine() = *this->snapshotTaintEngine;
-
-    /* 4 - Restore current AST context */
-    *tritonCtx.getAstContext() = *this->astCtx;
-
-    /* 5 - Restore the Triton CPU state */
-    switch (tritonCtx.getArchitecture()) {
-    case triton::arch::ARCH_X86_64:
-        *reinterpret_cast<triton::arch::x86::x8664Cpu*>(tritonCtx.getCpuInstance()) = *this->cpu_x8664;
-        break;
-    case triton::arch::ARCH_X86:
-        *reinterpret_cast<triton::arch::x86::x86Cpu*>(tritonCtx.getCpuInstance()) = *this->cpu_x86;
-        break;
-    case triton::arch::ARCH_AARCH64:
-        *reinterpret_cast<triton::arch::arm::aarch64::AArch64Cpu*>(tritonCtx.getCpuInstance()) = *this->cpu_AArch64;
-        break;
-    case triton::arch::ARCH_ARM32:
-        *reinterpret_cast<triton::arch::arm::arm32::Arm32Cpu*>(tritonCtx.getCpuInstance()) = *this->cpu_Arm32;
-        break;
-    default:
-        throw triton::exceptions::Architecture("Architecture not supported.");
-        break;
-    }
-
-    this->mustBeRestore = false;
-
-    /* 6 - Restore IDA registers context
+    /* 1 - Restore IDA registers context, only the registers that changed since the snapshot
     Suposedly XIP should be set at the same time and execution redirected*/
-    typedef std::map<std::string, triton::uint512>::iterator it_type;
-    for (it_type iterator = this->IDAContext.begin(); iterator != this->IDAContext.end(); iterator++) {
-        if (!set_reg_val(iterator->first.c_str(), static_cast<uint64>(iterator->second)))
-            msg("[!] ERROR restoring register %s\n", iterator->first.c_str());
-    }
+    unsigned int written = IDA_writeRegisterFile(this->IDAContext);
+    if (cmdOptions.showDebugInfo)
+        msg("[+] %u of %u registers restored\n", written, (unsigned int)this->IDAContext.size());
 
-    /* 7 - Restore the Ponce status */
+    /* 2 - Restore the Ponce status */
     ponce_runtime_status = this->saved_ponce_runtime_status;
 
-    /* 8 - We need to set to NULL the last instruction. We are deleting the last instructions in the Tritonize callback.
-    So after restore a snapshot if last_instruction is not NULL is double freeing the same instruction */
-    ponce_runtime_status.last_triton_instruction = nullptr;
-}
-
-/* Disable the snapshot engine. */
-void Snapshot::disableSnapshot(void) {
-    this->locked = true;
+    /* 3 - The instructions processed after the snapshot don't belong to the restored state anymore. The last one before
+    it goes back, Negate & Inject and the solver results look for the branch there */
+    last_triton_instructions.clear();
+    if (this->lastInstruction)
+        *last_triton_instructions.next() = *this->lastInstruction;
+    shadow_state.invalidate();
 }
 
 
-/* Reset the snapshot engine.
-* Clear all backups for a new snapshot. */
-void Snapshot::resetEngine(void) {
-    if (!this->snapshotTaken)
-        return;
-
-    this->memory.clear();
-
-    //ToDo: We should delete this when this issue is fixed: https://github.com/JonathanSalwan/Triton/issues/385
-    delete this->snapshotSymEngine;
-    this->snapshotSymEngine = nullptr;
+size_t page_journal_footprint(const page_journal& journal) {
+    size_t footprint = 0;
+    for (const auto& [page_base, page] : journal)
+        footprint += sizeof(ea_t) + sizeof(journal_page) + page.original.size() + page.modified.size() + page.dirty.size() / 8;
+    return footprint;
+}
 
-    delete this->snapshotTaintEngine;
-    this->snapshotTaintEngine = nullptr;
+/* An expression may be the only reference left to what a location held, we count it once with its root node.
+The rest of the AST is usually shared with the engine and the other journals */
+size_t engine_journal_footprint(const engine_journal& journal) {
+    std::set<const triton::engines::symbolic::SymbolicExpression*> expressions;
+    auto add_state = [&expressions](const engine_state& state) {
+        if (state.expression)
+            expressions.insert(state.expression.get());
+    };
+    size_t footprint = sizeof(engine_journal);
+    for (const auto& [reg_id, change] : journal.registers) {
+        footprint += sizeof(triton::arch::register_e) + sizeof(engine_change);
+        add_state(change.original);
+        add_state(change.modified);
+    }
+    for (const auto& [address, change] : journal.memory) {
+        footprint += sizeof(triton::uint64) + sizeof(engine_change);
+        add_state(change.original);
+        add_state(change.modified);
+    }
+    footprint += expressions.size() * (sizeof(triton::engines::symbolic::SymbolicExpression) + sizeof(triton::ast::AbstractNode));
 
-    this->snapshotTaken = false;
+    for (const auto* constraints : { &journal.originalConstraints, &journal.modifiedConstraints }) {
+        for (const auto& path_constraint : *constraints) {
+            footprint += sizeof(triton::engines::symbolic::PathConstraint);
+            footprint += path_constraint.getBranchConstraints().size() * (sizeof(std::tuple<bool, triton::uint64, triton::uint64, triton::ast::SharedAbstractNode>) + sizeof(triton::ast::AbstractNode));
+        }
+    }
+    return footprint;
+}
 
-    //We delete the comment and color that we created
-    ponce_set_cmt(this->address, "", false, false, false);
-    del_item_color(this->address);
-    this->address = 0;
+/* The journals and the registers */
+size_t Snapshot::getFootprint(void) const {
+    size_t footprint = sizeof(Snapshot);
+    footprint += page_journal_footprint(this->parentDelta);
+    footprint += engine_journal_footprint(this->parentEngineDelta);
+    footprint += this->IDAContext.size() * (sizeof(triton::uint512) + 16);
+    if (this->lastInstruction)
+        footprint += sizeof(triton::arch::Instruction);
+    return footprint;
 }
 
 
-/* Check if the snapshot engine is locked. */
-bool Snapshot::isLocked(void) {
-    return this->locked;
-}
+void Snapshot::save(SessionWriter& writer) const {
+    writer.value<std::uint32_t>(this->id);
+    writer.string(this->name);
+    writer.value<std::uint32_t>(this->parent);
+    writer.value<std::uint64_t>(this->address);
+    writer.value<std::uint8_t>(this->automatic);
 
+    writer.value<std::uint32_t>((std::uint32_t)this->IDAContext.size());
+    for (const auto& [reg_name, value] : this->IDAContext) {
+        writer.string(reg_name);
+        writer.integer(value);
+    }
 
-/* Check if we must restore the snapshot */
-bool Snapshot::mustBeRestored(void) {
-    return this->mustBeRestore;
+    writer.status(this->saved_ponce_runtime_status);
 }
 
+bool Snapshot::load(SessionReader& reader) {
+    this->id = reader.value<std::uint32_t>();
+    this->name = reader.string();
+    this->parent = reader.value<std::uint32_t>();
+    this->address = (ea_t)reader.value<std::uint64_t>();
+    this->automatic = reader.value<std::uint8_t>() != 0;
+
+    this->IDAContext.clear();
+    std::uint32_t count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++) {
+        std::string reg_name = reader.string();
+        this->IDAContext[reg_name] = reader.integer();
+    }
 
-/* Check if we must restore the snapshot */
-void Snapshot::setRestore(bool flag) {
-    this->mustBeRestore = flag;
+    //The rest of the status belongs to the process we are debugging now
+    this->saved_ponce_runtime_status = ponce_runtime_status;
+    reader.status(this->saved_ponce_runtime_status);
+    return reader.ok();
 }
@@ -11,110 +11,130 @@
 #include <pro.h>
 
 #include <map>
+#include <optional>
 #include <set>
+#include <string>
+#include <vector>
+#include <cstdint>
 
 /* libTriton */
 #include <triton/context.hpp>
 #include <triton/ast.hpp>
 #include <triton/symbolicEngine.hpp>
 #include <triton/taintEngine.hpp>
-#include <triton/x8664Cpu.hpp>
-#include <triton/x86Cpu.hpp>
-#include <triton/arm32Cpu.hpp>
-#include <triton/aarch64Cpu.hpp>
 
 // Ponce
 #include "runtime_status.hpp"
 
-//! \class Snapshot
-//! \brief the snapshot class.
-class Snapshot {
+class SessionWriter;
+class SessionReader;
+
+//Bytes written between two states of the debuggee, a page at a time
+struct journal_page {
+    //Content in the older state
+    std::vector<std::uint8_t> original;
+    //Content in the newer state, only filled once the journal is closed
+    std::vector<std::uint8_t> modified;
+    //Bytes written, only these are restored
+    std::vector<bool> dirty;
+    //False if the page couldn't be read at once, the original bytes are read store by store
+    bool complete = false;
+};
 
-private:
-    //! I/O memory monitoring for snapshot.
-    std::map<ea_t, char> memory;
+//Journal pages indexed by their base address
+typedef std::map<ea_t, journal_page> page_journal;
 
-    //! Status of the snapshot engine.
-    bool locked;
+//What the symbolic and taint engines hold for a parent register or a memory byte
+struct engine_state {
+    //nullptr if it is concrete
+    triton::engines::symbolic::SharedSymbolicExpression expression;
+    bool tainted = false;
+};
 
-    //! Status of the snapshot engine.
-    bool snapshotTaken;
+//A register or a memory byte changed in the engines between two states
+struct engine_change {
+    //State in the older state
+    engine_state original;
+    //State in the newer state, only filled once the journal is closed
+    engine_state modified;
+};
 
-    //! Flag which defines if we must restore the snapshot.
-    bool mustBeRestore;
+//What the symbolic and taint engines changed between two states. Like the page journal only the changes are kept, the
+//expressions and the AST nodes are shared with the engine
+struct engine_journal {
+    std::map<triton::arch::register_e, engine_change> registers;
+    std::map<triton::uint64, engine_change> memory;
+    //Path constraints both states have in common, they are only appended so they are the first ones
+    size_t sharedConstraints = 0;
+    //Path constraints after the shared ones in the older state and in the newer one, the newer only filled once the journal is closed
+    std::vector<triton::engines::symbolic::PathConstraint> originalConstraints;
+    std::vector<triton::engines::symbolic::PathConstraint> modifiedConstraints;
+};
 
-    //! AST node state.
-    std::set<triton::ast::AbstractNode*> nodesList;
+//! Approximate memory used by a page journal in bytes.
+size_t page_journal_footprint(const page_journal& journal);
 
-    //! Variables node state.
-    std::map<std::string, triton::ast::AbstractNode*> variablesMap;
+//! Approximate memory used by an engine journal in bytes, with the expressions and path constraints it keeps alive.
+size_t engine_journal_footprint(const engine_journal& journal);
 
-    //! Snapshot of the symbolic engine.
-    triton::engines::symbolic::SymbolicEngine* snapshotSymEngine;
+//! \class Snapshot
+//! \brief One of the snapshots in the snapshot tree. The memory and the engines are handled by the SnapshotManager.
+class Snapshot {
 
-    //! Snapshot of the taint engine.
-    triton::engines::taint::TaintEngine* snapshotTaintEngine;
+private:
+    //! Snapshot of IDA registers context.
+    std::map<std::string, triton::uint512> IDAContext;
 
-    //! AST Context
-    triton::ast::AstContext* astCtx;
+    //! Snapshot of the ponce plugin status
+    struct runtime_status_t saved_ponce_runtime_status;
 
-    //! Snapshot of triton CPU.
-    triton::arch::x86::x8664Cpu* cpu_x8664;
-    triton::arch::x86::x86Cpu* cpu_x86;
-    triton::arch::arm::aarch64::AArch64Cpu * cpu_AArch64;
-    triton::arch::arm::arm32::Arm32Cpu* cpu_Arm32;
+    //! Last instruction processed by Triton, a checkpoint's is its symbolic branch. Negate & Inject needs it back in the ring.
+    //! It is not written in the session files.
+    std::optional<triton::arch::Instruction> lastInstruction;
 
-#if defined(__x86_64__) || defined(_M_X64)
-    
-#endif
-#if defined(__i386) || defined(_M_IX86)
-    triton::arch::x86::x86Cpu* cpu;
-#endif
+public:
+    //! Identifier shown to the user, starting at 1.
+    unsigned int id;
 
-    //! Snapshot of Pin context.
-    std::map<std::string, triton::uint512> IDAContext;
+    //! Name given by the user.
+    std::string name;
 
-    //! Snapshot of the ponce plugin status
-    struct runtime_status_t saved_ponce_runtime_status;
+    //! Snapshot this one was taken from, 0 for the first one.
+    unsigned int parent;
 
     //! address where the snapshot was taken
     ea_t address;
 
-public:
-    //! Constructor.
-    Snapshot();
-
-    //! Destructor.
-    ~Snapshot();
+    //! Taken by Ponce at a symbolic branch, it is deleted when newer checkpoints need the room.
+    bool automatic;
 
-    //! Returns true if the snapshot engine is disabled.
-    bool isLocked(void);
+    //! Process forked when the snapshot was taken, restoring the snapshot switches to it. 0 if there isn't any.
+    int forkPid;
 
-    //! Returns true if we must restore the context.
-    bool mustBeRestored(void);
+    //! Memory written between the parent snapshot and this one. The original bytes are the parent ones and the modified bytes ours.
+    page_journal parentDelta;
 
-    //! Adds a memory modifiction.
-    void addModification(ea_t address, char byte);
+    //! Changes in the engines between the parent snapshot and this one, in the same way as the memory.
+    engine_journal parentEngineDelta;
 
-    //! Disables the snapshot engine.
-    void disableSnapshot(void);
+    //! Spans of code run without tracing between the parent snapshot and this one, their writes out of the stack are not in parentDelta.
+    unsigned int parentUntracedSpans;
 
-    //! Resets the snapshot engine.
-    void resetEngine(void);
+    //! Constructor.
+    Snapshot();
 
-    //! Restores a snapshot.
-    void restoreSnapshot();
+    //! Saves the registers and the Ponce status.
+    void takeSnapshot(void);
 
-    //! Sets the restore flag.
-    void setRestore(bool flag);
+    //! Restores the registers, the Ponce status and the last instruction. The memory and the engines must be restored before.
+    void restoreSnapshot(void);
 
-    //! Takes a snapshot.
-    void takeSnapshot();
+    //! Approximate memory used by the snapshot in bytes.
+    size_t getFootprint(void) const;
 
-    //! Tells if a snapshot has been taken
-    bool exists(void);
+    //! Writes the snapshot in a session file, without the journals.
+    void save(SessionWriter& writer) const;
 
-    //! Setter for the address where the snaphsot was taken
-    void setAddress(ea_t address);
+    //! Reads a snapshot written by save. Returns false if the file is corrupted.
+    bool load(SessionReader& reader);
 };
-
@@ -0,0 +1,143 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+//IDA
+#include <ida.hpp>
+#include <dbg.hpp>
+#include <kernwin.hpp>
+
+//Ponce
+#include "snapshot_chooser.hpp"
+#include "globals.hpp"
+#include "hybrid_execution.hpp"
+#include "utils.hpp"
+
+struct ponce_snapshot_chooser_t* ponce_snapshot_chooser = nullptr;
+
+const int ponce_snapshot_chooser_t::widths_[] = {
+    4,
+    30,
+    16,
+    12
+};
+
+// column headers
+const char* ponce_snapshot_chooser_t::header_[] =
+{
+    "Id",
+    "Name",
+    "Address",
+    "Memory (KB)"
+};
+
+ponce_snapshot_chooser_t::ponce_snapshot_chooser_t()
+    : chooser_t(CH_CAN_REFRESH | CH_CAN_INS | CH_CAN_DEL | CH_CAN_EDIT, qnumber(widths_), widths_, header_, SNAPSHOT_CHOOSER_TITLE) {
+    CASSERT(qnumber(widths_) == qnumber(header_));
+
+    fill_entryList();
+}
+
+void ponce_snapshot_chooser_t::fill_entryList() {
+    table_item_list.clear();
+    for (const auto& [id, depth] : snapshot_manager.getTree()) {
+        const Snapshot* snapshot = snapshot_manager.getSnapshot(id);
+        list_item_t item;
+        item.id = id;
+        item.depth = depth;
+        item.name = snapshot->name;
+        item.address = snapshot->address;
+        item.footprint = snapshot_manager.getFootprint(id);
+        item.current = id == snapshot_manager.getCurrent();
+        table_item_list.push_back(item);
+    }
+}
+
+// function that generates the list line
+void idaapi ponce_snapshot_chooser_t::get_row(qstrvec_t* cols_, int*, chooser_item_attrs_t* attrs,
+    size_t n) const {
+    qstrvec_t& cols = *cols_;
+
+    const auto& item = table_item_list.at(n);
+    cols[0].sprnt("%u", item.id);
+    //The children are indented under their parent
+    cols[1].sprnt("%*s%s", (int)item.depth * 2, "", item.name.c_str());
+    cols[2].sprnt(MEM_FORMAT, item.address);
+    cols[3].sprnt("%u", (unsigned int)((item.footprint + 1023) / 1024));
+    //The snapshot the debuggee comes from
+    if (item.current)
+        attrs->flags |= CHITEM_BOLD;
+}
+
+cbret_t idaapi ponce_snapshot_chooser_t::enter(size_t n) {
+    if (n >= table_item_list.size())
+        return cbret_t();
+    if (!is_debugger_on()) {
+        msg("[!] The snapshots can only be restored while debugging\n");
+        return cbret_t();
+    }
+    if (snapshot_manager.restoreSnapshot(table_item_list[n].id))
+        msg("Snapshot %u restored\n", table_item_list[n].id);
+    // Reset tracer timing counter since user was using IDA and not just tracing
+    ponce_runtime_status.tracing_start_time = GetTimeMs64();
+    return cbret_t(n, chooser_base_t::ALL_CHANGED);
+}
+
+cbret_t idaapi ponce_snapshot_chooser_t::ins(ssize_t n) {
+    if (!is_debugger_on()) {
+        msg("[!] The snapshots can only be taken while debugging\n");
+        return cbret_t();
+    }
+    qstring name;
+    name.sprnt("Snapshot %u", (unsigned int)table_item_list.size() + 1);
+    if (!ask_str(&name, HIST_IDENT, "Snapshot name"))
+        return cbret_t();
+    take_snapshot_here(name.c_str());
+    return cbret_t(n, chooser_base_t::ALL_CHANGED);
+}
+
+cbret_t idaapi ponce_snapshot_chooser_t::del(size_t n) {
+    if (n >= table_item_list.size())
+        return cbret_t();
+    if (snapshot_manager.deleteSnapshot(table_item_list[n].id))
+        msg("[+] Snapshot %u removed\n", table_item_list[n].id);
+    return cbret_t(n, chooser_base_t::ALL_CHANGED);
+}
+
+cbret_t idaapi ponce_snapshot_chooser_t::edit(size_t n) {
+    if (n >= table_item_list.size())
+        return cbret_t();
+    qstring name = table_item_list[n].name.c_str();
+    if (ask_str(&name, HIST_IDENT, "Snapshot name"))
+        snapshot_manager.renameSnapshot(table_item_list[n].id, name.c_str());
+    return cbret_t(n, chooser_base_t::ALL_CHANGED);
+}
+
+void refresh_snapshot_chooser(void)
+{
+    if (ponce_snapshot_chooser == nullptr)
+        return;
+    refresh_chooser(SNAPSHOT_CHOOSER_TITLE);
+}
+
+unsigned int take_snapshot_here(const char* name)
+{
+    ea_t xip;
+    if (!get_ip_val(&xip)) {
+        msg("Could not get the XIP value. This should never happen\n");
+        return 0;
+    }
+
+    //The snapshot needs to see every memory write
+    resume_tracing();
+
+    unsigned int id = snapshot_manager.takeSnapshot(name, xip);
+    msg("Snapshot %u Taken\n", id);
+    return id;
+}
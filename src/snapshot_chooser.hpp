@@ -0,0 +1,81 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "kernwin.hpp"
+
+#define SNAPSHOT_CHOOSER_TITLE "Ponce Snapshots"
+
+extern struct ponce_snapshot_chooser_t* ponce_snapshot_chooser;
+
+// The snapshot tree. Enter restores a snapshot, Ins takes a new one, Del deletes it and Edit renames it
+struct ponce_snapshot_chooser_t : public chooser_t
+{
+protected:
+    static const int widths_[];
+    static const char* header_[];
+
+    typedef struct s
+    {
+        unsigned int id = 0;
+        unsigned int depth = 0;
+        std::string name;
+        ea_t address = 0;
+        size_t footprint = 0;
+        bool current = false;
+    }list_item_t;
+
+public:
+    std::vector<list_item_t> table_item_list;
+
+    // function that returns number of lines in the list
+    virtual size_t idaapi get_count() const { return table_item_list.size(); }
+
+    // function that generates the list line
+    virtual void idaapi get_row(qstrvec_t* cols, int* icon_,
+        chooser_item_attrs_t* attrs,
+        size_t n) const;
+
+    // function that is called when the user wants to refresh the chooser
+    virtual cbret_t idaapi refresh(ssize_t n) {
+        fill_entryList();
+        return adjust_last_item(n);  // try to preserve the cursor
+    }
+
+    // the user pressed Enter, the snapshot is restored
+    virtual cbret_t idaapi enter(size_t n);
+
+    // the user pressed Ins, a new snapshot is taken
+    virtual cbret_t idaapi ins(ssize_t n);
+
+    // the user pressed Del
+    virtual cbret_t idaapi del(size_t n);
+
+    // the user wants to rename the snapshot
+    virtual cbret_t idaapi edit(size_t n);
+
+    // function that is called when the user wants to close the chooser
+    virtual void idaapi closed() {
+        table_item_list.clear();
+        ponce_snapshot_chooser = nullptr;
+    }
+
+    ponce_snapshot_chooser_t();
+    void fill_entryList();
+};
+
+//! Refreshes the snapshots window if it is open.
+void refresh_snapshot_chooser(void);
+
+//! Takes a snapshot at the current instruction. An empty name gives it a default one. Returns its id, 0 if it couldn't be taken.
+unsigned int take_snapshot_here(const char* name);
@@ -0,0 +1,937 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <algorithm>
+#include <set>
+#include <string>
+
+//Ponce
+#include "snapshot_manager.hpp"
+#include "globals.hpp"
+#include "utils.hpp"
+#include "session.hpp"
+#include "fork_checkpoint.hpp"
+#include "shadow_state.hpp"
+#include "context.hpp"
+
+//IDA
+#include <bytes.hpp>
+#include <nalt.hpp>
+#include <dbg.hpp>
+
+#define PAGE_BASE(address) ((address) & ~(ea_t)(PONCE_PAGE_SIZE - 1))
+
+// Background color of the instructions where a snapshot was taken
+#define SNAPSHOT_COLOR 0x00FFFF
+
+// Stack below the stack pointer saved before running code without tracing, the frames it is going to use
+#define UNTRACED_STACK_SIZE (4 * PONCE_PAGE_SIZE)
+
+SnapshotManager snapshot_manager;
+
+/* Save the original content of the bytes a store is going to write. It is called before the instruction runs.
+The first store to a page saves the whole page, so the next stores to it don't need the debugger. */
+static void journal_store(page_journal& journal, ea_t address, size_t size)
+{
+    for (ea_t page_base = PAGE_BASE(address); page_base < address + size; page_base += PONCE_PAGE_SIZE) {
+        ea_t start = std::max(address, page_base);
+        ea_t end = std::min<ea_t>(address + size, page_base + PONCE_PAGE_SIZE);
+
+        auto it = journal.find(page_base);
+        if (it == journal.end()) {
+            journal_page page;
+            page.original.resize(PONCE_PAGE_SIZE);
+            page.dirty.resize(PONCE_PAGE_SIZE, false);
+            page.complete = memory_cache.read(page_base, page.original.data(), PONCE_PAGE_SIZE);
+            it = journal.emplace(page_base, std::move(page)).first;
+        }
+
+        journal_page& page = it->second;
+        for (ea_t ea = start; ea < end; ea++) {
+            size_t offset = ea - page_base;
+            if (page.dirty[offset])
+                continue;
+            //The rest of the page is not mapped, we read the bytes one by one
+            if (!page.complete && !memory_cache.read(ea, &page.original[offset], 1))
+                continue;
+            page.dirty[offset] = true;
+        }
+    }
+}
+
+/* Calls callback(address, offset in the page, length) for every run of written bytes of a page */
+template <typename F>
+static void for_each_dirty_run(ea_t page_base, const journal_page& page, F callback)
+{
+    size_t offset = 0;
+    while (offset < PONCE_PAGE_SIZE) {
+        if (!page.dirty[offset]) {
+            offset++;
+            continue;
+        }
+        size_t start = offset;
+        while (offset < PONCE_PAGE_SIZE && page.dirty[offset])
+            offset++;
+        callback(page_base + start, start, offset - start);
+    }
+}
+
+/* The journal is not going to grow anymore, we save what the written bytes contain now */
+static void close_journal(page_journal& journal)
+{
+    for (auto& [page_base, page] : journal) {
+        page.modified = page.original;
+        for_each_dirty_run(page_base, page, [&page](ea_t address, size_t offset, size_t length) {
+            if (!memory_cache.read(address, &page.modified[offset], length))
+                msg("[!] Couldn't read " MEM_FORMAT " to save it in the snapshot\n", address);
+        });
+    }
+}
+
+/* Writes back the original or the modified bytes of the journal. The contiguous written bytes are put back at once.
+Returns the number of bytes written */
+static size_t apply_journal(const page_journal& journal, bool modified)
+{
+    std::vector<std::uint8_t> run;
+    ea_t run_start = BADADDR;
+    size_t written = 0;
+    auto flush_run = [&]() {
+        if (run.empty())
+            return;
+        put_bytes(run_start, run.data(), run.size());
+        instruction_cache.invalidate(run_start, run.size());
+        memory_cache.invalidate(run_start, run.size());
+        written += run.size();
+        run.clear();
+    };
+    for (const auto& [page_base, page] : journal) {
+        const std::vector<std::uint8_t>& content = modified ? page.modified : page.original;
+        for_each_dirty_run(page_base, page, [&](ea_t address, size_t offset, size_t length) {
+            //The runs can go on in the next page
+            if (!run.empty() && run_start + run.size() != address)
+                flush_run();
+            if (run.empty())
+                run_start = address;
+            run.insert(run.end(), content.begin() + offset, content.begin() + offset + length);
+        });
+    }
+    flush_run();
+    return written;
+}
+
+/* Extends the newer journal back to the start of the older one, which ends where the newer starts */
+static void merge_journals(page_journal& newer, const page_journal& older)
+{
+    for (const auto& [page_base, older_page] : older) {
+        auto it = newer.find(page_base);
+        if (it == newer.end()) {
+            newer.emplace(page_base, older_page);
+            continue;
+        }
+        journal_page& page = it->second;
+        for (size_t offset = 0; offset < PONCE_PAGE_SIZE; offset++) {
+            if (!older_page.dirty[offset])
+                continue;
+            //What the bytes contained before both journals
+            page.original[offset] = older_page.original[offset];
+            //Written only in the older journal, the newer state is the one the older journal left
+            if (!page.dirty[offset]) {
+                if (!older_page.modified.empty()) {
+                    page.modified.resize(PONCE_PAGE_SIZE);
+                    page.modified[offset] = older_page.modified[offset];
+                }
+                page.dirty[offset] = true;
+            }
+        }
+    }
+}
+
+/* What the engines hold now for a parent register */
+static engine_state register_state(triton::arch::register_e reg_id)
+{
+    const triton::arch::Register& reg = tritonCtx.getRegister(reg_id);
+    engine_state state;
+    state.expression = tritonCtx.getSymbolicRegister(reg);
+    state.tainted = tritonCtx.isRegisterTainted(reg);
+    return state;
+}
+
+/* What the engines hold now for a memory byte */
+static engine_state memory_state(triton::uint64 address)
+{
+    engine_state state;
+    state.expression = tritonCtx.getSymbolicMemory(address);
+    state.tainted = tritonCtx.isMemoryTainted(address);
+    return state;
+}
+
+static void set_register_state(triton::arch::register_e reg_id, const engine_state& state)
+{
+    const triton::arch::Register& reg = tritonCtx.getRegister(reg_id);
+    if (state.expression)
+        tritonCtx.assignSymbolicExpressionToRegister(state.expression, reg);
+    else
+        tritonCtx.concretizeRegister(reg);
+    if (state.tainted)
+        tritonCtx.taintRegister(reg);
+    else
+        tritonCtx.untaintRegister(reg);
+}
+
+static void set_memory_state(triton::uint64 address, const engine_state& state)
+{
+    if (state.expression)
+        tritonCtx.assignSymbolicExpressionToMemory(state.expression, triton::arch::MemoryAccess(address, 1));
+    else
+        tritonCtx.concretizeMemory(address);
+    if (state.tainted)
+        tritonCtx.taintMemory(address);
+    else
+        tritonCtx.untaintMemory(address);
+}
+
+/* The engine journal starts from what the engines hold now */
+static void open_engine_journal(engine_journal& journal)
+{
+    journal = engine_journal();
+    journal.sharedConstraints = tritonCtx.getPathConstraints().size();
+}
+
+/* Save what a register or a memory byte holds before it is changed, only the first change matters */
+static void journal_register(engine_journal& journal, triton::arch::register_e reg_id)
+{
+    if (journal.registers.find(reg_id) == journal.registers.end())
+        journal.registers[reg_id].original = register_state(reg_id);
+}
+
+static void journal_memory(engine_journal& journal, triton::uint64 address)
+{
+    if (journal.memory.find(address) == journal.memory.end())
+        journal.memory[address].original = memory_state(address);
+}
+
+/* The engine journal is not going to grow anymore, we save what the changed registers and bytes hold now */
+static void close_engine_journal(engine_journal& journal)
+{
+    for (auto& [reg_id, change] : journal.registers)
+        change.modified = register_state(reg_id);
+    for (auto& [address, change] : journal.memory)
+        change.modified = memory_state(address);
+    const auto& path_constraints = tritonCtx.getPathConstraints();
+    journal.modifiedConstraints.assign(path_constraints.begin() + journal.sharedConstraints, path_constraints.end());
+}
+
+/* Takes the engines to the older or the newer state of the journal, they must be in the other one.
+Only what the journal changed is touched, the expressions created on the way are released by Triton when nothing refers to them */
+static void apply_engine_journal(const engine_journal& journal, bool modified)
+{
+    for (const auto& [reg_id, change] : journal.registers)
+        set_register_state(reg_id, modified ? change.modified : change.original);
+    for (const auto& [address, change] : journal.memory)
+        set_memory_state(address, modified ? change.modified : change.original);
+
+    while (tritonCtx.getPathConstraints().size() > journal.sharedConstraints)
+        tritonCtx.popPathConstraint();
+    for (const auto& path_constraint : modified ? journal.modifiedConstraints : journal.originalConstraints)
+        tritonCtx.pushPathConstraint(path_constraint);
+}
+
+/* Extends the newer engine journal back to the start of the older one, which ends where the newer starts */
+static void merge_engine_journals(engine_journal& newer, const engine_journal& older)
+{
+    for (const auto& [reg_id, older_change] : older.registers) {
+        auto it = newer.registers.find(reg_id);
+        if (it == newer.registers.end())
+            newer.registers.emplace(reg_id, older_change);
+        else
+            it->second.original = older_change.original;
+    }
+    for (const auto& [address, older_change] : older.memory) {
+        auto it = newer.memory.find(address);
+        if (it == newer.memory.end())
+            newer.memory.emplace(address, older_change);
+        else
+            it->second.original = older_change.original;
+    }
+
+    if (newer.sharedConstraints >= older.sharedConstraints) {
+        //The newer journal kept what the older one appended, or part of it
+        std::vector<triton::engines::symbolic::PathConstraint> modified(older.modifiedConstraints.begin(),
+            older.modifiedConstraints.begin() + (newer.sharedConstraints - older.sharedConstraints));
+        modified.insert(modified.end(), newer.modifiedConstraints.begin(), newer.modifiedConstraints.end());
+        newer.modifiedConstraints = std::move(modified);
+        newer.originalConstraints = older.originalConstraints;
+        newer.sharedConstraints = older.sharedConstraints;
+    }
+    else {
+        //The newer journal popped constraints the older one didn't touch, they are followed by the older original ones
+        newer.originalConstraints.resize(older.sharedConstraints - newer.sharedConstraints);
+        newer.originalConstraints.insert(newer.originalConstraints.end(), older.originalConstraints.begin(), older.originalConstraints.end());
+    }
+}
+
+/* The dirty bytes are written as a bitmap */
+static void save_journal(SessionWriter& writer, const page_journal& journal)
+{
+    writer.value<std::uint32_t>((std::uint32_t)journal.size());
+    for (const auto& [page_base, page] : journal) {
+        writer.value<std::uint64_t>(page_base);
+        writer.value<std::uint8_t>(page.complete);
+        writer.value<std::uint8_t>(!page.modified.empty());
+        writer.bytes(page.original.data(), PONCE_PAGE_SIZE);
+        if (!page.modified.empty())
+            writer.bytes(page.modified.data(), PONCE_PAGE_SIZE);
+        std::uint8_t bitmap[PONCE_PAGE_SIZE / 8] = {};
+        for (size_t offset = 0; offset < PONCE_PAGE_SIZE; offset++) {
+            if (page.dirty[offset])
+                bitmap[offset / 8] |= 1 << (offset % 8);
+        }
+        writer.bytes(bitmap, sizeof(bitmap));
+    }
+}
+
+static bool load_journal(SessionReader& reader, page_journal& journal)
+{
+    journal.clear();
+    std::uint32_t count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++) {
+        ea_t page_base = (ea_t)reader.value<std::uint64_t>();
+        journal_page page;
+        page.complete = reader.value<std::uint8_t>() != 0;
+        bool has_modified = reader.value<std::uint8_t>() != 0;
+        page.original.resize(PONCE_PAGE_SIZE);
+        reader.bytes(page.original.data(), PONCE_PAGE_SIZE);
+        if (has_modified) {
+            page.modified.resize(PONCE_PAGE_SIZE);
+            reader.bytes(page.modified.data(), PONCE_PAGE_SIZE);
+        }
+        std::uint8_t bitmap[PONCE_PAGE_SIZE / 8];
+        if (!reader.bytes(bitmap, sizeof(bitmap)))
+            break;
+        page.dirty.resize(PONCE_PAGE_SIZE);
+        for (size_t offset = 0; offset < PONCE_PAGE_SIZE; offset++)
+            page.dirty[offset] = (bitmap[offset / 8] >> (offset % 8)) & 1;
+        journal.emplace(page_base, std::move(page));
+    }
+    return reader.ok();
+}
+
+static void save_engine_state(SessionWriter& writer, const engine_state& state)
+{
+    writer.value<std::uint8_t>(state.expression != nullptr);
+    if (state.expression)
+        writer.expression(state.expression);
+    writer.value<std::uint8_t>(state.tainted);
+}
+
+static engine_state load_engine_state(SessionReader& reader)
+{
+    engine_state state;
+    if (reader.value<std::uint8_t>() != 0)
+        state.expression = reader.expression();
+    state.tainted = reader.value<std::uint8_t>() != 0;
+    return state;
+}
+
+static void save_engine_journal(SessionWriter& writer, const engine_journal& journal)
+{
+    writer.value<std::uint32_t>((std::uint32_t)journal.registers.size());
+    for (const auto& [reg_id, change] : journal.registers) {
+        writer.value<std::uint32_t>((std::uint32_t)reg_id);
+        save_engine_state(writer, change.original);
+        save_engine_state(writer, change.modified);
+    }
+    writer.value<std::uint32_t>((std::uint32_t)journal.memory.size());
+    for (const auto& [address, change] : journal.memory) {
+        writer.value<std::uint64_t>(address);
+        save_engine_state(writer, change.original);
+        save_engine_state(writer, change.modified);
+    }
+    writer.value<std::uint32_t>((std::uint32_t)journal.sharedConstraints);
+    writer.value<std::uint32_t>((std::uint32_t)journal.originalConstraints.size());
+    for (const auto& path_constraint : journal.originalConstraints)
+        writer.path_constraint(path_constraint);
+    writer.value<std::uint32_t>((std::uint32_t)journal.modifiedConstraints.size());
+    for (const auto& path_constraint : journal.modifiedConstraints)
+        writer.path_constraint(path_constraint);
+}
+
+static bool load_engine_journal(SessionReader& reader, engine_journal& journal)
+{
+    journal = engine_journal();
+    std::uint32_t count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++) {
+        auto reg_id = (triton::arch::register_e)reader.value<std::uint32_t>();
+        engine_change& change = journal.registers[reg_id];
+        change.original = load_engine_state(reader);
+        change.modified = load_engine_state(reader);
+    }
+    count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++) {
+        triton::uint64 address = reader.value<std::uint64_t>();
+        engine_change& change = journal.memory[address];
+        change.original = load_engine_state(reader);
+        change.modified = load_engine_state(reader);
+    }
+    journal.sharedConstraints = reader.value<std::uint32_t>();
+    count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++)
+        journal.originalConstraints.push_back(reader.path_constraint());
+    count = reader.value<std::uint32_t>();
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++)
+        journal.modifiedConstraints.push_back(reader.path_constraint());
+    return reader.ok();
+}
+
+SnapshotManager::SnapshotManager() {
+    this->current = 0;
+    this->nextId = 1;
+    this->untracedSpans = 0;
+    this->branchesSinceCheckpoint = 0;
+    this->checkpointsCount = 0;
+    this->checkpointsFootprint = 0;
+}
+
+bool SnapshotManager::exists(void) const {
+    return !this->snapshots.empty();
+}
+
+void SnapshotManager::recordStore(ea_t address, size_t size) {
+    if (this->current == 0)
+        return;
+    journal_store(this->journal, address, size);
+}
+
+/* Nobody tells what untraced code writes. Its frames and the locals of the callers are in the stack, whole pages around the
+stack pointer are saved before it runs. The writes anywhere else are only counted, restoring across them warns the user */
+void SnapshotManager::recordUntracedSpan(void) {
+    ea_t sp = (ea_t)IDA_getCurrentRegisterValue(tritonCtx.getStackPointer());
+    ea_t start = PAGE_BASE(sp - UNTRACED_STACK_SIZE);
+    ea_t end = PAGE_BASE(sp) + PONCE_PAGE_SIZE;
+    //The session saves them too
+    session_record_store(start, end - start);
+    if (this->current == 0)
+        return;
+    journal_store(this->journal, start, end - start);
+    this->untracedSpans++;
+}
+
+void SnapshotManager::recordEngineRegister(const triton::arch::Register& reg) {
+    if (this->current == 0)
+        return;
+    journal_register(this->engineJournal, tritonCtx.getParentRegister(reg.getId()).getId());
+}
+
+void SnapshotManager::recordEngineMemory(triton::uint64 address, size_t size) {
+    if (this->current == 0)
+        return;
+    for (size_t i = 0; i < size; i++)
+        journal_memory(this->engineJournal, address + i);
+}
+
+void SnapshotManager::recordEngineRegisters(void) {
+    if (this->current == 0)
+        return;
+    //The concrete and untainted ones don't change
+    for (const auto& [reg_id, expression] : tritonCtx.getSymbolicRegisters())
+        journal_register(this->engineJournal, reg_id);
+    for (const auto& reg : tritonCtx.getTaintedRegisters())
+        journal_register(this->engineJournal, tritonCtx.getParentRegister(reg->getId()).getId());
+}
+
+/* Triton only tells what an instruction wrote once the previous content is lost. Before the semantics we save the
+tainted or symbolic registers and bytes the already disassembled instruction may write, the rest was concrete and untainted */
+void SnapshotManager::recordInstruction(const triton::arch::Instruction& instruction) {
+    if (this->current == 0)
+        return;
+    const auto& registers = shadow_state.dirty_registers();
+    if (registers.any()) {
+        for (size_t reg_id = 0; reg_id < registers.size(); reg_id++) {
+            if (registers.test(reg_id))
+                journal_register(this->engineJournal, (triton::arch::register_e)reg_id);
+        }
+    }
+
+    std::vector<std::pair<ea_t, size_t>> accesses;
+    if (!shadow_state.possible_accesses(instruction, accesses))
+        return;
+    for (const auto& [address, size] : accesses) {
+        if (!shadow_state.is_dirty(address, size))
+            continue;
+        for (size_t i = 0; i < size; i++) {
+            if (shadow_state.is_dirty(address + i, 1))
+                journal_memory(this->engineJournal, address + i);
+        }
+    }
+}
+
+/* Called after the semantics and before the shadow state is updated, so it still tells what was dirty before */
+void SnapshotManager::recordInstructionWrites(const triton::arch::Instruction& instruction) {
+    if (this->current == 0)
+        return;
+    engine_journal& journal = this->engineJournal;
+    for (const auto& [reg, node] : instruction.getWrittenRegisters()) {
+        auto reg_id = tritonCtx.getParentRegister(reg.getId()).getId();
+        //Not saved by recordInstruction, it was concrete and untainted
+        if (journal.registers.find(reg_id) == journal.registers.end())
+            journal.registers[reg_id].original = engine_state();
+    }
+    for (const auto& [memory_access, node] : instruction.getStoreAccess()) {
+        for (triton::uint32 i = 0; i < memory_access.getSize(); i++) {
+            triton::uint64 address = memory_access.getAddress() + i;
+            if (journal.memory.find(address) != journal.memory.end())
+                continue;
+            if (shadow_state.is_dirty((ea_t)address, 1))
+                msg("[!] " MEM_FORMAT " was overwritten by an access we didn't expect, the snapshots will restore it as concrete\n", (ea_t)address);
+            journal.memory[address].original = engine_state();
+        }
+    }
+}
+
+void SnapshotManager::popPathConstraint(void) {
+    size_t count = tritonCtx.getPathConstraints().size();
+    if (count == 0)
+        return;
+    //The constraint was there when the current snapshot was taken, the snapshot needs it back
+    if (this->current != 0 && count == this->engineJournal.sharedConstraints) {
+        this->engineJournal.originalConstraints.insert(this->engineJournal.originalConstraints.begin(), tritonCtx.getPathConstraints().back());
+        this->engineJournal.sharedConstraints--;
+    }
+    tritonCtx.popPathConstraint();
+}
+
+std::vector<unsigned int> SnapshotManager::getAncestors(unsigned int id) const {
+    std::vector<unsigned int> ancestors;
+    for (auto it = this->snapshots.find(id); it != this->snapshots.end(); it = this->snapshots.find(it->second.parent))
+        ancestors.push_back(it->first);
+    return ancestors;
+}
+
+unsigned int SnapshotManager::takeSnapshot(const char* name, ea_t address, bool automatic) {
+    Snapshot snapshot;
+    snapshot.id = this->nextId++;
+    if (name != nullptr && name[0] != '\0') {
+        snapshot.name = name;
+    }
+    else {
+        qstring default_name;
+        default_name.sprnt("Snapshot %u", snapshot.id);
+        snapshot.name = default_name.c_str();
+    }
+    snapshot.parent = this->current;
+    snapshot.address = address;
+    snapshot.automatic = automatic;
+
+    //What was written and changed in the engines since the current snapshot is the way from it to the new one
+    if (this->current != 0) {
+        close_journal(this->journal);
+        snapshot.parentDelta = std::move(this->journal);
+        close_engine_journal(this->engineJournal);
+        snapshot.parentEngineDelta = std::move(this->engineJournal);
+        snapshot.parentUntracedSpans = this->untracedSpans;
+    }
+    this->journal.clear();
+    open_engine_journal(this->engineJournal);
+    //The process may be running natively, what it does next is not traced either
+    this->untracedSpans = ponce_runtime_status.running_natively ? 1 : 0;
+
+    snapshot.takeSnapshot();
+    //The checkpoints are taken while tracing, the debuggee can't run the fork there
+    if (!automatic && fork_checkpoints_available())
+        snapshot.forkPid = fork_checkpoint();
+    unsigned int id = snapshot.id;
+    if (automatic) {
+        this->checkpointsCount++;
+        this->checkpointsFootprint += snapshot.getFootprint();
+    }
+    this->snapshots.emplace(id, std::move(snapshot));
+    this->current = id;
+    if (!automatic)
+        this->updateComment(address);
+    return id;
+}
+
+void SnapshotManager::symbolicBranch(ea_t address) {
+    if (!cmdOptions.auto_checkpoints)
+        return;
+    if (++this->branchesSinceCheckpoint < std::max<uint64>(cmdOptions.checkpoint_interval, 1))
+        return;
+    this->branchesSinceCheckpoint = 0;
+
+    qstring name;
+    name.sprnt("Branch at " MEM_FORMAT, address);
+    this->takeSnapshot(name.c_str(), address, true);
+    this->trimCheckpoints();
+}
+
+/* The oldest checkpoints go first. Their memory is merged in their children, so the newer ones can still be restored */
+void SnapshotManager::trimCheckpoints(void) {
+    size_t max_footprint = (size_t)cmdOptions.checkpoint_memory * 1024 * 1024;
+    if (this->checkpointsCount <= cmdOptions.checkpoint_count && this->checkpointsFootprint <= max_footprint)
+        return;
+
+    //The ids are the creation order. The current one is where the execution comes from, it is kept even if it is alone
+    std::vector<unsigned int> oldest;
+    for (const auto& [id, snapshot] : this->snapshots) {
+        if (snapshot.automatic && id != this->current)
+            oldest.push_back(id);
+    }
+    for (const auto& id : oldest) {
+        if (this->checkpointsCount <= cmdOptions.checkpoint_count && this->checkpointsFootprint <= max_footprint)
+            return;
+        this->deleteSnapshot(id);
+    }
+}
+
+/* Undoes the journals from the current state up to the common ancestor and redoes them down to the target.
+The memory is left alone when the debuggee already is the target. Returns the bytes written */
+size_t SnapshotManager::walkJournals(const std::vector<unsigned int>& up, const std::vector<unsigned int>& down, bool memory, unsigned int& untraced) {
+    /* 1 - Back to the current snapshot */
+    size_t written = 0;
+    if (memory)
+        written += apply_journal(this->journal, false);
+    this->journal.clear();
+    apply_engine_journal(this->engineJournal, false);
+    untraced = this->untracedSpans;
+
+    /* 2 - Undo the way from the common ancestor to the current snapshot */
+    for (const auto& id : up) {
+        if (memory)
+            written += apply_journal(this->snapshots[id].parentDelta, false);
+        apply_engine_journal(this->snapshots[id].parentEngineDelta, false);
+        untraced += this->snapshots[id].parentUntracedSpans;
+    }
+
+    /* 3 - Redo the way from the common ancestor to the target */
+    for (auto it = down.rbegin(); it != down.rend(); ++it) {
+        if (memory)
+            written += apply_journal(this->snapshots[*it].parentDelta, true);
+        apply_engine_journal(this->snapshots[*it].parentEngineDelta, true);
+        untraced += this->snapshots[*it].parentUntracedSpans;
+    }
+
+    //The journals start again from the target
+    open_engine_journal(this->engineJournal);
+    this->untracedSpans = 0;
+    return written;
+}
+
+bool SnapshotManager::restoreSnapshot(unsigned int id) {
+    auto target = this->snapshots.find(id);
+    if (target == this->snapshots.end())
+        return false;
+
+    //We go up from the current snapshot to the common ancestor and down to the target
+    std::vector<unsigned int> up = this->getAncestors(this->current);
+    std::vector<unsigned int> down = this->getAncestors(id);
+    std::set<unsigned int> down_set(down.begin(), down.end());
+    auto common = std::find_if(up.begin(), up.end(), [&down_set](unsigned int ancestor) { return down_set.count(ancestor) != 0; });
+    if (common == up.end()) {
+        msg("[!] Snapshot %u is not in the same tree as the current state\n", id);
+        return false;
+    }
+    down.erase(std::find(down.begin(), down.end(), *common), down.end());
+    up.erase(common, up.end());
+
+    //A forked snapshot doesn't need the memory journals, the child is the whole process as it was
+    int fork_pid = target->second.forkPid;
+    if (fork_pid != 0 && fork_checkpoints_available()) {
+        target->second.forkPid = 0;
+        if (switch_to_fork(fork_pid)) {
+            //The child has the memory as it was, the untraced code doesn't matter
+            unsigned int untraced;
+            this->walkJournals(up, down, false, untraced);
+            target->second.restoreSnapshot();
+            this->current = id;
+            this->checkBranchRestored(target->second);
+            //The child is the debuggee now, we fork it again to restore the snapshot later
+            target->second.forkPid = fork_checkpoint();
+            if (cmdOptions.showDebugInfo)
+                msg("[+] Snapshot %u (%s) restored, switched to process %d\n", id, target->second.name.c_str(), fork_pid);
+            return true;
+        }
+        //The debuggee was killed, the snapshots don't belong to any process anymore
+        if (!is_debugger_on()) {
+            this->resetEngine();
+            return false;
+        }
+    }
+
+    /* 1 - The memory and the engines */
+    unsigned int untraced;
+    size_t written = this->walkJournals(up, down, true, untraced);
+    if (untraced > 0)
+        msg("[!] Code ran without tracing %u times on the way to %s (skipped functions, syscalls...), only the stack it wrote was restored\n", untraced, target->second.name.c_str());
+
+    /* 2 - The registers and Ponce status */
+    target->second.restoreSnapshot();
+    this->current = id;
+    this->checkBranchRestored(target->second);
+
+    if (cmdOptions.showDebugInfo)
+        msg("[+] Snapshot %u (%s) restored, %u bytes written\n", id, target->second.name.c_str(), (unsigned int)written);
+    return true;
+}
+
+/* A checkpoint is restored to negate its branch, Negate & Inject needs the branch as the last instruction */
+void SnapshotManager::checkBranchRestored(const Snapshot& snapshot) const {
+    if (!snapshot.automatic)
+        return;
+    const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+    if (last_instruction == nullptr || last_instruction->getAddress() != snapshot.address || !last_instruction->isBranch() || !last_instruction->isSymbolized()) {
+        msg("[!] The branch of %s couldn't be restored, Negate & Inject is not available there\n", snapshot.name.c_str());
+        return;
+    }
+    if (cmdOptions.showDebugInfo)
+        msg("[+] Negate & Inject is available at " MEM_FORMAT "\n", snapshot.address);
+}
+
+bool SnapshotManager::restoreSnapshot(void) {
+    for (const auto& id : this->getAncestors(this->current)) {
+        if (!this->snapshots[id].automatic)
+            return this->restoreSnapshot(id);
+    }
+    msg("[!] There isn't any snapshot taken by hand to go back to, restore a checkpoint from the snapshots window\n");
+    return false;
+}
+
+bool SnapshotManager::deleteSnapshot(unsigned int id) {
+    auto it = this->snapshots.find(id);
+    if (it == this->snapshots.end())
+        return false;
+    Snapshot& snapshot = it->second;
+
+    std::vector<unsigned int> children;
+    for (const auto& [child_id, child] : this->snapshots) {
+        if (child.parent == id)
+            children.push_back(child_id);
+    }
+    //Without a parent the children couldn't be reached from each other, or from the current state if it is the deleted one
+    if (snapshot.parent == 0 && (children.size() > 1 || (!children.empty() && id == this->current))) {
+        msg("[!] %s can't be deleted while other snapshots were taken from it\n", snapshot.name.c_str());
+        return false;
+    }
+
+    //The way to the deleted snapshot is now part of the way to its children
+    for (const auto& child_id : children) {
+        Snapshot& child = this->snapshots[child_id];
+        if (child.automatic)
+            this->checkpointsFootprint -= child.getFootprint();
+        merge_journals(child.parentDelta, snapshot.parentDelta);
+        merge_engine_journals(child.parentEngineDelta, snapshot.parentEngineDelta);
+        child.parentUntracedSpans += snapshot.parentUntracedSpans;
+        child.parent = snapshot.parent;
+        //The only child becomes the root, nothing is restored from above it
+        if (child.parent == 0) {
+            child.parentDelta.clear();
+            child.parentEngineDelta = engine_journal();
+            child.parentUntracedSpans = 0;
+        }
+        if (child.automatic)
+            this->checkpointsFootprint += child.getFootprint();
+    }
+    if (id == this->current) {
+        merge_journals(this->journal, snapshot.parentDelta);
+        merge_engine_journals(this->engineJournal, snapshot.parentEngineDelta);
+        this->untracedSpans += snapshot.parentUntracedSpans;
+        this->current = snapshot.parent;
+        if (this->current == 0) {
+            this->journal.clear();
+            this->engineJournal = engine_journal();
+            this->untracedSpans = 0;
+        }
+    }
+
+    ea_t address = snapshot.address;
+    bool automatic = snapshot.automatic;
+    if (automatic) {
+        this->checkpointsCount--;
+        this->checkpointsFootprint -= snapshot.getFootprint();
+    }
+    if (snapshot.forkPid != 0)
+        release_fork(snapshot.forkPid);
+    this->snapshots.erase(it);
+    if (!automatic)
+        this->updateComment(address);
+    if (this->snapshots.empty())
+        this->nextId = 1;
+    return true;
+}
+
+bool SnapshotManager::renameSnapshot(unsigned int id, const char* name) {
+    auto it = this->snapshots.find(id);
+    if (it == this->snapshots.end() || name == nullptr || name[0] == '\0')
+        return false;
+    it->second.name = name;
+    if (!it->second.automatic)
+        this->updateComment(it->second.address);
+    return true;
+}
+
+void SnapshotManager::resetEngine(void) {
+    if (this->snapshots.empty())
+        return;
+
+    std::set<ea_t> addresses;
+    for (const auto& [id, snapshot] : this->snapshots) {
+        if (!snapshot.automatic)
+            addresses.insert(snapshot.address);
+        if (snapshot.forkPid != 0)
+            release_fork(snapshot.forkPid);
+    }
+
+    //Drop our references to the expressions, Triton can release them
+    this->snapshots.clear();
+    this->journal.clear();
+    this->engineJournal = engine_journal();
+    this->untracedSpans = 0;
+    this->current = 0;
+    this->nextId = 1;
+    this->branchesSinceCheckpoint = 0;
+    this->checkpointsCount = 0;
+    this->checkpointsFootprint = 0;
+
+    //We delete the comments and colors that we created
+    for (const auto& address : addresses)
+        this->updateComment(address);
+}
+
+unsigned int SnapshotManager::getCurrent(void) const {
+    return this->current;
+}
+
+const Snapshot* SnapshotManager::getSnapshot(unsigned int id) const {
+    auto it = this->snapshots.find(id);
+    return it != this->snapshots.end() ? &it->second : nullptr;
+}
+
+std::vector<std::pair<unsigned int, unsigned int>> SnapshotManager::getTree(void) const {
+    std::map<unsigned int, std::vector<unsigned int>> children;
+    for (const auto& [id, snapshot] : this->snapshots)
+        children[snapshot.parent].push_back(id);
+
+    std::vector<std::pair<unsigned int, unsigned int>> tree;
+    //Depth first, the snapshot ids are the creation order
+    std::vector<std::pair<unsigned int, unsigned int>> pending;
+    for (auto it = children[0].rbegin(); it != children[0].rend(); ++it)
+        pending.emplace_back(*it, 0);
+    while (!pending.empty()) {
+        auto [id, depth] = pending.back();
+        pending.pop_back();
+        tree.emplace_back(id, depth);
+        auto it = children.find(id);
+        if (it == children.end())
+            continue;
+        for (auto child = it->second.rbegin(); child != it->second.rend(); ++child)
+            pending.emplace_back(*child, depth + 1);
+    }
+    return tree;
+}
+
+size_t SnapshotManager::getFootprint(unsigned int id) const {
+    const Snapshot* snapshot = this->getSnapshot(id);
+    if (snapshot == nullptr)
+        return 0;
+    size_t footprint = snapshot->getFootprint();
+    if (id == this->current) {
+        footprint += page_journal_footprint(this->journal);
+        footprint += engine_journal_footprint(this->engineJournal);
+    }
+    return footprint;
+}
+
+void SnapshotManager::updateComment(ea_t address) {
+    std::string names;
+    for (const auto& [id, snapshot] : this->snapshots) {
+        //The checkpoints would fill the IDB with comments
+        if (snapshot.address != address || snapshot.automatic)
+            continue;
+        if (!names.empty())
+            names += ", ";
+        names += snapshot.name;
+    }
+
+    if (names.empty()) {
+        ponce_set_cmt(address, "", false, true, false);
+        del_item_color(address);
+        return;
+    }
+    qstring comment;
+    comment.sprnt("Snapshot taken here (%s)", names.c_str());
+    ponce_set_cmt(address, comment.c_str(), false, true, false);
+    ponce_set_item_color(address, SNAPSHOT_COLOR);
+}
+
+void SnapshotManager::showComments(void) {
+    std::set<ea_t> addresses;
+    for (const auto& [id, snapshot] : this->snapshots) {
+        if (!snapshot.automatic)
+            addresses.insert(snapshot.address);
+    }
+    for (const auto& address : addresses)
+        this->updateComment(address);
+}
+
+void SnapshotManager::save(SessionWriter& writer) const {
+    writer.value<std::uint32_t>(this->current);
+    writer.value<std::uint32_t>(this->nextId);
+    writer.value<std::uint32_t>((std::uint32_t)this->snapshots.size());
+    for (const auto& [id, snapshot] : this->snapshots) {
+        snapshot.save(writer);
+        save_journal(writer, snapshot.parentDelta);
+        save_engine_journal(writer, snapshot.parentEngineDelta);
+        writer.value<std::uint32_t>(snapshot.parentUntracedSpans);
+    }
+    save_journal(writer, this->journal);
+    save_engine_journal(writer, this->engineJournal);
+    writer.value<std::uint32_t>(this->untracedSpans);
+}
+
+/* Nothing is shown or released here, the caller puts the snapshots in place once the whole session was read */
+bool SnapshotManager::load(SessionReader& reader) {
+    unsigned int current = reader.value<std::uint32_t>();
+    unsigned int nextId = reader.value<std::uint32_t>();
+    std::uint32_t count = reader.value<std::uint32_t>();
+    std::map<unsigned int, Snapshot> snapshots;
+    for (std::uint32_t i = 0; i < count && reader.ok(); i++) {
+        Snapshot snapshot;
+        if (!snapshot.load(reader) || !load_journal(reader, snapshot.parentDelta) || !load_engine_journal(reader, snapshot.parentEngineDelta))
+            return false;
+        snapshot.parentUntracedSpans = reader.value<std::uint32_t>();
+        unsigned int id = snapshot.id;
+        snapshots.emplace(id, std::move(snapshot));
+    }
+    page_journal journal;
+    engine_journal engineJournal;
+    if (!load_journal(reader, journal) || !load_engine_journal(reader, engineJournal))
+        return false;
+    unsigned int untracedSpans = reader.value<std::uint32_t>();
+    if (!reader.ok())
+        return false;
+    if (current != 0 && snapshots.count(current) == 0)
+        return false;
+
+    this->snapshots = std::move(snapshots);
+    this->journal = std::move(journal);
+    this->engineJournal = std::move(engineJournal);
+    this->untracedSpans = untracedSpans;
+    this->current = current;
+    this->nextId = nextId;
+    this->branchesSinceCheckpoint = 0;
+    this->checkpointsCount = 0;
+    this->checkpointsFootprint = 0;
+    for (const auto& [id, snapshot] : this->snapshots) {
+        if (snapshot.automatic) {
+            this->checkpointsCount++;
+            this->checkpointsFootprint += snapshot.getFootprint();
+        }
+    }
+    return true;
+}
@@ -0,0 +1,142 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <utility>
+
+//IDA
+#include <pro.h>
+
+//Ponce
+#include "snapshot.hpp"
+
+//! \class SnapshotManager
+//! \brief Tree of snapshots. Every snapshot keeps the memory written between its parent and itself, so going from one
+//! snapshot to another only writes the bytes that changed on the way.
+class SnapshotManager {
+
+private:
+    //! Snapshots indexed by id.
+    std::map<unsigned int, Snapshot> snapshots;
+
+    //! Snapshot the debuggee comes from, the journal is relative to it. 0 if there isn't any.
+    unsigned int current;
+
+    //! Id for the next snapshot.
+    unsigned int nextId;
+
+    //! Memory written since the current snapshot was taken or restored.
+    page_journal journal;
+
+    //! Changes in the engines since the current snapshot was taken or restored.
+    engine_journal engineJournal;
+
+    //! Spans of code run without tracing since the current snapshot was taken or restored.
+    unsigned int untracedSpans;
+
+    //! Symbolic branches seen since the last checkpoint.
+    unsigned int branchesSinceCheckpoint;
+
+    //! Number of checkpoints and the memory they use, kept up to date so the limits are checked without going through all of them.
+    unsigned int checkpointsCount;
+    size_t checkpointsFootprint;
+
+    //! Deletes the oldest checkpoints until they fit in the limits set by the user.
+    void trimCheckpoints(void);
+
+    //! Returns the snapshot and its ancestors, the snapshot first.
+    std::vector<unsigned int> getAncestors(unsigned int id) const;
+
+    //! Goes from the current snapshot to another one through the journals, given the snapshots up to and down from their common ancestor.
+    //! untraced is set to the spans of untraced code on the way.
+    size_t walkJournals(const std::vector<unsigned int>& up, const std::vector<unsigned int>& down, bool memory, unsigned int& untraced);
+
+    //! Tells the user if Negate & Inject can't negate the branch of a restored checkpoint.
+    void checkBranchRestored(const Snapshot& snapshot) const;
+
+    //! Writes the comment with the names of the snapshots taken at address.
+    void updateComment(ea_t address);
+
+public:
+    //! Constructor.
+    SnapshotManager();
+
+    //! Tells if any snapshot has been taken.
+    bool exists(void) const;
+
+    //! Saves the original bytes of a store about to be executed.
+    void recordStore(ea_t address, size_t size);
+
+    //! Code is going to run without tracing. The stack pages it is likely to write are saved, and written in the session, the rest of its writes are lost.
+    void recordUntracedSpan(void);
+
+    //! Saves what the engines hold for a register or some memory bytes before they are concretized, tainted or symbolized.
+    void recordEngineRegister(const triton::arch::Register& reg);
+    void recordEngineMemory(triton::uint64 address, size_t size);
+
+    //! Saves every tainted or symbolic register before all of them are concretized or untainted.
+    void recordEngineRegisters(void);
+
+    //! Saves what the disassembled instruction may overwrite in the engines, before Triton builds its semantics.
+    void recordInstruction(const triton::arch::Instruction& instruction);
+
+    //! Saves the registers and bytes the instruction wrote that recordInstruction didn't know about, after Triton processed it.
+    void recordInstructionWrites(const triton::arch::Instruction& instruction);
+
+    //! Pops the last path constraint, the current snapshot keeps it if it was there before.
+    void popPathConstraint(void);
+
+    //! Takes a snapshot at address as a child of the current one. An empty name gives it a default one. Returns its id.
+    unsigned int takeSnapshot(const char* name, ea_t address, bool automatic = false);
+
+    //! Called on every symbolic branch, takes a checkpoint every few of them if the user enabled it.
+    void symbolicBranch(ea_t address);
+
+    //! Restores any snapshot of the tree. Returns false if it doesn't exist.
+    bool restoreSnapshot(unsigned int id);
+
+    //! Restores the closest snapshot taken by hand the current state comes from, the checkpoints are skipped.
+    bool restoreSnapshot(void);
+
+    //! Deletes a snapshot, its children are attached to its parent. Returns false if it can't be deleted.
+    bool deleteSnapshot(unsigned int id);
+
+    //! Renames a snapshot.
+    bool renameSnapshot(unsigned int id, const char* name);
+
+    //! Deletes all the snapshots.
+    void resetEngine(void);
+
+    //! Returns the current snapshot, 0 if there isn't any.
+    unsigned int getCurrent(void) const;
+
+    //! Returns the snapshot with this id, nullptr if it doesn't exist.
+    const Snapshot* getSnapshot(unsigned int id) const;
+
+    //! Returns the snapshots in tree order with their depth.
+    std::vector<std::pair<unsigned int, unsigned int>> getTree(void) const;
+
+    //! Approximate memory used by a snapshot in bytes. The current one also holds the journal.
+    size_t getFootprint(unsigned int id) const;
+
+    //! Writes again the comments and colors of all the snapshots.
+    void showComments(void);
+
+    //! Writes the snapshot tree and the journal in a session file.
+    void save(SessionWriter& writer) const;
+
+    //! Reads the snapshots of a session file in an empty manager. Returns false if the file is corrupted.
+    bool load(SessionReader& reader);
+};
+
+extern SnapshotManager snapshot_manager;
@@ -1,141 +1,246 @@
 
 #include "solver.hpp"
 #include "globals.hpp"
+#include "context.hpp"
+#include "constraint_slice.hpp"
+#include "solver_pool.hpp"
+#include "utils.hpp"
 
 #include <dbg.hpp>
+#include <kernwin.hpp>
 
+solver_statistics_t solver_statistics;
 
-/* This function return a vector of Inputs. A vector is necesary since switch conditions may have multiple branch constraints*/
-std::vector<Input> solve_formula(ea_t pc, size_t path_constraint_index)
+triton::ast::SharedAbstractNode get_user_constraints(void)
 {
-    auto pathConstrains = tritonCtx.getPathConstraints();
-    std::vector<Input> solutions;
-    
-    if (path_constraint_index > pathConstrains.size() - 1) {
-        msg("Error. Requested path constraint index %u is larger than PathConstraints vector size (%lu)\n", path_constraint_index, pathConstrains.size());
-        return solutions;
-    }
-
-    // Double check that the condition at the path constraint index is at the address the user selected
-    assert(std::get<1>(pathConstrains[path_constraint_index].getBranchConstraints()[0]) == pc);
-
     auto ast = tritonCtx.getAstContext();
-    // We are going to store here the constraints for the previous conditions
     // We can not initializate this to null, so we do it to a true condition (based on code_coverage_crackme_xor.py from the triton project)
-    auto previousConstraints = ast->equal(ast->bvtrue(), ast->bvtrue());
+    auto userConstraints = ast->equal(ast->bvtrue(), ast->bvtrue());
 
     // Add user define constraints (borrar en reejecuccion, poner mensaje if not sat, 
     if (ponce_table_chooser){
         for (const auto& [id, constrain] : ponce_table_chooser->constrains) {
             for (const auto& [abstract_node_constrain, str_constrain] : constrain) {
-                previousConstraints = ast->land(previousConstraints, abstract_node_constrain);
+                userConstraints = ast->land(userConstraints, abstract_node_constrain);
             }
         }
-    }  
+    }
+    return userConstraints;
+}
 
-    // First we iterate through the previous path constrains to add the predicates of the taken path
-    unsigned int j;
-    for (j = 0; j < path_constraint_index; j++)
-    {
-        if (cmdOptions.showExtraDebugInfo)
-            msg("[+] Keeping condition %d\n", j);
+Input solution_from_model(size_t path_constraint_index, triton::uint64 srcAddr, triton::uint64 dstAddr,
+    const std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model)
+{
+    Input newinput;
+    newinput.path_constraint_index = (int)path_constraint_index;
+    newinput.dstAddr = dstAddr;
+    newinput.srcAddr = srcAddr;
 
-        // We add to the previous constraints the predicate for the taken branch 
-        auto predicate = pathConstrains[j].getTakenPredicate();
-        previousConstraints = ast->land(previousConstraints, predicate);
+    std::map<triton::usize, triton::engines::solver::SolverModel> ordered_model(model.begin(), model.end());
+    for (const auto& [symId, solver_model] : ordered_model) {
+        const auto& symbVar = solver_model.getVariable();
+        if (symbVar->getType() == triton::engines::symbolic::variable_e::MEMORY_VARIABLE) {
+            auto mem = triton::arch::MemoryAccess(symbVar->getOrigin(), symbVar->getSize() / 8);
+            newinput.memOperand.push_back(mem);
+            tritonCtx.setConcreteMemoryValue(mem, solver_model.getValue());
+        }
+        else if (symbVar->getType() == triton::engines::symbolic::variable_e::REGISTER_VARIABLE) {
+            auto reg = triton::arch::Register(*tritonCtx.getCpuInstance(), (triton::arch::register_e)symbVar->getOrigin());
+            newinput.regOperand.push_back(reg);
+            tritonCtx.setConcreteRegisterValue(reg, solver_model.getValue());
+        }
+    }
+    return newinput;
+}
+
+//Period to check if the user cancelled the formula being solved, in ms
+#define SOLVE_CANCEL_POLL_PERIOD 100
+
+//The Solve formula running in the background, there is only one at a time
+struct formula_solving {
+    ea_t pc = BADADDR;
+    std::vector<shared_solver_job> jobs;
+    size_t pending = 0;
+    bool cancelling = false;
+    solve_formula_callback done;
+    qtimer_t timer = nullptr;
+};
+
+static std::unique_ptr<formula_solving> solving;
+
+/* Prints the result of a branch, the solution is added to solutions if it is SAT*/
+static void report_solver_job(const solver_job& job, std::vector<Input>& solutions)
+{
+    if (job.cancelled) {
+        msg("[!] Solving the branch to " MEM_FORMAT " was cancelled\n", (ea_t)job.dstAddr);
+        return;
+    }
+    if (job.status == triton::engines::solver::status_e::TIMEOUT) {
+        msg("[!] Solver timed out after %u seconds\n", job.timeout);
+    }
+    else if (job.status == triton::engines::solver::status_e::UNSAT) {
+        msg("[!] That formula cannnot be solved (UNSAT)\n");
     }
 
+    else if (job.status == triton::engines::solver::status_e::SAT) {
+        Input newinput = solution_from_model(job.path_constraint_index, job.srcAddr, job.dstAddr, job.model);
+
+        // model is an std::unordered_map. Lets sort it out so results make more sense when printed
+        std::map<triton::usize, triton::engines::solver::SolverModel> ordered_model(job.model.begin(), job.model.end());
+
+        msg("[+] Solution found! Values:\n");
+        for (const auto& [symId, model] : ordered_model) {
+            triton::engines::symbolic::SharedSymbolicVariable  symbVar = tritonCtx.getSymbolicVariable(symId);
+            std::string  symbVarComment = symbVar->getComment();
+            triton::uint512 model_value = model.getValue();
+            switch (symbVar->getSize())
+            {
+            case 8:
+                msg(" - %s%s: %#02x %s\n", 
+                    model.getVariable()->getName().c_str(), 
+                    !symbVarComment.empty()? (" ("+symbVarComment+")").c_str():"",
+                    static_cast<uchar>(model_value),
+                    isprint(static_cast<uchar>(model_value)) ? ("(" + std::string(1, static_cast<uchar>(model_value)) + ")").c_str()  : "");
+                break;
+            case 16:
+                msg(" - %s%s: %#04x (%c%c)\n", 
+                    !symbVarComment.empty() ? (" (" + symbVarComment + ")").c_str() : "",
+                    symbVarComment.c_str(), 
+                    static_cast<ushort>(model_value),
+                    static_cast<uchar>(model_value) == 0 ? ' ' : static_cast<uchar>(model_value),
+                    (unsigned char)(static_cast<ushort>(model_value) >> 8) == 0 ? ' ' : (unsigned char)(static_cast<ushort>(model_value) >> 8));
+                break;
+            case 32:
+                msg(" - %s%s: %#08x\n", 
+                    !symbVarComment.empty() ? (" (" + symbVarComment + ")").c_str() : "",
+                    symbVarComment.c_str(), 
+                    static_cast<uint32>(model_value));
+                break;
+            case 64:
+                msg(" - %s%s: %#16llx\n", 
+                    model.getVariable()->getName().c_str(), 
+                    !symbVarComment.empty() ? (" (" + symbVarComment + ")").c_str() : "",
+                    static_cast<uint64>(model_value));
+                break;
+            default:
+                msg("[!] Unsupported size for the symbolic variable: %s (%s)\n", model.getVariable()->getName().c_str(), symbVarComment.c_str()); // what about 128 - 512 registers? 
+            }
+        }
+        solutions.push_back(newinput);
+    }
+    else {
+        msg("[!] You should not see this. If so report a bug :(\n");
+    }
+}
+
+static int idaapi poll_solve_cancel(void*)
+{
+    if (!solving)
+        return -1;
+    if (!solving->cancelling && user_cancelled()) {
+        solving->cancelling = true;
+        for (const auto& job : solving->jobs) {
+            if (!job->finished)
+                solver_pool_cancel(job);
+        }
+    }
+    return SOLVE_CANCEL_POLL_PERIOD;
+}
+
+static void close_solve_wait_box(formula_solving& finished)
+{
+    if (finished.timer != nullptr)
+        unregister_timer(finished.timer);
+    hide_wait_box();
+}
+
+/* In the main thread, when every branch of the formula is solved*/
+static void formula_job_done(const shared_solver_job&)
+{
+    if (!solving || --solving->pending > 0)
+        return;
+    auto finished = std::move(solving);
+    close_solve_wait_box(*finished);
+
+    std::vector<Input> solutions;
+    for (const auto& job : finished->jobs)
+        report_solver_job(*job, solutions);
+    if (finished->done)
+        finished->done(solutions);
+}
+
+/* The solutions are a vector of Inputs since switch conditions may have multiple branch constraints*/
+bool solve_formula(ea_t pc, size_t path_constraint_index, solve_formula_callback done)
+{
+    const auto& pathConstrains = tritonCtx.getPathConstraints();
+
+    if (solving) {
+        msg("[!] The formula at " MEM_FORMAT " is still being solved\n", solving->pc);
+        return false;
+    }
+    if (path_constraint_index > pathConstrains.size() - 1) {
+        msg("Error. Requested path constraint index %u is larger than PathConstraints vector size (%lu)\n", path_constraint_index, pathConstrains.size());
+        return false;
+    }
+
+    // Double check that the condition at the path constraint index is at the address the user selected
+    assert(std::get<1>(pathConstrains[path_constraint_index].getBranchConstraints()[0]) == pc);
+
+    auto ast = tritonCtx.getAstContext();
+    // We are going to store here the user defined constraints
+    auto userConstraints = get_user_constraints();
+
+    // The solver runs in the background, IDA is usable meanwhile and the wait box cancels it
+    solving = std::make_unique<formula_solving>();
+    solving->pc = pc;
+    solving->done = done;
+    show_wait_box("Solving the formula at " MEM_FORMAT, pc);
+    solving->timer = register_timer(SOLVE_CANCEL_POLL_PERIOD, poll_solve_cancel, nullptr);
+
     // Then we use the predicate for the non taken path so we "solve" that condition.
     // We try to solve every non taken branch (more than one is possible under certain situations
     for (auto const& [taken, srcAddr, dstAddr, constraint] : pathConstrains[path_constraint_index].getBranchConstraints()) {
         if (!taken) {
-            // We concatenate the previous constraints for the taken path plus the non taken constrain of the user selected condition
-            triton::ast::SharedAbstractNode final_expr = ast->land(previousConstraints, constraint);
+            // Only the previous predicates that share variables with the branch or the user constraints matter
+            auto predicates = slice_path_predicates(path_constraint_index, { constraint, userConstraints });
+
             if (cmdOptions.showExtraDebugInfo) {  
+                // We concatenate the previous constraints for the taken path plus the non taken constrain of the user selected condition
+                triton::ast::SharedAbstractNode final_expr = userConstraints;
+                for (const auto& predicate : predicates)
+                    final_expr = ast->land(final_expr, predicate);
+                final_expr = ast->land(final_expr, constraint);
                 std::stringstream ss;
                 ss << "(set-logic QF_AUFBV)" << std::endl;
                 tritonCtx.liftToSMT(ss, tritonCtx.newSymbolicExpression(final_expr), true);
                 msg("[+] Formula:\n%s\n\n", ss.str().c_str());
             }
 
-            //Time to solve
-            tritonCtx.setSolverTimeout(cmdOptions.solver_timeout * 1000);
-            triton::engines::solver::status_e solver_status;
-            auto model = tritonCtx.getModel(final_expr, &solver_status);
-            
-            if (solver_status == triton::engines::solver::status_e::TIMEOUT) {
-                msg("[!] Solver timed out after %d seconds\n", cmdOptions.solver_timeout);
-            }
-            else if (solver_status == triton::engines::solver::status_e::UNSAT) {
-                msg("[!] That formula cannnot be solved (UNSAT)\n");
-            }
-
-            else if (solver_status == triton::engines::solver::status_e::SAT) {
-                Input newinput;
-                //Clone object 
-                newinput.path_constraint_index = path_constraint_index;
-                newinput.dstAddr = dstAddr;
-                newinput.srcAddr = srcAddr;
-
-                // model is an std::unordered_map. Lets sort it out so results make more sense when printed
-                std::map<triton::usize, triton::engines::solver::SolverModel> ordered_model(model.begin(), model.end());
-
-                msg("[+] Solution found! Values:\n");
-                for (const auto& [symId, model] : ordered_model) {
-                    triton::engines::symbolic::SharedSymbolicVariable  symbVar = tritonCtx.getSymbolicVariable(symId);
-                    std::string  symbVarComment = symbVar->getComment();
-                    triton::uint512 model_value = model.getValue();
-                    if (symbVar->getType() == triton::engines::symbolic::variable_e::MEMORY_VARIABLE) {
-                        auto mem = triton::arch::MemoryAccess(symbVar->getOrigin(), symbVar->getSize() / 8);
-                        newinput.memOperand.push_back(mem);
-                        tritonCtx.setConcreteMemoryValue(mem, model_value);
-                    }
-                    else if (symbVar->getType() == triton::engines::symbolic::variable_e::REGISTER_VARIABLE) {
-                        auto reg = triton::arch::Register(*tritonCtx.getCpuInstance(), (triton::arch::register_e)symbVar->getOrigin());
-                        newinput.regOperand.push_back(reg);
-                        tritonCtx.setConcreteRegisterValue(reg, model_value);
-                    }
-                    switch (symbVar->getSize())
-                    {
-                    case 8:
-                        msg(" - %s%s: %#02x %s\n", 
-                            model.getVariable()->getName().c_str(), 
-                            !symbVarComment.empty()? (" ("+symbVarComment+")").c_str():"",
-                            static_cast<uchar>(model_value),
-                            isprint(static_cast<uchar>(model_value)) ? ("(" + std::string(1, static_cast<uchar>(model_value)) + ")").c_str()  : "");
-                        break;
-                    case 16:
-                        msg(" - %s%s: %#04x (%c%c)\n", 
-                            !symbVarComment.empty() ? (" (" + symbVarComment + ")").c_str() : "",
-                            symbVarComment.c_str(), 
-                            static_cast<ushort>(model_value),
-                            static_cast<uchar>(model_value) == 0 ? ' ' : static_cast<uchar>(model_value),
-                            (unsigned char)(static_cast<ushort>(model_value) >> 8) == 0 ? ' ' : (unsigned char)(static_cast<ushort>(model_value) >> 8));
-                        break;
-                    case 32:
-                        msg(" - %s%s: %#08x\n", 
-                            !symbVarComment.empty() ? (" (" + symbVarComment + ")").c_str() : "",
-                            symbVarComment.c_str(), 
-                            static_cast<uint32>(model_value));
-                        break;
-                    case 64:
-                        msg(" - %s%s: %#16llx\n", 
-                            model.getVariable()->getName().c_str(), 
-                            !symbVarComment.empty() ? (" (" + symbVarComment + ")").c_str() : "",
-                            static_cast<uint64>(model_value));
-                        break;
-                    default:
-                        msg("[!] Unsupported size for the symbolic variable: %s (%s)\n", model.getVariable()->getName().c_str(), symbVarComment.c_str()); // what about 128 - 512 registers? 
-                    }
-                }
-                solutions.push_back(newinput);
-            }
-            else {
-                msg("[!] You should not see this. If so report a bug :(\n");
-            }
+            auto job = std::make_shared<solver_job>();
+            job->path_constraint_index = path_constraint_index;
+            job->srcAddr = srcAddr;
+            job->dstAddr = dstAddr;
+            solving->jobs.push_back(job);
+            solving->pending++;
+            //The job is always delivered later, from the UI loop
+            solver_pool_submit(job, userConstraints, predicates, constraint, formula_job_done);
         }
     }
-    return solutions;
+
+    if (solving->jobs.empty()) {
+        close_solve_wait_box(*solving);
+        solving.reset();
+        return false;
+    }
+    return true;
+}
+
+void solve_formula_reset(void)
+{
+    if (!solving)
+        return;
+    close_solve_wait_box(*solving);
+    solving.reset();
 }
 
 
@@ -145,6 +250,11 @@ Probably it is possible to do this with the solver, adding more variable to the
 identify the flag of the conditions and get the values. But for now we are doing it in this way.*/
 void negate_flag_condition(triton::arch::Instruction* triton_instruction)
 {
+    if (triton_instruction == nullptr) {
+        msg("[!] There is no instruction to negate\n");
+        return;
+    }
+
     switch (triton_instruction->getType())
     {
     case triton::arch::x86::ID_INS_JA:
@@ -348,6 +458,8 @@ void negate_flag_condition(triton::arch::Instruction* triton_instruction)
     default:
         msg("[!] We cannot negate %s instruction\n", triton_instruction->getDisassembly().c_str());
     }
+    // The flags changed, they need to be read again
+    invalidate_register_cache();
 }
 
 
@@ -357,6 +469,8 @@ void set_SMT_solution(const Input& solution) {
     for (const auto& mem : solution.memOperand){
         auto concreteValue = tritonCtx.getConcreteMemoryValue(mem, false);
         put_bytes((ea_t)mem.getAddress(), &concreteValue, mem.getSize());
+        instruction_cache.invalidate((ea_t)mem.getAddress(), mem.getSize());
+        memory_cache.invalidate((ea_t)mem.getAddress(), mem.getSize());
         tritonCtx.setConcreteMemoryValue(mem, concreteValue);
 
         if (cmdOptions.showExtraDebugInfo){
@@ -376,6 +490,7 @@ void set_SMT_solution(const Input& solution) {
     for (const auto& reg : solution.regOperand) {
         auto concreteRegValue = tritonCtx.getConcreteRegisterValue(reg, false);
         set_reg_val(reg.getName().c_str(), static_cast<uint64>(concreteRegValue));
+        invalidate_register_cache();
         tritonCtx.setConcreteRegisterValue(reg, concreteRegValue);
 
         if (cmdOptions.showExtraDebugInfo) {
@@ -398,42 +513,49 @@ void set_SMT_solution(const Input& solution) {
 
 
 void negate_inject_maybe_restore_solver(ea_t pc, int path_constraint_index, bool restore) {
-    auto solutions = solve_formula(pc, path_constraint_index);
-
-    Input* chosen_solution = nullptr;
-    if (solutions.size() > 0) {
-        if (solutions.size() == 1) {
-            chosen_solution = &solutions[0];
-            triton::ast::SharedAbstractNode new_constraint;
-            for (auto& [taken, srcAddr, dstAddr, constraint] : tritonCtx.getPathConstraints().back().getBranchConstraints()) {
-                // Let's look for the constraint we have force to take wich is the a priori not taken one
-                if (!taken) {
-                    new_constraint = constraint;
-                    break;
-                }
-            }
-            // Once found we first pop the last path constraint
-            tritonCtx.popPathConstraint();
-            // And replace it for the found previously
-            tritonCtx.pushPathConstraint(new_constraint);
+    solve_formula(pc, path_constraint_index, [pc, restore](std::vector<Input>& solutions) {
+        // The user may have continued the process while the formula was solved
+        const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+        if (!solutions.empty() && (!is_debugger_on() || last_instruction == nullptr || last_instruction->getAddress() != pc)) {
+            msg("[!] The process is not at " MEM_FORMAT " anymore, the solution is not injected\n", pc);
+            return;
         }
-        else {
-            // ToDo: what do we do if we are in a switch case and get several solutions? Just using the first one? Ask the user?
-            for (const auto& solution : solutions) {
-                // ask the user where he wants to go in popup or even better in the contextual menu
-                // chosen_solution = &solutions[0];
-                //We need to modify the last path constrain from tritonCtx.getPathConstraints()
+
+        Input* chosen_solution = nullptr;
+        if (solutions.size() > 0) {
+            if (solutions.size() == 1) {
+                chosen_solution = &solutions[0];
+                triton::ast::SharedAbstractNode new_constraint;
                 for (auto& [taken, srcAddr, dstAddr, constraint] : tritonCtx.getPathConstraints().back().getBranchConstraints()) {
+                    // Let's look for the constraint we have force to take wich is the a priori not taken one
                     if (!taken) {
+                        new_constraint = constraint;
+                        break;
+                    }
+                }
+                // Once found we first pop the last path constraint
+                snapshot_manager.popPathConstraint();
+                // And replace it for the found previously
+                tritonCtx.pushPathConstraint(new_constraint);
+            }
+            else {
+                // ToDo: what do we do if we are in a switch case and get several solutions? Just using the first one? Ask the user?
+                for (const auto& solution : solutions) {
+                    // ask the user where he wants to go in popup or even better in the contextual menu
+                    // chosen_solution = &solutions[0];
+                    //We need to modify the last path constrain from tritonCtx.getPathConstraints()
+                    for (auto& [taken, srcAddr, dstAddr, constraint] : tritonCtx.getPathConstraints().back().getBranchConstraints()) {
+                        if (!taken) {
 
+                        }
                     }
                 }
             }
+            // We negate necesary flags to go over the other branch
+            negate_flag_condition(last_triton_instructions.last());
+            if (restore)
+                snapshot_manager.restoreSnapshot();
+            set_SMT_solution(*chosen_solution);
         }
-        // We negate necesary flags to go over the other branch
-        negate_flag_condition(ponce_runtime_status.last_triton_instruction);
-        if (restore)
-            snapshot.restoreSnapshot();
-        set_SMT_solution(*chosen_solution);
-    }
-}
\ No newline at end of file
+    });
+}
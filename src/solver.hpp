@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
 #include <vector>
 
 #include <triton/context.hpp>
@@ -29,5 +32,33 @@ public:
 };
 
 
-std::vector<Input> solve_formula(ea_t pc, size_t path_constraint_index);
+//Counters of the queries solved, shown in the progress panel
+struct solver_statistics_t {
+    std::uint64_t queries = 0;
+    // Queries answered by the solver and the milliseconds it took
+    std::uint64_t solver_calls = 0;
+    std::uint64_t solver_time = 0;
+    // Queries answered without the solver
+    std::uint64_t cache_hits = 0;
+    std::uint64_t model_reuse_hits = 0;
+};
+
+extern solver_statistics_t solver_statistics;
+
+//! The constraints the user added in the symbolic variables window, true if there are none.
+triton::ast::SharedAbstractNode get_user_constraints(void);
+//! Loads a model in the Triton context, the Input returned is what set_SMT_solution writes in the process.
+Input solution_from_model(size_t path_constraint_index, triton::uint64 srcAddr, triton::uint64 dstAddr,
+    const std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model);
+
+//! Called in the main thread with the solutions of a formula, empty if it was not solved or it was cancelled.
+typedef std::function<void(std::vector<Input>& solutions)> solve_formula_callback;
+
+//! Solves the non taken branches of a path constraint in the background while a cancellable wait box is shown. The
+//! solutions are printed and passed to done. Returns false if the formula could not be queued.
+bool solve_formula(ea_t pc, size_t path_constraint_index, solve_formula_callback done);
+//! Closes the wait box of the formula being solved, its result is not delivered.
+void solve_formula_reset(void);
+//! Writes the values of a solution in the memory and registers of the process.
+void set_SMT_solution(const Input& solution);
 void negate_inject_maybe_restore_solver(ea_t pc, int path_constraint_index, bool restore);
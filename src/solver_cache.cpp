@@ -0,0 +1,269 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <utility>
+
+//IDA
+#include <ida.hpp>
+#include <nalt.hpp>
+#include <loader.hpp>
+
+//Ponce
+#include "solver_cache.hpp"
+#include "globals.hpp"
+#include "serialization.hpp"
+
+//Verdict of a query. The model values are by the number of the variable in the query
+struct cached_verdict {
+    triton::engines::solver::status_e status;
+    //Timeout in seconds when it timed out
+    std::uint32_t timeout;
+    std::vector<std::pair<std::uint32_t, triton::uint512>> model;
+};
+
+//Entries kept, the cache is emptied when it has more
+#define MAX_CACHED_QUERIES 100000
+
+static const char solver_cache_magic[8] = { 'P', 'O', 'N', 'C', 'E', 'Q', 'R', 'Y' };
+static const std::uint32_t solver_cache_version = 1;
+
+static std::map<std::pair<std::uint64_t, std::uint64_t>, cached_verdict> solver_cache;
+
+//The file is read the first time the cache is used, and written if something was added
+static bool solver_cache_loaded = false;
+static bool solver_cache_dirty = false;
+
+/* Two different mixes so the 128 bits don't collide together */
+static void hash_combine(std::uint64_t hash[2], std::uint64_t value)
+{
+    std::uint64_t x = hash[0] ^ (value + 0x9E3779B97F4A7C15ull);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    hash[0] = x ^ (x >> 31);
+    hash[1] = (hash[1] ^ value) * 0x100000001B3ull + (hash[1] >> 17);
+}
+
+static void hash_integer(std::uint64_t hash[2], const triton::uint512& value)
+{
+    triton::uint512 rest = value;
+    do {
+        hash_combine(hash, static_cast<std::uint64_t>(rest & triton::uint512(0xFFFFFFFFFFFFFFFFull)));
+        rest >>= 64;
+    } while (rest != 0);
+}
+
+/* Post order without recursion. The referenced expressions are hashed as part of the query, the variables are numbered
+when they are found for the first time */
+solver_query make_solver_query(const std::vector<triton::ast::SharedAbstractNode>& formulas)
+{
+    solver_query query;
+    std::unordered_map<const triton::ast::AbstractNode*, std::pair<std::uint64_t, std::uint64_t>> hashes;
+    std::unordered_map<triton::usize, std::uint32_t> numbers;
+
+    auto children_of = [](triton::ast::AbstractNode* node) {
+        std::vector<triton::ast::AbstractNode*> children;
+        if (node->getType() == triton::ast::REFERENCE_NODE)
+            children.push_back(static_cast<triton::ast::ReferenceNode*>(node)->getSymbolicExpression()->getAst().get());
+        else if (node->getType() != triton::ast::VARIABLE_NODE)
+            for (const auto& child : node->getChildren())
+                children.push_back(child.get());
+        return children;
+    };
+
+    for (const auto& formula : formulas) {
+        std::vector<std::pair<triton::ast::AbstractNode*, bool>> pending = { { formula.get(), false } };
+        while (!pending.empty()) {
+            auto [node, expanded] = pending.back();
+            pending.pop_back();
+            if (hashes.count(node) != 0)
+                continue;
+            auto children = children_of(node);
+            if (!expanded) {
+                pending.emplace_back(node, true);
+                for (auto it = children.rbegin(); it != children.rend(); ++it)
+                    pending.emplace_back(*it, false);
+                continue;
+            }
+
+            std::uint64_t hash[2] = { 0, 0 };
+            hash_combine(hash, node->getType());
+            hash_combine(hash, node->isLogical() ? 0 : node->getBitvectorSize());
+            switch (node->getType()) {
+            case triton::ast::INTEGER_NODE:
+                hash_integer(hash, static_cast<triton::ast::IntegerNode*>(node)->getInteger());
+                break;
+            case triton::ast::STRING_NODE:
+                for (const auto& c : static_cast<triton::ast::StringNode*>(node)->getString())
+                    hash_combine(hash, (std::uint8_t)c);
+                break;
+            case triton::ast::VARIABLE_NODE: {
+                const auto& variable = static_cast<triton::ast::VariableNode*>(node)->getSymbolicVariable();
+                auto number = numbers.emplace(variable->getId(), (std::uint32_t)query.variables.size());
+                if (number.second)
+                    query.variables.push_back(variable);
+                hash_combine(hash, number.first->second);
+                break;
+            }
+            default:
+                break;
+            }
+            for (const auto& child : children) {
+                const auto& child_hash = hashes[child];
+                hash_combine(hash, child_hash.first);
+                hash_combine(hash, child_hash.second);
+            }
+            hashes[node] = { hash[0], hash[1] };
+        }
+        const auto& formula_hash = hashes[formula.get()];
+        hash_combine(query.hash, formula_hash.first);
+        hash_combine(query.hash, formula_hash.second);
+    }
+    hash_combine(query.hash, formulas.size());
+    return query;
+}
+
+static qstring solver_cache_path(void)
+{
+    char path[QMAXPATH];
+    set_file_ext(path, sizeof(path), get_path(PATH_TYPE_IDB), "ponce_cache");
+    return qstring(path);
+}
+
+/* A corrupted file is ignored, the queries are solved again. It is only read once the user wants to keep the cache, the
+queries solved before in this session are merged with it and win over the ones in the file */
+static void solver_cache_load(void)
+{
+    if (!cmdOptions.persist_solver_cache)
+        return;
+    solver_cache_loaded = true;
+    qstring path = solver_cache_path();
+    std::ifstream cache_file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!cache_file.is_open())
+        return;
+
+    char magic[sizeof(solver_cache_magic)] = {};
+    std::uint32_t version = 0, count = 0;
+    cache_file.read(magic, sizeof(magic));
+    if (!read_value(cache_file, version) || !read_value(cache_file, count) || memcmp(magic, solver_cache_magic, sizeof(magic)) != 0 || version != solver_cache_version) {
+        msg("[!] %s is not a solver cache of this version of Ponce\n", path.c_str());
+        return;
+    }
+    std::uint32_t read = 0;
+    for (std::uint32_t i = 0; i < count && solver_cache.size() < MAX_CACHED_QUERIES; i++) {
+        std::uint64_t hash[2];
+        std::uint8_t status;
+        std::uint32_t values;
+        cached_verdict verdict;
+        if (!read_value(cache_file, hash[0]) || !read_value(cache_file, hash[1]) || !read_value(cache_file, status) ||
+            !read_value(cache_file, verdict.timeout) || !read_value(cache_file, values))
+            break;
+        verdict.status = (triton::engines::solver::status_e)status;
+        for (std::uint32_t j = 0; j < values && cache_file; j++) {
+            std::uint32_t number;
+            triton::uint512 value;
+            if (read_value(cache_file, number) && read_integer(cache_file, value))
+                verdict.model.emplace_back(number, value);
+        }
+        if (!cache_file)
+            break;
+        solver_cache.emplace(std::make_pair(hash[0], hash[1]), std::move(verdict));
+        read++;
+    }
+    if (cmdOptions.showDebugInfo)
+        msg("[+] %u solved queries read from %s\n", read, path.c_str());
+}
+
+bool solver_cache_lookup(const solver_query& query, std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model, triton::engines::solver::status_e& status)
+{
+    if (!solver_cache_loaded)
+        solver_cache_load();
+    auto it = solver_cache.find({ query.hash[0], query.hash[1] });
+    if (it == solver_cache.end())
+        return false;
+    const cached_verdict& verdict = it->second;
+    //With more time it may be solved
+    if (verdict.status == triton::engines::solver::status_e::TIMEOUT && cmdOptions.solver_timeout > verdict.timeout)
+        return false;
+    for (const auto& [number, value] : verdict.model) {
+        if (number >= query.variables.size())
+            return false;
+    }
+
+    status = verdict.status;
+    model.clear();
+    for (const auto& [number, value] : verdict.model) {
+        const auto& variable = query.variables[number];
+        model.emplace(variable->getId(), triton::engines::solver::SolverModel(variable, value));
+    }
+    if (cmdOptions.showExtraDebugInfo)
+        msg("[+] Query found in the solver cache\n");
+    return true;
+}
+
+void solver_cache_store(const solver_query& query, const std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model, triton::engines::solver::status_e status)
+{
+    //Nothing to remember if the solver didn't say anything
+    if (status != triton::engines::solver::status_e::SAT && status != triton::engines::solver::status_e::UNSAT && status != triton::engines::solver::status_e::TIMEOUT)
+        return;
+    if (!solver_cache_loaded)
+        solver_cache_load();
+    if (solver_cache.size() >= MAX_CACHED_QUERIES)
+        solver_cache.clear();
+
+    std::unordered_map<triton::usize, std::uint32_t> numbers;
+    for (std::uint32_t i = 0; i < query.variables.size(); i++)
+        numbers[query.variables[i]->getId()] = i;
+
+    cached_verdict verdict;
+    verdict.status = status;
+    verdict.timeout = (std::uint32_t)cmdOptions.solver_timeout;
+    for (const auto& [id, solver_model] : model) {
+        auto number = numbers.find(id);
+        if (number != numbers.end())
+            verdict.model.emplace_back(number->second, solver_model.getValue());
+    }
+    solver_cache[{ query.hash[0], query.hash[1] }] = std::move(verdict);
+    solver_cache_dirty = true;
+}
+
+void solver_cache_save(void)
+{
+    if (!cmdOptions.persist_solver_cache || !solver_cache_dirty)
+        return;
+    //The persistence may have been enabled after the last query, the file is not overwritten without its queries
+    if (!solver_cache_loaded)
+        solver_cache_load();
+    qstring path = solver_cache_path();
+    std::ofstream cache_file(path.c_str(), std::ios::out | std::ios::binary);
+    if (!cache_file.is_open()) {
+        msg("[!] Error opening the solver cache %s\n", path.c_str());
+        return;
+    }
+    cache_file.write(solver_cache_magic, sizeof(solver_cache_magic));
+    write_value<std::uint32_t>(cache_file, solver_cache_version);
+    write_value<std::uint32_t>(cache_file, (std::uint32_t)solver_cache.size());
+    for (const auto& [hash, verdict] : solver_cache) {
+        write_value<std::uint64_t>(cache_file, hash.first);
+        write_value<std::uint64_t>(cache_file, hash.second);
+        write_value<std::uint8_t>(cache_file, (std::uint8_t)verdict.status);
+        write_value<std::uint32_t>(cache_file, verdict.timeout);
+        write_value<std::uint32_t>(cache_file, (std::uint32_t)verdict.model.size());
+        for (const auto& [number, value] : verdict.model) {
+            write_value<std::uint32_t>(cache_file, number);
+            write_integer(cache_file, value);
+        }
+    }
+    solver_cache_dirty = false;
+    if (cmdOptions.showDebugInfo)
+        msg("[+] %u solved queries written to %s\n", (unsigned int)solver_cache.size(), path.c_str());
+}
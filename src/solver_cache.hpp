@@ -0,0 +1,41 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//Triton
+#include <triton/context.hpp>
+#include <triton/ast.hpp>
+
+/*Solver cache: the verdicts and models of the queries solved, by a hash of the query. The variables are numbered in the
+order they are found in the query, so the same formula over other variables (after restarting the process, for
+instance) has the same hash. The models are kept by that number and given to the variables of the new query.*/
+
+//! A query ready to look up: its hash and its variables in the order they were numbered.
+struct solver_query {
+    std::uint64_t hash[2] = {};
+    std::vector<triton::engines::symbolic::SharedSymbolicVariable> variables;
+};
+
+//! Hashes the conjunction of the formulas, in this order.
+solver_query make_solver_query(const std::vector<triton::ast::SharedAbstractNode>& formulas);
+
+//! Returns true if the query was solved before. A timeout is only returned if the timeout now is not longer.
+bool solver_cache_lookup(const solver_query& query, std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model, triton::engines::solver::status_e& status);
+
+//! Remembers the verdict of a query, and its model if it is SAT.
+void solver_cache_store(const solver_query& query, const std::unordered_map<triton::usize, triton::engines::solver::SolverModel>& model, triton::engines::solver::status_e status);
+
+//! Writes the cache next to the IDB if the user wants to keep it.
+void solver_cache_save(void);
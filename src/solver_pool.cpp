@@ -0,0 +1,519 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+//IDA
+#include <ida.hpp>
+#include <kernwin.hpp>
+
+//Ponce
+#include "solver_pool.hpp"
+#include "solver.hpp"
+#include "model_reuse.hpp"
+#include "globals.hpp"
+#include "utils.hpp"
+
+//Z3
+#include <z3++.h>
+
+//Triton
+#include <triton/tritonToZ3Ast.hpp>
+
+//The solver configurations of the portfolio. Without the portfolio only the first one is used
+struct solver_config {
+    const char* name;
+    // Queries it answered first, only counted when the configurations raced
+    unsigned int wins;
+    // The solver is kept between the queries, the tactics solve everything again in every check so they start afresh
+    bool incremental;
+};
+
+static solver_config portfolio_configs[] = {
+    { "Z3", 0, true },
+    { "Z3 QF_BV", 0, true },
+    { "Z3 bit-blasting", 0, false },
+};
+
+//A taken predicate converted to SMT-LIB, only once in the main thread. Every worker parses it and asserts it once
+struct pool_predicate {
+    std::uint64_t id;
+    std::string smtlib;
+};
+
+typedef std::shared_ptr<const pool_predicate> shared_pool_predicate;
+
+//A job being solved, by one attempt or by one attempt per configuration in portfolio mode
+struct pool_job {
+    shared_solver_job job;
+    solver_job_callback done;
+    // Attempts queued or running
+    size_t remaining = 0;
+    size_t attempts = 0;
+    // Set when the result of the job is known, the attempts left are interrupted
+    bool decided = false;
+    bool timed_out = false;
+    // False if the answer came from the cache or a previous model
+    bool from_solver = false;
+    // Configuration that answered first, -1 if none gave a definitive answer
+    int winner = -1;
+    // Error of the solver, printed when the job is delivered
+    std::string error;
+    // What the workers solve: the taken predicates and the user constraints with the branch to take, in SMT-LIB
+    std::vector<shared_pool_predicate> predicates;
+    std::string formula;
+    // The variables of the query by their name in the formulas
+    std::unordered_map<std::string, triton::engines::symbolic::SharedSymbolicVariable> variables;
+};
+
+typedef std::shared_ptr<pool_job> shared_pool_job;
+
+//An attempt at a job with one configuration
+struct pool_entry {
+    shared_pool_job owner;
+    unsigned int config = 0;
+    triton::engines::solver::status_e status = triton::engines::solver::status_e::UNKNOWN;
+    std::unordered_map<triton::usize, triton::engines::solver::SolverModel> model;
+    std::uint64_t time = 0;
+    std::string error;
+    // The context of the worker solving it, set while it is running
+    z3::context* context = nullptr;
+};
+
+typedef std::shared_ptr<pool_entry> shared_pool_entry;
+
+//Everything below is protected by pool_mutex
+static std::mutex pool_mutex;
+static std::condition_variable pool_condition;
+static std::deque<shared_pool_entry> queued;
+static std::vector<shared_pool_entry> running;
+static std::vector<shared_pool_job> finished;
+static std::vector<std::thread> workers;
+static bool stopping = false;
+//Id of the execute_sync request that delivers the finished jobs, -1 if there is none
+static int delivery_request = -1;
+
+//Only used in the main thread. The predicates converted, by their node, which is kept so the address isn't reused
+static std::unique_ptr<triton::ast::TritonToZ3> main_converter;
+static std::unordered_map<const triton::ast::AbstractNode*, std::pair<triton::ast::SharedAbstractNode, shared_pool_predicate>> converted_predicates;
+static std::uint64_t next_predicate_id = 0;
+
+static void deliver_finished(void);
+
+struct solver_delivery_request_t : public exec_request_t {
+    virtual ssize_t idaapi execute(void) override {
+        deliver_finished();
+        return 0;
+    }
+};
+
+//Called with pool_mutex held
+static void request_delivery(void)
+{
+    if (delivery_request == -1)
+        delivery_request = execute_sync(*new solver_delivery_request_t(), MFF_WRITE | MFF_NOWAIT);
+}
+
+//Called with pool_mutex held
+static void finish(const shared_pool_job& owner)
+{
+    owner->decided = true;
+    finished.push_back(owner);
+    request_delivery();
+}
+
+//Called with pool_mutex held. The queued attempts of the job are dropped and the running ones interrupted
+static void drop_attempts(const shared_pool_job& owner)
+{
+    auto end = std::remove_if(queued.begin(), queued.end(), [&](const shared_pool_entry& entry) { return entry->owner == owner; });
+    owner->remaining -= std::distance(end, queued.end());
+    queued.erase(end, queued.end());
+    //Z3 allows to interrupt a context from another thread
+    for (const auto& entry : running) {
+        if (entry->owner == owner)
+            entry->context->interrupt();
+    }
+}
+
+/* Called with pool_mutex held when an attempt finishes. The first SAT or UNSAT answer is the result of the job, if no
+attempt gives one the job finishes with the last of them */
+static void attempt_done(const shared_pool_entry& entry)
+{
+    auto& owner = *entry->owner;
+    owner.remaining--;
+    if (owner.decided)
+        return;
+    if (!entry->error.empty() && owner.error.empty())
+        owner.error = entry->error;
+    if (entry->status == triton::engines::solver::status_e::TIMEOUT)
+        owner.timed_out = true;
+
+    bool definitive = entry->status == triton::engines::solver::status_e::SAT || entry->status == triton::engines::solver::status_e::UNSAT;
+    if (!definitive && owner.remaining > 0)
+        return;
+
+    auto& job = *owner.job;
+    if (definitive) {
+        job.status = entry->status;
+        owner.winner = (int)entry->config;
+    }
+    else {
+        job.status = owner.timed_out ? triton::engines::solver::status_e::TIMEOUT : triton::engines::solver::status_e::UNKNOWN;
+    }
+    job.model = std::move(entry->model);
+    job.time = entry->time;
+    drop_attempts(entry->owner);
+    finish(entry->owner);
+}
+
+/* In the main thread. The answers of the solver go to the cache and the statistics before the callbacks see them */
+static void deliver_finished(void)
+{
+    std::vector<shared_pool_job> owners;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        delivery_request = -1;
+        owners.swap(finished);
+    }
+    for (const auto& owner : owners) {
+        auto& job = *owner->job;
+        if (!owner->error.empty())
+            msg("[!] Solver error: %s\n", owner->error.c_str());
+        if (owner->from_solver && !job.cancelled) {
+            solver_statistics.solver_calls++;
+            solver_statistics.solver_time += job.time;
+            solver_cache_store(job.query, job.model, job.status);
+            if (job.status == triton::engines::solver::status_e::SAT)
+                model_reuse_store(job.model);
+            if (owner->attempts > 1 && owner->winner != -1) {
+                portfolio_configs[owner->winner].wins++;
+                if (cmdOptions.showExtraDebugInfo)
+                    msg("[+] %s answered first in %u ms\n", portfolio_configs[owner->winner].name, (unsigned int)job.time);
+            }
+        }
+        job.finished = true;
+        if (owner->done)
+            owner->done(owner->job);
+    }
+}
+
+//The configurations by their wins, the first one is the default
+static std::vector<unsigned int> portfolio_order(void)
+{
+    std::vector<unsigned int> order;
+    for (unsigned int i = 0; i < qnumber(portfolio_configs); i++)
+        order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), [](unsigned int a, unsigned int b) { return portfolio_configs[a].wins > portfolio_configs[b].wins; });
+    return order;
+}
+
+std::vector<std::pair<std::string, unsigned int>> solver_portfolio_ranking(void)
+{
+    std::vector<std::pair<std::string, unsigned int>> ranking;
+    for (auto config : portfolio_order())
+        ranking.emplace_back(portfolio_configs[config].name, portfolio_configs[config].wins);
+    return ranking;
+}
+
+static z3::solver make_solver(z3::context& context, unsigned int config)
+{
+    switch (config) {
+    case 1:
+        //The solver for quantifier free bit-vector formulas
+        return z3::solver(context, "QF_BV");
+    case 2:
+        //Simplified and bit-blasted to a SAT problem
+        return (z3::tactic(context, "simplify") & z3::tactic(context, "solve-eqs") & z3::tactic(context, "bit-blast") & z3::tactic(context, "sat")).mk_solver();
+    default:
+        return z3::solver(context);
+    }
+}
+
+//A solver of a worker and the predicates asserted in it
+struct worker_solver {
+    z3::solver solver;
+    std::unordered_set<std::uint64_t> asserted;
+};
+
+/* The Z3 context of a worker, it lives as long as the worker. Each predicate is parsed once, and asserted once in each
+incremental solver as implied by an indicator. A query assumes the indicators of its predicates, so the solver keeps
+what it learnt about them, and its branch is asserted in a scope that is popped afterwards. The members are destroyed
+before the context */
+struct worker_state {
+    z3::context context;
+    // The indicator and the formula of the predicates parsed, by their id
+    std::unordered_map<std::uint64_t, std::pair<z3::expr, z3::expr>> predicates;
+    std::optional<worker_solver> solvers[qnumber(portfolio_configs)];
+};
+
+/* In a worker. Only the Z3 context of the worker is used */
+static void solve_entry(worker_state& state, pool_entry& entry, unsigned int timeout)
+{
+    std::uint64_t start = GetTimeMs64();
+    const auto& owner = *entry.owner;
+    auto& kept = state.solvers[entry.config];
+    bool incremental = portfolio_configs[entry.config].incremental;
+    try {
+        z3::context& context = state.context;
+        if (!kept)
+            kept.emplace(worker_solver{ make_solver(context, entry.config), {} });
+        z3::solver& solver = kept->solver;
+
+        z3::expr_vector assumptions(context);
+        for (const auto& predicate : owner.predicates) {
+            auto parsed = state.predicates.find(predicate->id);
+            if (parsed == state.predicates.end()) {
+                z3::expr indicator = context.bool_const(("ponce_predicate_" + std::to_string(predicate->id)).c_str());
+                parsed = state.predicates.emplace(predicate->id, std::make_pair(indicator, z3::mk_and(context.parse_string(predicate->smtlib.c_str())))).first;
+            }
+            const auto& [indicator, formula] = parsed->second;
+            if (!incremental)
+                solver.add(formula);
+            else {
+                if (kept->asserted.insert(predicate->id).second)
+                    solver.add(z3::implies(indicator, formula));
+                assumptions.push_back(indicator);
+            }
+        }
+
+        z3::params params(context);
+        params.set("timeout", timeout * 1000);
+        solver.set(params);
+        solver.push();
+        solver.add(z3::mk_and(context.parse_string(owner.formula.c_str())));
+
+        switch (solver.check(assumptions)) {
+        case z3::sat: {
+            entry.status = triton::engines::solver::status_e::SAT;
+            z3::model z3_model = solver.get_model();
+            for (unsigned int i = 0; i < z3_model.num_consts(); i++) {
+                z3::func_decl decl = z3_model.get_const_decl(i);
+                auto variable = owner.variables.find(decl.name().str());
+                if (variable == owner.variables.end())
+                    continue;
+                triton::uint512 value(Z3_get_numeral_string(context, z3_model.get_const_interp(decl)));
+                entry.model.emplace(variable->second->getId(), triton::engines::solver::SolverModel(variable->second, value));
+            }
+            break;
+        }
+        case z3::unsat:
+            entry.status = triton::engines::solver::status_e::UNSAT;
+            break;
+        default:
+            entry.status = solver.reason_unknown() == "timeout" ? triton::engines::solver::status_e::TIMEOUT : triton::engines::solver::status_e::UNKNOWN;
+        }
+        solver.pop();
+        if (!incremental)
+            kept.reset();
+    }
+    catch (const z3::exception& e) {
+        //The solver may be left in the scope of the branch, it is built again for the next query
+        kept.reset();
+        entry.status = triton::engines::solver::status_e::UNKNOWN;
+        entry.model.clear();
+        entry.error = e.msg();
+    }
+    entry.time = GetTimeMs64() - start;
+}
+
+static void worker_loop(void)
+{
+    worker_state state;
+    for (;;) {
+        shared_pool_entry entry;
+        unsigned int timeout;
+        {
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            pool_condition.wait(lock, [] { return stopping || !queued.empty(); });
+            if (stopping)
+                return;
+            entry = queued.front();
+            queued.pop_front();
+            entry->context = &state.context;
+            running.push_back(entry);
+            timeout = entry->owner->job->timeout;
+        }
+
+        solve_entry(state, *entry, timeout);
+
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        running.erase(std::find(running.begin(), running.end(), entry));
+        if (stopping)
+            return;
+        attempt_done(entry);
+    }
+}
+
+//Called with pool_mutex held. A core is left for IDA
+static void start_workers(void)
+{
+    if (!workers.empty())
+        return;
+    unsigned int count = std::thread::hardware_concurrency();
+    count = count > 2 ? count - 1 : 1;
+    for (unsigned int i = 0; i < count; i++)
+        workers.emplace_back(worker_loop);
+    if (cmdOptions.showDebugInfo)
+        msg("[+] %u solver threads started\n", count);
+}
+
+//Main thread. The workers get the formulas in SMT-LIB and parse them in their own context
+static std::string to_smtlib(const z3::expr& formula)
+{
+    Z3_string smtlib = Z3_benchmark_to_smtlib_string(main_converter->context, "", "", "unknown", "", 0, nullptr, formula);
+    main_converter->context.check_error();
+    return smtlib;
+}
+
+//Main thread. A predicate is converted the first time it is solved, the next queries that need it reuse it
+static shared_pool_predicate convert_predicate(const triton::ast::SharedAbstractNode& predicate)
+{
+    auto converted = converted_predicates.find(predicate.get());
+    if (converted != converted_predicates.end())
+        return converted->second.second;
+    auto result = std::make_shared<pool_predicate>();
+    result->id = next_predicate_id++;
+    result->smtlib = to_smtlib(main_converter->convert(predicate));
+    converted_predicates.emplace(predicate.get(), std::make_pair(predicate, result));
+    return result;
+}
+
+void solver_pool_submit(const shared_solver_job& job, const triton::ast::SharedAbstractNode& userConstraints, const std::vector<triton::ast::SharedAbstractNode>& predicates,
+    const triton::ast::SharedAbstractNode& constraint, solver_job_callback done)
+{
+    //The same query may have been solved before, after restoring a snapshot or in a previous run
+    std::vector<triton::ast::SharedAbstractNode> formulas = { userConstraints };
+    formulas.insert(formulas.end(), predicates.begin(), predicates.end());
+    formulas.push_back(constraint);
+
+    auto owner = std::make_shared<pool_job>();
+    owner->job = job;
+    owner->done = std::move(done);
+    job->query = make_solver_query(formulas);
+    job->timeout = cmdOptions.solver_timeout;
+    solver_statistics.queries++;
+
+    if (solver_cache_lookup(job->query, job->model, job->status)) {
+        solver_statistics.cache_hits++;
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        finish(owner);
+        return;
+    }
+    if (model_reuse_lookup(formulas, job->query.variables, job->model)) {
+        job->status = triton::engines::solver::status_e::SAT;
+        solver_statistics.model_reuse_hits++;
+        solver_cache_store(job->query, job->model, job->status);
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        finish(owner);
+        return;
+    }
+
+    //Only the predicates not solved before and the branch are converted, every configuration solves the same text
+    try {
+        if (!main_converter)
+            main_converter = std::make_unique<triton::ast::TritonToZ3>(false);
+        for (const auto& predicate : predicates)
+            owner->predicates.push_back(convert_predicate(predicate));
+        owner->formula = to_smtlib(main_converter->convert(userConstraints) && main_converter->convert(constraint));
+    }
+    catch (const z3::exception& e) {
+        owner->error = e.msg();
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        finish(owner);
+        return;
+    }
+    for (const auto& variable : job->query.variables)
+        owner->variables.emplace(variable->getName(), variable);
+
+    std::vector<unsigned int> configs = { 0 };
+    if (cmdOptions.solver_portfolio)
+        configs = portfolio_order();
+    std::vector<shared_pool_entry> attempts;
+    for (auto config : configs) {
+        auto entry = std::make_shared<pool_entry>();
+        entry->owner = owner;
+        entry->config = config;
+        attempts.push_back(entry);
+    }
+
+    owner->from_solver = true;
+    owner->attempts = attempts.size();
+    owner->remaining = attempts.size();
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    start_workers();
+    queued.insert(queued.end(), attempts.begin(), attempts.end());
+    pool_condition.notify_all();
+}
+
+void solver_pool_cancel(const shared_solver_job& job)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    job->cancelled = true;
+    shared_pool_job owner;
+    for (const auto& entry : queued) {
+        if (entry->owner->job == job)
+            owner = entry->owner;
+    }
+    for (const auto& entry : running) {
+        if (entry->owner->job == job)
+            owner = entry->owner;
+    }
+    if (!owner || owner->decided)
+        return;
+    drop_attempts(owner);
+    //The attempts interrupted finish the job when they come back
+    if (owner->remaining == 0)
+        finish(owner);
+}
+
+size_t solver_pool_pending(void)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return queued.size() + running.size();
+}
+
+void solver_pool_stop(void)
+{
+    std::vector<std::thread> stopped;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        stopping = true;
+        for (const auto& entry : queued)
+            entry->owner->job->cancelled = true;
+        queued.clear();
+        for (const auto& entry : running) {
+            entry->owner->job->cancelled = true;
+            entry->context->interrupt();
+        }
+        finished.clear();
+        if (delivery_request != -1) {
+            cancel_exec_request(delivery_request);
+            delivery_request = -1;
+        }
+        stopped.swap(workers);
+    }
+    pool_condition.notify_all();
+    for (auto& worker : stopped)
+        worker.join();
+
+    //The predicates converted belong to the Triton context, which is restarted after this
+    converted_predicates.clear();
+    main_converter.reset();
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    stopping = false;
+}
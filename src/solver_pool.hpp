@@ -0,0 +1,79 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//Triton
+#include <triton/context.hpp>
+#include <triton/ast.hpp>
+
+//Ponce
+#include "solver_cache.hpp"
+
+/*Solver pool: the queries are solved by worker threads, each worker with its own Z3 context. The formulas are converted
+to SMT-LIB when they are submitted, in the main thread, so the workers never touch the Triton context while the process
+is traced. A taken predicate is converted only the first time a query needs it. Each worker keeps its solvers between the
+queries: a predicate is asserted once, behind an indicator the queries that need it assume, and the branch to take is
+asserted in a scope that is popped after the check. The results are delivered to the main thread with execute_sync, where they go to the solver cache and the
+statistics. The solver cache and the last models are tried before queueing a query.
+In portfolio mode a query is solved at the same time with every solver configuration, each one in another worker. The
+first SAT or UNSAT answer wins and the other attempts are interrupted. The configurations are queued in the order of
+their wins, so when there are few workers the one that answers more often starts first.
+The queries are never solved in the main thread, so the wait box and the results window can always cancel them.*/
+
+//! A query to solve and, once it is delivered, its result.
+struct solver_job {
+    // The branch the query takes, filled by who submits it
+    size_t path_constraint_index = 0;
+    triton::uint64 srcAddr = 0;
+    triton::uint64 dstAddr = 0;
+
+    // Filled when it is submitted
+    solver_query query;
+    unsigned int timeout = 0;
+
+    // The result, valid once finished is set in the main thread
+    bool finished = false;
+    bool cancelled = false;
+    triton::engines::solver::status_e status = triton::engines::solver::status_e::UNKNOWN;
+    std::unordered_map<triton::usize, triton::engines::solver::SolverModel> model;
+    // Milliseconds in the solver
+    std::uint64_t time = 0;
+};
+
+typedef std::shared_ptr<solver_job> shared_solver_job;
+
+//! Called in the main thread with the job finished.
+typedef std::function<void(const shared_solver_job&)> solver_job_callback;
+
+//! Queues the user constraints, the taken predicates and the branch to take. done is called when the job finishes,
+//! also if it is cancelled.
+void solver_pool_submit(const shared_solver_job& job, const triton::ast::SharedAbstractNode& userConstraints, const std::vector<triton::ast::SharedAbstractNode>& predicates,
+    const triton::ast::SharedAbstractNode& constraint, solver_job_callback done);
+
+//! Cancels a job, it is interrupted if it is being solved.
+void solver_pool_cancel(const shared_solver_job& job);
+
+//! Returns the number of queries queued or being solved, a query raced in portfolio mode counts once per configuration.
+size_t solver_pool_pending(void);
+
+//! Name and wins of the solver configurations of the portfolio, in the order they are tried.
+std::vector<std::pair<std::string, unsigned int>> solver_portfolio_ranking(void);
+
+//! Cancels every job and stops the workers. The callbacks of the jobs cancelled are not called.
+void solver_pool_stop(void);
@@ -0,0 +1,205 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <map>
+#include <sstream>
+
+//IDA
+#include <ida.hpp>
+#include <dbg.hpp>
+#include <kernwin.hpp>
+
+//Ponce
+#include "solver_results.hpp"
+#include "solver.hpp"
+#include "constraint_slice.hpp"
+#include "globals.hpp"
+#include "utils.hpp"
+
+struct ponce_solver_results_chooser_t* ponce_solver_results_chooser = nullptr;
+
+//The jobs of the last Solve all symbolic branches, they are kept when the window is closed
+static std::vector<shared_solver_job> solver_results;
+
+//Where the process was when the branches were solved, the models are only valid for that path
+static ea_t solved_at = BADADDR;
+static size_t solved_path_constraints = 0;
+
+const int ponce_solver_results_chooser_t::widths_[] = {
+    6,
+    16,
+    16,
+    10,
+    10,
+    60
+};
+
+// column headers
+const char* ponce_solver_results_chooser_t::header_[] =
+{
+    "Index",
+    "Address",
+    "Target",
+    "Status",
+    "Time (ms)",
+    "Model"
+};
+
+ponce_solver_results_chooser_t::ponce_solver_results_chooser_t()
+    : chooser_t(CH_CAN_REFRESH | CH_CAN_DEL, qnumber(widths_), widths_, header_, SOLVER_RESULTS_TITLE) {
+    CASSERT(qnumber(widths_) == qnumber(header_));
+}
+
+size_t idaapi ponce_solver_results_chooser_t::get_count() const {
+    return solver_results.size();
+}
+
+static const char* job_status(const solver_job& job)
+{
+    if (!job.finished)
+        return job.cancelled ? "Cancelling" : "Solving";
+    if (job.cancelled)
+        return "Cancelled";
+    switch (job.status) {
+    case triton::engines::solver::status_e::SAT:
+        return "SAT";
+    case triton::engines::solver::status_e::UNSAT:
+        return "UNSAT";
+    case triton::engines::solver::status_e::TIMEOUT:
+        return "Timeout";
+    default:
+        return "Unknown";
+    }
+}
+
+// function that generates the list line
+void idaapi ponce_solver_results_chooser_t::get_row(qstrvec_t* cols_, int*, chooser_item_attrs_t* attrs,
+    size_t n) const {
+    qstrvec_t& cols = *cols_;
+
+    const auto& job = *solver_results.at(n);
+    cols[0].sprnt("%u", (unsigned int)job.path_constraint_index);
+    cols[1].sprnt(MEM_FORMAT, (ea_t)job.srcAddr);
+    cols[2].sprnt(MEM_FORMAT, (ea_t)job.dstAddr);
+    cols[3].sprnt("%s", job_status(job));
+    if (job.finished)
+        cols[4].sprnt("%u", (unsigned int)job.time);
+
+    if (job.finished && !job.cancelled && job.status == triton::engines::solver::status_e::SAT) {
+        //The variables in the order they were created
+        std::map<triton::usize, triton::engines::solver::SolverModel> ordered_model(job.model.begin(), job.model.end());
+        std::stringstream ss;
+        for (const auto& [id, model] : ordered_model) {
+            if (ss.tellp() > 0)
+                ss << ", ";
+            ss << model.getVariable()->getName() << "=0x" << std::hex << model.getValue();
+        }
+        cols[5] = ss.str().c_str();
+        attrs->flags |= CHITEM_BOLD;
+    }
+}
+
+cbret_t idaapi ponce_solver_results_chooser_t::enter(size_t n) {
+    if (n >= solver_results.size())
+        return cbret_t();
+    const auto& job = *solver_results[n];
+    if (!job.finished || job.cancelled || job.status != triton::engines::solver::status_e::SAT) {
+        msg("[!] The branch at " MEM_FORMAT " has no solution to apply\n", (ea_t)job.srcAddr);
+        return cbret_t();
+    }
+    if (!is_debugger_on()) {
+        msg("[!] The solutions can only be applied while debugging\n");
+        return cbret_t();
+    }
+    // The user may have continued the process or restored a snapshot since the branches were solved
+    const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+    if (last_instruction == nullptr || last_instruction->getAddress() != solved_at || tritonCtx.getPathConstraints().size() != solved_path_constraints) {
+        msg("[!] The process is not at " MEM_FORMAT " anymore, the solution is not applied. Solve all the branches again\n", solved_at);
+        return cbret_t();
+    }
+    set_SMT_solution(solution_from_model(job.path_constraint_index, job.srcAddr, job.dstAddr, job.model));
+    msg("[+] Solution for the branch at " MEM_FORMAT " to " MEM_FORMAT " applied\n", (ea_t)job.srcAddr, (ea_t)job.dstAddr);
+    // Reset tracer timing counter since user was using IDA and not just tracing
+    ponce_runtime_status.tracing_start_time = GetTimeMs64();
+    return cbret_t(n, chooser_base_t::NOTHING_CHANGED);
+}
+
+cbret_t idaapi ponce_solver_results_chooser_t::del(size_t n) {
+    if (n >= solver_results.size())
+        return cbret_t();
+    if (!solver_results[n]->finished)
+        solver_pool_cancel(solver_results[n]);
+    return cbret_t(n, chooser_base_t::ALL_CHANGED);
+}
+
+void refresh_solver_results(void)
+{
+    if (ponce_solver_results_chooser == nullptr)
+        return;
+    refresh_chooser(SOLVER_RESULTS_TITLE);
+}
+
+static void show_solver_results(void)
+{
+    if (ponce_solver_results_chooser != nullptr) {
+        auto form = find_widget(SOLVER_RESULTS_TITLE);
+        if (form) {
+            refresh_solver_results();
+            activate_widget(form, true);
+            return;
+        }
+    }
+    ponce_solver_results_chooser = new ponce_solver_results_chooser_t();
+    ponce_solver_results_chooser->choose();
+}
+
+void solve_all_branches(void)
+{
+    const auto& pathConstraints = tritonCtx.getPathConstraints();
+    if (pathConstraints.empty()) {
+        msg("[!] There are no symbolic conditions to solve\n");
+        return;
+    }
+
+    //The branches of the previous run that are still queued are not needed anymore
+    for (const auto& job : solver_results) {
+        if (!job->finished)
+            solver_pool_cancel(job);
+    }
+    solver_results.clear();
+    const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+    solved_at = last_instruction != nullptr ? (ea_t)last_instruction->getAddress() : BADADDR;
+    solved_path_constraints = pathConstraints.size();
+
+    auto userConstraints = get_user_constraints();
+    for (size_t i = 0; i < pathConstraints.size(); i++) {
+        for (auto const& [taken, srcAddr, dstAddr, constraint] : pathConstraints[i].getBranchConstraints()) {
+            if (taken)
+                continue;
+            auto job = std::make_shared<solver_job>();
+            job->path_constraint_index = i;
+            job->srcAddr = srcAddr;
+            job->dstAddr = dstAddr;
+
+            auto predicates = slice_path_predicates(i, { constraint, userConstraints });
+            solver_results.push_back(job);
+            solver_pool_submit(job, userConstraints, predicates, constraint, [](const shared_solver_job&) { refresh_solver_results(); });
+        }
+    }
+    msg("[+] %u branches queued to solve\n", (unsigned int)solver_results.size());
+    show_solver_results();
+}
+
+void solver_results_reset(void)
+{
+    solver_pool_stop();
+    solver_results.clear();
+    refresh_solver_results();
+}
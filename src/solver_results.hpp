@@ -0,0 +1,65 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "kernwin.hpp"
+
+//Ponce
+#include "solver_pool.hpp"
+
+#define SOLVER_RESULTS_TITLE "Ponce Solver Results"
+
+extern struct ponce_solver_results_chooser_t* ponce_solver_results_chooser;
+
+// The branches queued by Solve all symbolic branches. Enter applies a solution, Del cancels a branch not solved yet
+struct ponce_solver_results_chooser_t : public chooser_t
+{
+protected:
+    static const int widths_[];
+    static const char* header_[];
+
+public:
+    // function that returns number of lines in the list
+    virtual size_t idaapi get_count() const;
+
+    // function that generates the list line
+    virtual void idaapi get_row(qstrvec_t* cols, int* icon_,
+        chooser_item_attrs_t* attrs,
+        size_t n) const;
+
+    // function that is called when the user wants to refresh the chooser
+    virtual cbret_t idaapi refresh(ssize_t n) {
+        return adjust_last_item(n);  // try to preserve the cursor
+    }
+
+    // the user pressed Enter, the solution is written in the process
+    virtual cbret_t idaapi enter(size_t n);
+
+    // the user pressed Del, the branch is not solved
+    virtual cbret_t idaapi del(size_t n);
+
+    // function that is called when the user wants to close the chooser
+    virtual void idaapi closed() {
+        ponce_solver_results_chooser = nullptr;
+    }
+
+    ponce_solver_results_chooser_t();
+};
+
+//! Queues every non taken branch of the path constraints in the solver pool and opens the results window.
+void solve_all_branches(void);
+
+//! Refreshes the results window if it is open.
+void refresh_solver_results(void);
+
+//! Cancels the branches being solved and forgets the results, their variables don't exist anymore.
+void solver_results_reset(void);
@@ -0,0 +1,314 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <algorithm>
+#include <cctype>
+
+//Ponce
+#include "trace_scope.hpp"
+#include "globals.hpp"
+#include "blacklist.hpp"
+#include "context.hpp"
+#include "shadow_state.hpp"
+#include "annotation_queue.hpp"
+#include "utils.hpp"
+
+//IDA
+#include <dbg.hpp>
+#include <segment.hpp>
+
+//Triton
+#include <triton/context.hpp>
+#include <triton/x86Specifications.hpp>
+
+// Instructions a thunk may have between the call and the jump out of the trace scope
+#define THUNK_LENGTH 4
+
+TraceScope trace_scope;
+
+static std::string to_lower(const char* str)
+{
+    std::string lower(str);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return lower;
+}
+
+/*Splits a list of names separated by commas, semicolons or spaces*/
+static void parse_names(const char* list, std::vector<std::string>& names)
+{
+    names.clear();
+    std::string name;
+    for (const char* c = list; ; c++) {
+        if (*c == '\0' || *c == ',' || *c == ';' || std::isspace((unsigned char)*c)) {
+            if (!name.empty())
+                names.push_back(to_lower(name.c_str()));
+            name.clear();
+            if (*c == '\0')
+                break;
+        }
+        else {
+            name += *c;
+        }
+    }
+}
+
+TraceScope::TraceScope() {
+    this->stale = true;
+}
+
+void TraceScope::invalidate(void) {
+    this->stale = true;
+}
+
+void TraceScope::refresh_if_stale(void) {
+    if (!this->stale)
+        return;
+
+    parse_names(cmdOptions.trace_include, this->includes);
+    parse_names(cmdOptions.trace_exclude, this->excludes);
+
+    this->modules.clear();
+    if (!this->includes.empty() || !this->excludes.empty()) {
+        modinfo_t modinfo;
+        for (bool ok = get_first_module(&modinfo); ok; ok = get_next_module(&modinfo)) {
+            scope_module module;
+            module.start = modinfo.base;
+            module.end = modinfo.base + modinfo.size;
+            module.name = to_lower(qbasename(modinfo.name.c_str()));
+            this->modules.push_back(module);
+        }
+        std::sort(this->modules.begin(), this->modules.end(), [](const scope_module& a, const scope_module& b) { return a.start < b.start; });
+    }
+
+    this->verdicts.clear();
+    this->stale = false;
+}
+
+const scope_module* TraceScope::find_module(ea_t address) const {
+    auto it = std::upper_bound(this->modules.begin(), this->modules.end(), address, [](ea_t ea, const scope_module& module) { return ea < module.start; });
+    if (it == this->modules.begin())
+        return nullptr;
+    --it;
+    return address < it->end ? &*it : nullptr;
+}
+
+bool TraceScope::matches(const std::vector<std::string>& list, const std::string& name) {
+    if (name.empty())
+        return false;
+    //"kernel32" matches "kernel32.dll"
+    std::string without_extension = name.substr(0, name.rfind('.'));
+    for (const auto& item : list) {
+        if (item == name || item == without_extension)
+            return true;
+    }
+    return false;
+}
+
+bool TraceScope::contains(ea_t address) {
+    this->refresh_if_stale();
+    //Nothing configured, everything is traced
+    if (this->includes.empty() && this->excludes.empty())
+        return true;
+
+    auto it = this->verdicts.upper_bound(address);
+    if (it != this->verdicts.begin()) {
+        --it;
+        if (address < it->second.end)
+            return it->second.in_scope;
+    }
+
+    const scope_module* module = this->find_module(address);
+    std::string module_name = module ? module->name : "";
+    std::string segment_name;
+    ea_t start = address;
+    ea_t end = address + 1;
+    if (module != nullptr) {
+        start = module->start;
+        end = module->end;
+    }
+    segment_t* segment = getseg(address);
+    if (segment != nullptr) {
+        qstring name;
+        get_segm_name(&name, segment);
+        segment_name = to_lower(name.c_str());
+        start = segment->start_ea;
+        end = segment->end_ea;
+    }
+
+    bool in_scope;
+    if (matches(this->excludes, module_name) || matches(this->excludes, segment_name))
+        in_scope = false;
+    else if (!this->includes.empty())
+        in_scope = matches(this->includes, module_name) || matches(this->includes, segment_name);
+    else
+        in_scope = true;
+
+    if (cmdOptions.showDebugInfo)
+        msg("[+] " MEM_FORMAT "-" MEM_FORMAT " (%s %s) is %s the trace scope\n", start, end, module_name.c_str(), segment_name.c_str(), in_scope ? "in" : "out of");
+    this->verdicts[start] = { end, in_scope };
+    return in_scope;
+}
+
+int trace_step_options(void)
+{
+    int options = 0;
+    if (cmdOptions.trace_over_library_functions)
+        options |= ST_OVER_LIB_FUNC;
+    if (cmdOptions.trace_over_debug_segments)
+        options |= ST_OVER_DEBUG_SEG;
+    return options;
+}
+
+void concretize_untraced_effects(void)
+{
+    concretizeAndUntaintVolatileRegisters();
+    //We didn't see the writes done meanwhile
+    memory_cache.clear();
+
+    //The untraced code may have overwritten some tainted/symbolic bytes, we can tell it from their concrete value
+    std::vector<triton::uint64> changed;
+    for (const auto& [address, expression] : tritonCtx.getSymbolicMemory()) {
+        if (tritonCtx.getConcreteMemoryValue(address, false) != (triton::uint8)IDA_getCurrentMemoryValue((ea_t)address, 1))
+            changed.push_back(address);
+    }
+    for (const auto& address : tritonCtx.getTaintedMemory()) {
+        if (tritonCtx.getConcreteMemoryValue(address, false) != (triton::uint8)IDA_getCurrentMemoryValue((ea_t)address, 1))
+            changed.push_back(address);
+    }
+    for (const auto& address : changed) {
+        snapshot_manager.recordEngineMemory(address, 1);
+        tritonCtx.concretizeMemory(address);
+        tritonCtx.untaintMemory(address);
+        tritonCtx.setConcreteMemoryValue(address, (triton::uint8)IDA_getCurrentMemoryValue((ea_t)address, 1));
+    }
+    if (!changed.empty() && cmdOptions.showDebugInfo)
+        msg("[+] %u tainted/symbolic bytes were overwritten by the untraced code, concretizing them\n", (unsigned int)changed.size());
+    shadow_state.invalidate();
+}
+
+/*Called when the out of scope code returns to the traced code*/
+static void return_to_scope(ea_t address)
+{
+    ponce_runtime_status.runtimeTrigger.enable();
+    concretize_untraced_effects();
+    enable_step_trace(true);
+    set_step_trace_options(trace_step_options());
+}
+
+/*Calls from the traced code, the callee returns to the next instruction*/
+static bool is_call(const triton::arch::Instruction& instruction)
+{
+    switch (tritonCtx.getArchitecture()) {
+    case triton::arch::ARCH_X86:
+    case triton::arch::ARCH_X86_64:
+        return instruction.getType() == triton::arch::x86::ID_INS_CALL;
+    case triton::arch::ARCH_AARCH64:
+        return instruction.getType() == triton::arch::arm::aarch64::ID_INS_BL ||
+            instruction.getType() == triton::arch::arm::aarch64::ID_INS_BLR;
+    case triton::arch::ARCH_ARM32:
+        return instruction.getType() == triton::arch::arm::arm32::ID_INS_BL ||
+            instruction.getType() == triton::arch::arm::arm32::ID_INS_BLX;
+    default:
+        return false;
+    }
+}
+
+/*Where the code at pc is going to return to the traced code. Only known when it was reached through a traced call,
+directly or through a thunk (jmp [IAT], PLT stub...). A ret, a jmp or a tail call to out of scope code returns BADADDR*/
+static ea_t get_return_address(ea_t pc)
+{
+    //Reached through a call from the traced code
+    const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+    if (last_instruction == nullptr)
+        return BADADDR;
+    if (is_call(*last_instruction))
+        return (ea_t)last_instruction->getNextAddress();
+
+    //Reached through a thunk, the return address the call left must be the one after a call traced just before
+    ea_t return_address;
+    switch (tritonCtx.getArchitecture()) {
+    case triton::arch::ARCH_X86:
+        return_address = read_regSize_from_ida((ea_t)IDA_getCurrentRegisterValue(tritonCtx.registers.x86_esp));
+        break;
+    case triton::arch::ARCH_X86_64:
+        return_address = read_regSize_from_ida((ea_t)IDA_getCurrentRegisterValue(tritonCtx.registers.x86_rsp));
+        break;
+    case triton::arch::ARCH_AARCH64:
+        return_address = (ea_t)IDA_getCurrentRegisterValue(tritonCtx.registers.aarch64_x30);
+        break;
+    case triton::arch::ARCH_ARM32:
+        //The lowest bit is the thumb mode
+        return_address = (ea_t)IDA_getCurrentRegisterValue(tritonCtx.registers.arm32_r14) & ~(ea_t)1;
+        break;
+    default:
+        return BADADDR;
+    }
+    for (size_t age = 1; age <= THUNK_LENGTH; age++) {
+        const triton::arch::Instruction* instruction = last_triton_instructions.at(age);
+        if (instruction == nullptr)
+            break;
+        if (is_call(*instruction))
+            return instruction->getNextAddress() == return_address ? return_address : BADADDR;
+    }
+    return BADADDR;
+}
+
+bool returned_from_skipped_call(ea_t pc)
+{
+    if (trace_step_options() == 0)
+        return false;
+    const triton::arch::Instruction* last_instruction = last_triton_instructions.last();
+    if (last_instruction == nullptr || !is_call(*last_instruction) || pc != last_instruction->getNextAddress())
+        return false;
+    //call $+5 is used to get the current address, nothing was skipped there
+    for (const auto& operand : last_instruction->operands) {
+        if (operand.getType() == triton::arch::OP_IMM && operand.getConstImmediate().getValue() == pc)
+            return false;
+    }
+    return true;
+}
+
+bool skip_out_of_scope_code(ea_t pc)
+{
+    ea_t return_address = get_return_address(pc);
+    if (return_address == BADADDR || return_address == 0 || !trace_scope.contains(return_address)) {
+        if (cmdOptions.showExtraDebugInfo)
+            msg("[!] " MEM_FORMAT " wasn't reached through a traced call, tracing it\n", pc);
+        return false;
+    }
+
+    //A recursive call may skip the same code again before it returns, one pending action is enough
+    bool pending = false;
+    for (const auto& bpa : breakpoint_pending_actions) {
+        if (!bpa.watchpoint && bpa.address == return_address && bpa.callback == return_to_scope) {
+            pending = true;
+            break;
+        }
+    }
+    if (!pending) {
+        breakpoint_pending_action bpa;
+        bpa.address = return_address;
+        //If the user already had a breakpoint there we keep it
+        bpa.ignore_breakpoint = exist_bpt(return_address);
+        bpa.callback = return_to_scope;
+        if (!bpa.ignore_breakpoint)
+            add_bpt(return_address, 1, BPT_EXEC);
+        breakpoint_pending_actions.push_back(bpa);
+    }
+
+    if (cmdOptions.showDebugInfo)
+        msg("[+] " MEM_FORMAT " is out of the trace scope, running natively until " MEM_FORMAT "\n", pc, return_address);
+
+    snapshot_manager.recordUntracedSpan();
+    disable_step_trace();
+    ponce_runtime_status.runtimeTrigger.disable();
+    annotation_queue.flush();
+    return true;
+}
@@ -0,0 +1,82 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+
+//IDA
+#include <ida.hpp>
+#include <idd.hpp>
+
+struct scope_range {
+    ea_t end;
+    bool in_scope;
+};
+
+struct scope_module {
+    ea_t start;
+    ea_t end;
+    std::string name;
+};
+
+//! \class TraceScope
+//! \brief Decides which modules and segments are traced, the rest of the code runs natively.
+class TraceScope {
+
+private:
+    //! Lowercase module/segment names from the include and exclude options.
+    std::vector<std::string> includes;
+    std::vector<std::string> excludes;
+
+    //! Loaded modules sorted by address.
+    std::vector<scope_module> modules;
+
+    //! Verdicts already given, indexed by the start of the segment or module they apply to.
+    std::map<ea_t, scope_range> verdicts;
+
+    //! Set when the modules or the options changed.
+    bool stale;
+
+    //! Re-reads the options and the module list if needed.
+    void refresh_if_stale(void);
+
+    //! Returns the module containing address, nullptr if there isn't any.
+    const scope_module* find_module(ea_t address) const;
+
+    //! Returns true if name matches any of the names in the list.
+    static bool matches(const std::vector<std::string>& list, const std::string& name);
+
+public:
+    //! Constructor.
+    TraceScope();
+
+    //! The loaded modules or the options changed.
+    void invalidate(void);
+
+    //! Returns true if the instruction at address should be traced.
+    bool contains(ea_t address);
+};
+
+extern TraceScope trace_scope;
+
+//! The options for set_step_trace_options selected by the user.
+int trace_step_options(void);
+
+//! Runs natively the out of scope code at pc until it returns to the traced code. Returns false if the return address is unknown.
+bool skip_out_of_scope_code(ea_t pc);
+
+//! Returns true if IDA stepped over the call we traced last because of the step trace options.
+bool returned_from_skipped_call(ea_t pc);
+
+//! Concretizes what the code that wasn't traced could have changed: the volatile registers and the tainted/symbolic memory whose value changed.
+void concretize_untraced_effects(void);
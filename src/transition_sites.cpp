@@ -0,0 +1,190 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#include <cstring>
+
+//Ponce
+#include "transition_sites.hpp"
+#include "instruction_cache.hpp"
+#include "globals.hpp"
+#include "trace_scope.hpp"
+#include "annotation_queue.hpp"
+
+//IDA
+#include <dbg.hpp>
+#include <name.hpp>
+
+//Triton
+#include <triton/context.hpp>
+#include <triton/x86Specifications.hpp>
+
+TransitionSites transition_sites;
+
+//call dword ptr fs:[0xC0], the WOW64 processes go through it to switch to 64 bits. https://forum.hex-rays.com/viewtopic.php?f=8&t=4070
+static const unsigned char wow64_gate[] = { 0x64, 0xFF, 0x15, 0xC0, 0x00, 0x00, 0x00 };
+
+struct named_site {
+    const char* name;
+    transition_kind_t kind;
+};
+
+//The debugger names the exports of the modules with the module as prefix
+static const named_site named_sites[] = {
+    { "Wow64SystemServiceCall", TRANSITION_WOW64_GATE },
+    { "ntdll_Wow64SystemServiceCall", TRANSITION_WOW64_GATE },
+    { "KiFastSystemCall", TRANSITION_SYSCALL },
+    { "ntdll_KiFastSystemCall", TRANSITION_SYSCALL },
+    { "__kernel_vsyscall", TRANSITION_VDSO },
+    { "__kernel_rt_sigreturn", TRANSITION_VDSO },
+};
+
+static const char* vdso_modules[] = { "[vdso]", "linux-vdso.so.1", "linux-gate.so.1", "linux-vdso32.so.1", "linux-vdso64.so.1" };
+
+transition_kind_t classify_transition_opcode(ea_t address, const cached_instruction& cached)
+{
+    auto arch = tritonCtx.getArchitecture();
+    if (arch == triton::arch::ARCH_X86 && cached.size == sizeof(wow64_gate) && memcmp(cached.opcodes, wow64_gate, sizeof(wow64_gate)) == 0)
+        return TRANSITION_WOW64_GATE;
+
+    triton::arch::Instruction instruction(address, (triton::uint8*)cached.opcodes, (triton::uint32)cached.size);
+    try {
+        tritonCtx.disassembly(instruction);
+    }
+    catch (const triton::exceptions::Exception&) {
+        return TRANSITION_NONE;
+    }
+
+    switch (arch) {
+    case triton::arch::ARCH_X86:
+    case triton::arch::ARCH_X86_64:
+        if (instruction.getType() == triton::arch::x86::ID_INS_SYSCALL || instruction.getType() == triton::arch::x86::ID_INS_SYSENTER)
+            return TRANSITION_SYSCALL;
+        //int 0x2E in Windows and int 0x80 in Linux are syscalls, int 3 is a breakpoint
+        if (instruction.getType() == triton::arch::x86::ID_INS_INT) {
+            if (!instruction.operands.empty() && instruction.operands[0].getType() == triton::arch::OP_IMM) {
+                auto vector = instruction.operands[0].getConstImmediate().getValue();
+                if (vector == 0x2E || vector == 0x80)
+                    return TRANSITION_SYSCALL;
+            }
+            return TRANSITION_INTERRUPT;
+        }
+        return TRANSITION_NONE;
+    case triton::arch::ARCH_AARCH64:
+        return instruction.getType() == triton::arch::arm::aarch64::ID_INS_SVC ? TRANSITION_SYSCALL : TRANSITION_NONE;
+    case triton::arch::ARCH_ARM32:
+        return instruction.getType() == triton::arch::arm::arm32::ID_INS_SVC ? TRANSITION_SYSCALL : TRANSITION_NONE;
+    default:
+        return TRANSITION_NONE;
+    }
+}
+
+TransitionSites::TransitionSites() {
+    this->stale = true;
+}
+
+void TransitionSites::invalidate(void) {
+    this->stale = true;
+}
+
+void TransitionSites::refresh_if_stale(void) {
+    if (!this->stale)
+        return;
+
+    this->entries.clear();
+    for (const auto& site : named_sites) {
+        ea_t address = get_name_ea(BADADDR, site.name);
+        if (address == BADADDR)
+            address = get_debug_name_ea(site.name);
+        if (address != BADADDR)
+            this->entries[address] = site.kind;
+    }
+
+    this->vdso_ranges.clear();
+    modinfo_t modinfo;
+    for (bool ok = get_first_module(&modinfo); ok; ok = get_next_module(&modinfo)) {
+        const char* name = qbasename(modinfo.name.c_str());
+        for (const auto& vdso : vdso_modules) {
+            if (strcmp(name, vdso) == 0) {
+                this->vdso_ranges.emplace_back(modinfo.base, modinfo.base + modinfo.size);
+                break;
+            }
+        }
+    }
+
+    if (cmdOptions.showDebugInfo)
+        msg("[+] Found %u transition stubs and %u vDSO modules\n", (unsigned int)this->entries.size(), (unsigned int)this->vdso_ranges.size());
+    this->stale = false;
+}
+
+transition_kind_t TransitionSites::site_at(ea_t address) {
+    this->refresh_if_stale();
+    auto it = this->entries.find(address);
+    if (it != this->entries.end())
+        return it->second;
+    //There is one vDSO per process at most
+    for (const auto& [start, end] : this->vdso_ranges) {
+        if (address >= start && address < end)
+            return TRANSITION_VDSO;
+    }
+    return TRANSITION_NONE;
+}
+
+bool skip_transition(transition_kind_t kind)
+{
+    switch (kind) {
+    case TRANSITION_WOW64_GATE:
+        return cmdOptions.skip_wow64_gates;
+    case TRANSITION_SYSCALL:
+        return cmdOptions.skip_syscalls;
+    case TRANSITION_VDSO:
+        return cmdOptions.skip_vdso;
+    default:
+        return false;
+    }
+}
+
+bool skip_transition_site(ea_t pc)
+{
+    transition_kind_t kind = transition_sites.site_at(pc);
+    if (!skip_transition(kind))
+        return false;
+    if (cmdOptions.showExtraDebugInfo)
+        msg("[+] Transition stub at " MEM_FORMAT ", running it natively\n", pc);
+    return skip_out_of_scope_code(pc);
+}
+
+bool step_over_transition(ea_t pc)
+{
+    const cached_instruction* cached = instruction_cache.get(pc);
+    if (cached == nullptr || cached->transition != TRANSITION_WOW64_GATE || !skip_transition(TRANSITION_WOW64_GATE))
+        return false;
+
+    if (cmdOptions.showExtraDebugInfo)
+        msg("[+] Wow64 switching! Requesting a step_over\n");
+    //IDA can't trace the 64 bits code, we stop the tracing, do step over and the tracing goes on after it
+    snapshot_manager.recordUntracedSpan();
+    suspend_process();
+    //We don't want to do a real step over (it would reset the timer)
+    ponce_runtime_status.ignore_wow64_switching_step = true;
+    request_step_over();
+    request_continue_process();
+    run_requests();
+    return true;
+}
+
+bool finish_transition_step(void)
+{
+    if (!ponce_runtime_status.ignore_wow64_switching_step)
+        return false;
+    ponce_runtime_status.ignore_wow64_switching_step = false;
+    //The 64 bits side may have written the output of the system call
+    concretize_untraced_effects();
+    return true;
+}
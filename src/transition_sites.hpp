@@ -0,0 +1,77 @@
+//! \file
+/*
+**  Copyright (c) 2020 - Ponce
+**  Authors:
+**         Alberto Garcia Illera        agarciaillera@gmail.com
+**         Francisco Oca                francisco.oca.gonzalez@gmail.com
+**
+**  This program is under the terms of the BSD License.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+//IDA
+#include <ida.hpp>
+
+struct cached_instruction;
+
+//Places where the execution leaves the user code for the kernel or the WOW64 layer
+enum transition_kind_t : unsigned char {
+    TRANSITION_NONE = 0,
+    //call dword ptr fs:[0xC0] and Wow64SystemServiceCall, they switch to 64 bits code
+    TRANSITION_WOW64_GATE,
+    //syscall, sysenter, int 0x2E/0x80, svc and the KiFastSystemCall stub
+    TRANSITION_SYSCALL,
+    //The code mapped by the kernel in the Linux processes, __kernel_vsyscall...
+    TRANSITION_VDSO,
+    //The other int n, they are given to Triton but the kernel may write memory
+    TRANSITION_INTERRUPT,
+};
+
+//! Returns the transition kind of a decoded instruction looking only at its opcodes, called once when it is decoded.
+transition_kind_t classify_transition_opcode(ea_t address, const cached_instruction& cached);
+
+//! \class TransitionSites
+//! \brief Table with the transition sites of the loaded modules, rebuilt from the IDB when a module is loaded.
+class TransitionSites {
+
+private:
+    //! Entry points of the transition stubs found by name.
+    std::unordered_map<ea_t, transition_kind_t> entries;
+
+    //! Ranges of the vDSO modules.
+    std::vector<std::pair<ea_t, ea_t>> vdso_ranges;
+
+    //! Set when the loaded modules changed.
+    bool stale;
+
+    //! Looks for the stubs and the vDSO again if needed.
+    void refresh_if_stale(void);
+
+public:
+    //! Constructor.
+    TransitionSites();
+
+    //! The loaded modules changed.
+    void invalidate(void);
+
+    //! Returns the kind of the stub or vDSO code at address, TRANSITION_NONE for the rest of the code.
+    transition_kind_t site_at(ea_t address);
+};
+
+extern TransitionSites transition_sites;
+
+//! Returns true if the user wants Ponce to skip the sites of this kind and concretize what they change.
+bool skip_transition(transition_kind_t kind);
+
+//! Runs natively the stub or vDSO code at pc until it returns, if the user skips that kind of site. Returns true if it was skipped.
+bool skip_transition_site(ea_t pc);
+
+//! Steps over the WOW64 gate about to be executed at pc, if the user skips the WOW64 gates. Returns true if it was skipped.
+bool step_over_transition(ea_t pc);
+
+//! Called by the step over requested by step_over_transition. Returns false if the step was requested by the user.
+bool finish_transition_step(void);
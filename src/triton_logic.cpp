@@ -4,11 +4,80 @@
 #include "utils.hpp"
 #include "context.hpp"
 #include "blacklist.hpp"
+#include "shadow_state.hpp"
+#include "annotation_queue.hpp"
+#include "hybrid_execution.hpp"
+#include "trace_scope.hpp"
+#include "transition_sites.hpp"
+#include "session.hpp"
+#include "constraint_slice.hpp"
+#include "model_reuse.hpp"
+#include "solver_results.hpp"
+#include "solver.hpp"
 
 #include <ida.hpp>
 #include <dbg.hpp>
 #include <auto.hpp>
 
+#include <algorithm>
+
+#include <triton/x86Specifications.hpp>
+
+// Bytes that fxsave and the xsave family may write, they are given as a single memory operand
+#define XSAVE_AREA_SIZE PONCE_PAGE_SIZE
+
+//Returns true for the x86 instructions that dump the FPU/SSE/AVX state to memory
+static bool saves_processor_state(const triton::arch::Instruction& instruction)
+{
+    if (tritonCtx.getArchitecture() != triton::arch::ARCH_X86 && tritonCtx.getArchitecture() != triton::arch::ARCH_X86_64)
+        return false;
+    switch (instruction.getType()) {
+    case triton::arch::x86::ID_INS_FXSAVE:
+    case triton::arch::x86::ID_INS_FXSAVE64:
+    case triton::arch::x86::ID_INS_XSAVE:
+    case triton::arch::x86::ID_INS_XSAVE64:
+    case triton::arch::x86::ID_INS_XSAVEC:
+    case triton::arch::x86::ID_INS_XSAVEC64:
+    case triton::arch::x86::ID_INS_XSAVEOPT:
+    case triton::arch::x86::ID_INS_XSAVEOPT64:
+    case triton::arch::x86::ID_INS_XSAVES:
+    case triton::arch::x86::ID_INS_XSAVES64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*Skips the semantics of an already disassembled instruction that can't read or write any tainted or symbolic state.
+The engines don't change, the snapshot only needs the memory it may write.
+Returns true if the instruction was skipped*/
+static bool try_fast_path(triton::arch::Instruction* tritonInst, const cached_instruction* cached)
+{
+    if (!shadow_state.registers_clean())
+        return false;
+
+    if (cached->transition == TRANSITION_SYSCALL)
+        return false;
+
+    std::vector<std::pair<ea_t, size_t>> accesses;
+    if (!shadow_state.is_clean(*tritonInst, accesses))
+        return false;
+
+    //Triton is not going to tell us what it wrote, we forget everything it could have written
+    for (const auto& [address, size] : accesses) {
+        size_t written = size;
+        //The operand of the state saving instructions doesn't say how big their save area is
+        if (saves_processor_state(*tritonInst))
+            written = std::max<size_t>(size, XSAVE_AREA_SIZE);
+        //The instruction didn't run yet, the memory still has the original content
+        snapshot_manager.recordStore(address, written);
+        session_record_store(address, written);
+        instruction_cache.invalidate(address, written);
+        memory_cache.invalidate(address, written);
+    }
+    return true;
+}
+
 /*This function will create and fill the Triton object for every instruction
     Returns:
     0 instruction tritonized
@@ -28,39 +97,60 @@ int tritonize(ea_t pc, thid_t threadID)
     }
 
     // Show analized instruction in IDA UI
-    show_addr(pc);
-
-    //We delete the last_instruction
-    if (ponce_runtime_status.last_triton_instruction != nullptr) {
-        delete ponce_runtime_status.last_triton_instruction;
-        ponce_runtime_status.last_triton_instruction = nullptr;
-    }
+    annotation_queue.show(pc);
 
-    triton::arch::Instruction* tritonInst = new triton::arch::Instruction();
-    ponce_runtime_status.last_triton_instruction = tritonInst;
+    //We reuse the oldest instruction of the ring
+    triton::arch::Instruction* tritonInst = last_triton_instructions.next();
 
-    /*This will fill the 'cmd' (to get the instruction size) which is a insn_t structure https://www.hex-rays.com/products/ida/support/sdkdoc/classinsn__t.html */
-    if (!can_decode(pc)) {
+    const cached_instruction* cached = instruction_cache.get(pc);
+    if (cached == nullptr) {
         msg("[!] Some error decoding instruction at " MEM_FORMAT "\n", pc);
+        return 2;
     }
 
-    unsigned char opcodes[15];
-    ssize_t item_size = 0x0;
-
-    insn_t ins;
-    decode_insn(&ins, pc);
-    item_size = ins.size;
-    assert(item_size < sizeof(opcodes));
-    get_bytes(&opcodes, item_size, pc, GMB_READALL, NULL);
-
     /* Setup Triton information */
-    tritonInst->clear(); // ToDo: I think this is not necesary
-    tritonInst->setOpcode((triton::uint8*)opcodes, item_size);
+    tritonInst->setOpcode((triton::uint8*)cached->opcodes, cached->size);
     tritonInst->setAddress(pc);
     tritonInst->setThreadId(threadID);
 
+    //Triton doesn't know what the kernel does, the next instruction sees its results as concrete values
+    if (cached->transition == TRANSITION_SYSCALL && skip_transition(TRANSITION_SYSCALL)) {
+        snapshot_manager.recordUntracedSpan();
+        ponce_runtime_status.syscall_skipped = true;
+        annotation_queue.executed(pc);
+        return 0;
+    }
 
-    switch (tritonCtx.processing(*tritonInst))
+    //Decoded once for the fast path, the snapshot and the semantics
+    try {
+        tritonCtx.disassembly(*tritonInst);
+    }
+    catch (const triton::exceptions::Exception& e) {
+        msg("[!] Triton couldn't disassemble the instruction at " MEM_FORMAT ": %s\n", pc, e.what());
+        return 2;
+    }
+
+    if (try_fast_path(tritonInst, cached)) {
+        ponce_runtime_status.total_number_fast_path_ins++;
+        annotation_queue.executed(pc);
+        return 0;
+    }
+
+    //The direct memory operands are going to be read, we bring their pages at once
+    for (int i = 0; i < UA_MAXOP && cached->ins.ops[i].type != o_void; i++) {
+        if (cached->ins.ops[i].type == o_mem)
+            memory_cache.prefetch(cached->ins.ops[i].addr, get_dtype_size(cached->ins.ops[i].dtype));
+    }
+
+    //The snapshot needs what the instruction is going to overwrite in the engines
+    snapshot_manager.recordInstruction(*tritonInst);
+    auto fault = tritonCtx.buildSemantics(*tritonInst);
+
+    //The kernel may write anywhere, and Triton doesn't know what the instructions it can't process write
+    if (cached->transition == TRANSITION_SYSCALL || cached->transition == TRANSITION_INTERRUPT || fault != triton::arch::NO_FAULT)
+        memory_cache.clear();
+
+    switch (fault)
     {
     case triton::arch::NO_FAULT:
         if (cmdOptions.showExtraDebugInfo) {
@@ -77,22 +167,26 @@ int tritonize(ea_t pc, thid_t threadID)
         return 2;
     }    
 
-    /*In the case that the snapshot engine is in use we should track every memory write access*/
-    if (snapshot.exists())  {
-        for (const auto& [memory_access, node]: tritonInst->getStoreAccess()){
-            auto addr = memory_access.getAddress();
-            //This is the way to force IDA to read the value from the debugger
-            //More info here: https://www.hex-rays.com/products/ida/support/sdkdoc/dbg_8hpp.html#ac67a564945a2c1721691aa2f657a908c
-            invalidate_dbgmem_contents((ea_t)addr, memory_access.getSize()); //ToDo: Do I have to call this for every byte in memory I want to read?
-            for (unsigned int i = 0; i < memory_access.getSize(); i++) {
-                triton::uint128 value = 0;
-                //We get the memory readed
-                get_bytes(&value, 1, (ea_t)addr + i, GMB_READALL, NULL);
-
-                //We add a meomory modification to the snapshot engine
-                snapshot.addModification((ea_t)addr + i, static_cast<char>(value));
-            }
-        }
+    snapshot_manager.recordInstructionWrites(*tritonInst);
+    shadow_state.update(*tritonInst);
+
+    /*The branch is already in the path constraints, restoring the checkpoint lets the user negate it.
+    It is taken before the stores are journaled so restoring it undoes them*/
+    if (tritonInst->isBranch() && tritonInst->isSymbolized())
+        snapshot_manager.symbolicBranch(pc);
+
+    for (const auto& [memory_access, node]: tritonInst->getStoreAccess()){
+        auto addr = memory_access.getAddress();
+        /*In the case that the snapshot engine is in use we should track every memory write access.
+        The instruction didn't run yet, the memory still has the original content*/
+        if (snapshot_manager.exists())
+            snapshot_manager.recordStore((ea_t)addr, memory_access.getSize());
+        //The pages written are saved with the session
+        session_record_store((ea_t)addr, memory_access.getSize());
+
+        //Self modifying code, the next time we reach it we need to decode it again
+        instruction_cache.invalidate((ea_t)addr, memory_access.getSize());
+        memory_cache.invalidate((ea_t)addr, memory_access.getSize());
     }
 
     /* Don't write anything on symbolic/tainted branch instructions because I'll do it later*/
@@ -103,11 +197,8 @@ int tritonize(ea_t pc, thid_t threadID)
     if (cmdOptions.addCommentsSymbolicExpresions)
         comment_symbolic_expressions(tritonInst, pc);
 
-    //We only paint the executed instructions if they don't have a previous color
-    if (get_item_color(pc) == DEFCOLOR && cmdOptions.color_executed_instruction != DEFCOLOR) {
-        ponce_set_item_color(pc, cmdOptions.color_executed_instruction);
-    }
-    
+    annotation_queue.executed(pc);
+
 
     //ToDo: The isSymbolized is missidentifying like "user-controlled" some instructions: https://github.com/JonathanSalwan/Triton/issues/383
     if (tritonInst->isTainted() || tritonInst->isSymbolized()) {
@@ -117,23 +208,23 @@ int tritonize(ea_t pc, thid_t threadID)
             msg("[!] Instruction %s at " MEM_FORMAT " \n", tritonInst->isTainted() ? "tainted" : "symbolized", pc);
         }
         if (cmdOptions.RenameTaintedFunctionNames)
-            rename_tainted_function(pc);
+            annotation_queue.rename_function(pc);
         // Check if it is a conditional jump
         // We only color with a different color the symbolic conditions, to show the user he could do additional actions like solve
         if (tritonInst->isBranch()) {
             if (tritonInst->isTainted())
-                ponce_set_cmt(pc, "Tainted branch!", false, false);
+                annotation_queue.comment(pc, "Tainted branch!", false);
             else
-                ponce_set_cmt(pc, "Symbolic branch, make your choice!", false, false);
+                annotation_queue.comment(pc, "Symbolic branch, make your choice!", false);
 
             ponce_runtime_status.total_number_symbolic_conditions++;
             if (cmdOptions.color_tainted_condition != DEFCOLOR)
-                ponce_set_item_color(pc, cmdOptions.color_tainted_condition);
+                annotation_queue.color(pc, cmdOptions.color_tainted_condition);
         }
         else  {
             //It paints every tainted/symbolic instruction
             if (cmdOptions.color_tainted != DEFCOLOR)
-                ponce_set_item_color(pc, cmdOptions.color_tainted);
+                annotation_queue.color(pc, cmdOptions.color_tainted);
         }
     }
 
@@ -195,10 +286,12 @@ void triton_restart_engines()
     // Register access callback
     tritonCtx.addCallback(triton::callbacks::callback_e::GET_CONCRETE_REGISTER_VALUE, needConcreteRegisterValue_cb);
 
-    if (ponce_runtime_status.last_triton_instruction) {
-        delete ponce_runtime_status.last_triton_instruction;
-        ponce_runtime_status.last_triton_instruction = nullptr;
-    }
+    last_triton_instructions.clear();
+    //The solver helpers know the variables and path constraints of the old context
+    constraint_slice_reset();
+    model_reuse_reset();
+    solve_formula_reset();
+    solver_results_reset();
 
     tritonCtx.setMode(triton::modes::ONLY_ON_SYMBOLIZED, true);
     
@@ -223,9 +316,20 @@ void triton_restart_engines()
     ponce_runtime_status.total_number_traced_ins = 0;
     ponce_runtime_status.total_number_symbolic_ins = 0;
     ponce_runtime_status.total_number_symbolic_conditions = 0;
+    ponce_runtime_status.total_number_fast_path_ins = 0;
     ponce_runtime_status.current_trace_counter = 0;
+    ponce_runtime_status.ignore_wow64_switching_step = false;
+    ponce_runtime_status.syscall_skipped = false;
+    //The watchpoints are breakpoints stored in the IDB, they would fire in the new process
+    disarm_watchpoints();
     breakpoint_pending_actions.clear();
+    clear_blacklist_cache();
     clear_requests_queue();
+    // A new process may have different code mapped at the same addresses
+    instruction_cache.clear();
+    memory_cache.clear();
+    transition_sites.invalidate();
+    session_reset();
 
 }
 
@@ -237,7 +341,7 @@ void start_tainting_or_symbolic_analysis()
     {
         //triton_restart_engines();
         // Delete previous Ponce comments
-        if (ponce_runtime_status.last_triton_instruction == nullptr){
+        if (last_triton_instructions.last() == nullptr){
             /* We don't want to delete the comments in case we are re-enabling 
             an current Ponce tracing like when the user just disables Ponce
             to prevent instrumenting a function but he's gonna reenabling in after it*/
@@ -245,8 +349,14 @@ void start_tainting_or_symbolic_analysis()
         }
         ponce_runtime_status.runtimeTrigger.enable();
         ponce_runtime_status.analyzed_thread = get_current_thread();
+        //The user could have modified the memory while the tracing was disabled
+        memory_cache.clear();
         enable_step_trace(true);
-        set_step_trace_options(0);
+        set_step_trace_options(trace_step_options());
         ponce_runtime_status.tracing_start_time = 0;
     }
+    else {
+        //The user is tainting/symbolizing something new while running natively, it may not be watched
+        resume_tracing();
+    }
 }
\ No newline at end of file
@@ -14,12 +14,7 @@
 #include <iostream>
 #include <fstream>
 //Used in GetTimeMs64
-#ifdef _WIN32
-#include <Windows.h>
-#else
-#include <sys/time.h>
-#include <ctime>
-#endif
+#include <chrono>
 
 
 //Triton
@@ -39,6 +34,7 @@
 #include "context.hpp"
 #include "blacklist.hpp"
 #include "callbacks.hpp"
+#include "annotation_queue.hpp"
 
 
 
@@ -248,7 +244,7 @@ void comment_symbolic_expressions(triton::arch::Instruction* tritonInst, ea_t ad
         oss << expr << "\n";
     }
 
-    ponce_set_cmt(address, oss.str().c_str(), false);
+    annotation_queue.comment(address, oss.str());
 }
 
 std::string notification_code_to_string(int notification_code)
@@ -361,7 +357,7 @@ Returns true if the user say yes.*/
 bool ask_for_execute_native()
 {
     //Is there any snapshot?
-    if (!snapshot.exists())
+    if (!snapshot_manager.exists())
         return true;
     //If so we should say to the user that he cannot execute native code and expect the snapshot to work
     int answer = ask_yn(1, "[?] If you execute native code (without tracing) Ponce cannot trace all the memory modifications so the execution snapshot will be deleted. Do you still want to do it? (Y/n):");
@@ -422,39 +418,10 @@ qstring get_callee_name(ea_t address) {
     return name;
 }
 
+/* Monotonic time in milliseconds, only used to measure intervals*/
 std::uint64_t GetTimeMs64(void)
 {
-#ifdef _WIN32
-    /* Windows */
-    FILETIME ft;
-    LARGE_INTEGER li;
-
-    /* Get the amount of 100 nano seconds intervals elapsed since January 1, 1601 (UTC) and copy it
-    * to a LARGE_INTEGER structure. */
-    GetSystemTimeAsFileTime(&ft);
-    li.LowPart = ft.dwLowDateTime;
-    li.HighPart = ft.dwHighDateTime;
-
-    std::uint64_t ret = li.QuadPart;
-    ret -= 116444736000000000LL; /* Convert from file time to UNIX epoch time. */
-    ret /= 10000; /* From 100 nano seconds (10^-7) to 1 millisecond (10^-3) intervals */
-
-    return ret;
-#else
-    /* Linux */
-    struct timeval tv;
-
-    gettimeofday(&tv, NULL);
-
-    triton::uint64 ret = tv.tv_usec;
-    /* Convert from micro seconds (10^-6) to milliseconds (10^-3) */
-    ret /= 1000;
-
-    /* Adds the seconds (10^0) after converting them to milliseconds (10^-3) */
-    ret += (tv.tv_sec * 1000);
-
-    return ret;
-#endif
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 /* Gets current instruction. Only possible if */
@@ -476,15 +443,12 @@ engine is restarted with another run. We do this to prevent polluting the IDA UI
 void delete_ponce_comments() {
     unsigned int count_comments = 0;
     unsigned int count_colors = 0;
-    ea_t snapshot_address = 0;
     for (auto& [address, insinfo]: ponce_comments) {      
         if (!insinfo.comment.empty()) { //comment
             set_cmt(address, "", false);
             count_comments++;
         }
         if (!insinfo.snapshot_comment.empty()) { //extra comment
-            if (snapshot.exists())
-                snapshot_address = address;
             set_cmt(address, "", false);
         }
         if (insinfo.color != DEFCOLOR) { //color
@@ -493,12 +457,12 @@ void delete_ponce_comments() {
         }
     }
     ponce_comments.clear();
+    //Whatever was not written yet would paint everything again
+    annotation_queue.clear();
     msg("[+] Deleted %u comments and %u colored addresses\n", count_comments, count_colors);
 
-    // If snapshot exists lets put it back
-    if (snapshot_address) {
-        ponce_set_cmt(snapshot_address, "Snapshot taken here", false, true);
-    }
+    // If there are snapshots lets put them back
+    snapshot_manager.showComments();
 }
 
 void ponce_set_item_color(ea_t ea, bgcolor_t color) {
@@ -514,29 +478,14 @@ void ponce_set_item_color(ea_t ea, bgcolor_t color) {
     set_item_color(ea, color);
 }
 
-/* Wrapper to keep track of added comments so we can delete them after*/
-bool ponce_set_cmt(ea_t ea, const char* comm, bool rptble, bool snapshot, bool increment_index) {
-    qstring buf;
+/* Writes the comment prefixed with the hit count we keep in ponce_comments*/
+static bool ponce_write_cmt(ea_t ea, const char* comm, bool rptble, bool snapshot) {
+    struct instruction_info& insinfo = ponce_comments[ea];
     qstring new_comment;
-    if (increment_index && get_cmt(&buf, ea, rptble) != -1) {
-        auto first_space = strchr(buf.c_str(), ' ');
-        // there is a previous comment. Let's try to get the hit count
-        if (first_space){
-            try {
-                auto n_hit = std::stoi(std::string(buf.c_str(), first_space - buf.c_str()));
-                new_comment.sprnt("%d hits. %s", ++n_hit, comm);
-                //return set_cmt(ea, new_comment.c_str(), rptble);
-            }
-            catch (...) {}
-        }
-        if(new_comment.empty()){
-            new_comment.sprnt("%d hits. %s", 2, comm);
-            //return set_cmt(ea, new_comment.c_str(), rptble);     
-        }
-    }
-    else { //its a new comment
+    if (!snapshot && insinfo.hits > 1)
+        new_comment.sprnt("%u hits. %s", insinfo.hits, comm);
+    else
         new_comment = comm;
-    }
 
     auto new_line_pos = new_comment.find('\n');
     /* Lets only get the text about Symbolic/Taint instruction not the memory or
@@ -547,25 +496,32 @@ bool ponce_set_cmt(ea_t ea, const char* comm, bool rptble, bool snapshot, bool i
     else
         pseudocode_comment = std::string(new_comment.c_str());
 
-    //if it is a new comment we add it to ponce_comments
-    if (ponce_comments.count(ea) > 0) {
-        if (snapshot)
-            ponce_comments[ea].snapshot_comment = pseudocode_comment;
-        else
-            ponce_comments[ea].comment = pseudocode_comment;
-    }
-    else  {
-        struct instruction_info insinfo;
-        if (snapshot)
-            insinfo.snapshot_comment = pseudocode_comment;
-        else
-            insinfo.comment = pseudocode_comment;
+    if (snapshot)
+        insinfo.snapshot_comment = pseudocode_comment;
+    else
+        insinfo.comment = pseudocode_comment;
 
-        ponce_comments[ea] = insinfo;
-    }
     return set_cmt(ea, new_comment.c_str(), rptble);
 }
 
+/* Wrapper to keep track of added comments so we can delete them after*/
+bool ponce_set_cmt(ea_t ea, const char* comm, bool rptble, bool snapshot, bool increment_index) {
+    struct instruction_info& insinfo = ponce_comments[ea];
+    if (!snapshot) {
+        if (increment_index)
+            insinfo.hits++;
+        else //its a new comment
+            insinfo.hits = comm[0] != '\0' ? 1 : 0;
+    }
+    return ponce_write_cmt(ea, comm, rptble, snapshot);
+}
+
+/* Same as ponce_set_cmt but for a comment that was hit several times since it was written the last time*/
+bool ponce_add_cmt_hits(ea_t ea, const char* comm, bool rptble, unsigned int hits) {
+    ponce_comments[ea].hits += hits;
+    return ponce_write_cmt(ea, comm, rptble, false);
+}
+
 /*This function gets the tainted operands for an instruction and add a comment to that instruction with this info*/
 void comment_controlled_operands(triton::arch::Instruction* tritonInst, ea_t pc)
 {
@@ -607,6 +563,6 @@ void comment_controlled_operands(triton::arch::Instruction* tritonInst, ea_t pc)
 
     //We set the comment
     if (comment.str().size() > 0) {
-        ponce_set_cmt(pc, comment.str().c_str(), false);
+        annotation_queue.comment(pc, comment.str());
     }
 }
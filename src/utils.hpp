@@ -37,5 +37,6 @@ short read_unicode_char_from_ida(ea_t address);
 ea_t current_instruction();
 void delete_ponce_comments();
 bool ponce_set_cmt(ea_t ea, const char* comm, bool rptble, bool snapshot = false, bool increment_index = true);
+bool ponce_add_cmt_hits(ea_t ea, const char* comm, bool rptble, unsigned int hits);
 void ponce_set_item_color(ea_t ea, bgcolor_t color);
 void comment_controlled_operands(triton::arch::Instruction* tritonInst, ea_t pc);
\ No newline at end of file